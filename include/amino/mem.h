@@ -626,9 +626,9 @@ aa_bits_set( aa_bits *b, size_t i, int val )
     size_t j,k;
     AA_BITS_JK(i,j,k);
     if( val ) {
-        b[j] |=  0x1<<k;
+        b[j] |=  (aa_bits)(1u<<k);
     } else {
-        b[j] &= ~ ( 0x1<<k );
+        b[j] &= ~ (aa_bits)(1u<<k);
     }
 }
 
@@ -639,8 +639,8 @@ static inline void
 aa_bits_and( aa_bits *a, const aa_bits *b, size_t n_bits )
 {
     size_t n_words = aa_bits_words(n_bits);
-    while( n_words ) {
-        a[n_words] &= b[n_words];
+    for( size_t i = 0; i < n_words; i ++ ) {
+        a[i] &= b[i];
     }
 }
 
@@ -651,8 +651,8 @@ static inline void
 aa_bits_or( aa_bits *a, const aa_bits *b, size_t n_bits )
 {
     size_t n_words = aa_bits_words(n_bits);
-    while( n_words ) {
-        a[n_words] |= b[n_words];
+    for( size_t i = 0; i < n_words; i ++ ) {
+        a[i] |= b[i];
     }
 }
 
@@ -663,11 +663,31 @@ static inline void
 aa_bits_xor( aa_bits *a, const aa_bits *b, size_t n_bits )
 {
     size_t n_words = aa_bits_words(n_bits);
-    while( n_words ) {
-        a[n_words] ^= b[n_words];
+    for( size_t i = 0; i < n_words; i ++ ) {
+        a[i] ^= b[i];
     }
 }
 
+/**
+ * Count the set bits in bitset b of n_bits bits.
+ *
+ * Bits of the last word beyond n_bits must be zero.
+ */
+static inline size_t
+aa_bits_count( const aa_bits *b, size_t n_bits )
+{
+    size_t n_words = aa_bits_words(n_bits);
+    size_t c = 0;
+    for( size_t i = 0; i < n_words; i ++ ) {
+#ifdef __GNUC__
+        c += (size_t)__builtin_popcount( (unsigned)b[i] );
+#else
+        for( unsigned x = (unsigned)b[i]; x; x &= x-1 ) c++;
+#endif
+    }
+    return c;
+}
+
 
 /************/
 /* Swapping */
@@ -0,0 +1,96 @@
+/* -*- mode: C++; c-basic-offset: 4; -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2016, Rice University
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@rice.edu>
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of copyright holder the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef AMINO_RX_OMPL_SCENE_MOTION_VALIDATOR_H
+#define AMINO_RX_OMPL_SCENE_MOTION_VALIDATOR_H
+
+/**
+ * @file scene_motion_validator.h
+ * @brief OMPL Motion Validator
+ */
+
+#include <ompl/base/MotionValidator.h>
+
+#include "scene_state_space.h"
+#include "scene_state_validity_checker.h"
+
+namespace amino {
+
+/**
+ * Validate motions with discrete and continuous collision checking.
+ *
+ * As with ompl::base::DiscreteMotionValidator, every state at the
+ * space's validity-checking resolution must be valid.  In addition,
+ * each segment covering segment_steps of those states is checked with
+ * a single call to aa_rx_cl_check_motion(), so collisions between
+ * resolution states are also caught.
+ */
+class sgMotionValidator : public ::ompl::base::MotionValidator {
+public:
+
+    /**
+     * Create a motion validator that shares the collision context of
+     * checker.
+     */
+    sgMotionValidator( sgSpaceInformation *si,
+                       sgStateValidityChecker *checker );
+
+    virtual bool checkMotion( const ompl::base::State *s1,
+                              const ompl::base::State *s2 ) const;
+
+    virtual bool checkMotion( const ompl::base::State *s1,
+                              const ompl::base::State *s2,
+                              std::pair<ompl::base::State*, double> &lastValid ) const;
+
+    /**
+     * Number of discrete resolution steps covered by each continuous
+     * check.
+     */
+    unsigned segment_steps;
+
+private:
+    bool check_segment( const ompl::base::State *s1,
+                        const ompl::base::State *s2 ) const;
+
+    sgStateSpace *space;
+    sgStateValidityChecker *checker;
+};
+
+}
+
+#endif /*AMINO_RX_OMPL_SCENE_MOTION_VALIDATOR_H*/
@@ -90,6 +90,8 @@ struct aa_rx_mp {
 
     unsigned simplify : 1;
 
+    size_t ik_threads;
+
     amino::sgWorkspaceGoal *lazy_samples;
 };
 
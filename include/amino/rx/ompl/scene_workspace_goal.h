@@ -59,13 +59,14 @@ class sgWorkspaceGoal : public ompl::base::GoalLazySamples {
 public:
     sgWorkspaceGoal (const sgSpaceInformation::Ptr &si,
                      size_t n_e, const aa_rx_frame_id *frames,
-                     const double *E, size_t ldE );
+                     const double *E, size_t ldE,
+                     size_t n_threads );
 
     virtual ~sgWorkspaceGoal ();
 
     const sgSpaceInformation::Ptr &typed_si;
     struct aa_rx_ksol_opts *ko;
-    struct aa_rx_ik_jac_cx *ik_cx;
+    struct aa_rx_ik_parallel_cx *ik_cx;
 
     ompl::base::StateSamplerPtr state_sampler;
     sgSpaceInformation::StateType *seed;
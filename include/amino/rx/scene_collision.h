@@ -102,11 +102,56 @@ aa_rx_cl_set_get( const struct aa_rx_cl_set *cl_set,
 AA_API void
 aa_rx_cl_set_merge(struct aa_rx_cl_set* into, const struct aa_rx_cl_set* from);
 
+/**
+ * Remove from set `into' all elements not in set `from'.
+ *
+ * This is an intersection operation, with the result stored in `into'.
+ */
+AA_API void
+aa_rx_cl_set_intersect(struct aa_rx_cl_set* into, const struct aa_rx_cl_set* from);
+
+/**
+ * Toggle in set `into' all elements in set `from'.
+ *
+ * This is a symmetric difference operation, with the result stored in
+ * `into'.
+ */
+AA_API void
+aa_rx_cl_set_symdiff(struct aa_rx_cl_set* into, const struct aa_rx_cl_set* from);
+
+/**
+ * Remove all elements from the set.
+ */
+AA_API void
+aa_rx_cl_set_clear( struct aa_rx_cl_set *cl_set );
+
+/**
+ * Return the number of frame pairs in the set.
+ */
+AA_API size_t
+aa_rx_cl_set_count( const struct aa_rx_cl_set *cl_set );
+
+/**
+ * Callback for aa_rx_cl_set_map(), called with frames i >= j.
+ */
+typedef void aa_rx_cl_set_fun( void *cx, aa_rx_frame_id i, aa_rx_frame_id j );
+
+/**
+ * Call fun for each frame pair in the set.
+ *
+ * Pairs are visited in order of i, then j.
+ */
+AA_API void
+aa_rx_cl_set_map( const struct aa_rx_cl_set *cl_set,
+                  aa_rx_cl_set_fun *fun, void *cx );
+
 /**
  * Opaque type for collision detection context.
  */
 struct aa_rx_cl;
 
+struct aa_rx_sg_sub;
+
 /**
  * Initialize the collision structures within scene_graph.
  */
@@ -150,6 +195,22 @@ aa_rx_cl_allow_name( struct aa_rx_cl *cl,
                      const char *frame1,
                      int allowed );
 
+/**
+ * Declare which geometry moves between collision checks.
+ *
+ * Only frames that depend on the configurations of ssg are moving.
+ * If ssg is NULL (the default), every frame that depends on any
+ * configuration is moving.
+ *
+ * aa_rx_cl_check() updates and collides only the moving geometry
+ * against the static and moving geometry.  The static geometry is
+ * placed using the transforms passed to the next aa_rx_cl_check()
+ * and then held fixed; call this function again to place it anew.
+ */
+AA_API void
+aa_rx_cl_set_moving( struct aa_rx_cl *cl,
+                     const struct aa_rx_sg_sub *ssg );
+
 /**
  * Detect collisions.
  *
@@ -164,6 +225,96 @@ aa_rx_cl_check( struct aa_rx_cl *cl,
                 const double *TF, size_t ldTF,
                 struct aa_rx_cl_set *cl_set );
 
+/**
+ * Detect collisions along a motion.
+ *
+ * Each moving frame travels from its pose in TF_start to its pose in
+ * TF_end by linear interpolation of translation and rotation.  Static
+ * geometry stays at TF_start.  Uses continuous collision detection,
+ * so thin obstacles between the endpoints are not missed.
+ *
+ * If cl_set is non-NULL, it will be filled in with all detected collisions.
+ * If cl_set is NULL, collision checking may short-circuit after the first collision is detected.
+ *
+ * @returns 0 if no collisions are detected and non-zero if any collisions are detected.
+ *
+ * @sa aa_rx_cl_set_moving()
+ */
+AA_API int
+aa_rx_cl_check_motion( struct aa_rx_cl *cl,
+                       size_t n_tf,
+                       const double *TF_start, size_t ld_start,
+                       const double *TF_end, size_t ld_end,
+                       struct aa_rx_cl_set *cl_set );
+
+/**
+ * Opaque type for the results of a distance query.
+ *
+ * Holds the signed distance, closest points, and normal of each frame
+ * pair nearer than the query margin.
+ */
+struct aa_rx_cl_dist;
+
+/**
+ * Create a distance result for the frames of cl.
+ */
+AA_API struct aa_rx_cl_dist *
+aa_rx_cl_dist_create( const struct aa_rx_cl *cl );
+
+/**
+ * Destroy a distance result.
+ */
+AA_API void
+aa_rx_cl_dist_destroy( struct aa_rx_cl_dist *dist );
+
+/**
+ * Compute signed distances between frames.
+ *
+ * Distances are computed for all frame pairs that are not allowed to
+ * collide.  Negative distances are penetration depths.  Only pairs
+ * nearer than margin are computed exactly; pass INFINITY for all
+ * pairs.
+ *
+ * @param margin the distance beyond which pairs are ignored
+ * @param dist   if non-NULL, filled with the distance of each pair
+ *               nearer than margin
+ *
+ * @returns the minimum distance, or margin if no pair is nearer
+ */
+AA_API double
+aa_rx_cl_distance( struct aa_rx_cl *cl,
+                   size_t n_tf,
+                   const double *TF, size_t ldTF,
+                   double margin,
+                   struct aa_rx_cl_dist *dist );
+
+/**
+ * Retrieve the distance between frames i and j.
+ *
+ * Points and normal are in the global frame.  The normal points from
+ * p_i toward p_j, i.e., the direction that separates j from i.  Any
+ * of p_i, p_j, or n may be NULL.
+ *
+ * @returns the signed distance, or INFINITY if the pair was not
+ * nearer than the margin
+ */
+AA_API double
+aa_rx_cl_dist_get( const struct aa_rx_cl_dist *dist,
+                   aa_rx_frame_id i, aa_rx_frame_id j,
+                   double p_i[3], double p_j[3], double n[3] );
+
+/**
+ * Retrieve the minimum distance from frame i to any other frame.
+ *
+ * @param j if non-NULL, set to the nearest frame, or
+ *          AA_RX_FRAME_NONE if no frame was nearer than the margin
+ *
+ * @returns the minimum distance, or the margin if no frame was nearer
+ */
+AA_API double
+aa_rx_cl_dist_frame( const struct aa_rx_cl_dist *dist,
+                     aa_rx_frame_id i, aa_rx_frame_id *j );
+
 /**
  * Allow all collisions at configuration q.
  */
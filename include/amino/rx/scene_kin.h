@@ -143,6 +143,27 @@ aa_rx_ksol_opts_set_max_iterations( struct aa_rx_ksol_opts *opts, size_t n );
 AA_API void
 aa_rx_ksol_opts_set_frame( struct aa_rx_ksol_opts *opts, aa_rx_frame_id frame );
 
+/**
+ * Set the frames to solve for multiple goals.
+ *
+ * Frame i of frames is driven to goal transform i.  Without frames,
+ * a solve for several goals uses the leaf frames of the
+ * sub-scenegraph, in order.
+ */
+AA_API void
+aa_rx_ksol_opts_take_frames( struct aa_rx_ksol_opts *opts, size_t n,
+                             aa_rx_frame_id *frames, enum aa_mem_refop refop );
+
+/**
+ * Set the relative weight of each goal.
+ *
+ * The error and Jacobian rows of goal i are scaled by weights[i].  A
+ * goal with zero weight is ignored.
+ */
+AA_API void
+aa_rx_ksol_opts_take_frame_weights( struct aa_rx_ksol_opts *opts, size_t n,
+                                    double *weights, enum aa_mem_refop refop );
+
 /**
  * Set a reference configuration.
  */
@@ -180,12 +201,191 @@ aa_rx_ksol_opts_center_configs( struct aa_rx_ksol_opts *opts,
                                 const struct aa_rx_sg_sub *ssg,
                                 double gain );
 
+/*-- Analytic IK Solvers --*/
+
+/**
+ * Type signature of a closed-form IK solver.
+ *
+ * @param data  The solver's data, from struct aa_rx_ik_analytic
+ * @param E     Goal pose of the tip relative to the chain root, as a
+ *              quaternion-translation
+ * @param n_q   Number of chain configurations
+ * @param q     On entry, the seed configuration; on exit, the
+ *              solution.  Solvers with several solutions should pick
+ *              the one nearest the seed.
+ *
+ * @returns 0 on success, nonzero if there is no solution
+ */
+typedef int aa_rx_ik_analytic_fun( const void *data, const double E[7],
+                                   size_t n_q, double *q );
+
+/**
+ * A closed-form IK solver for a kinematic chain.
+ *
+ * The solver applies to the sub-scenegraph created by
+ * aa_rx_sg_chain_create() for the same root and tip, with
+ * configurations in the listed order.
+ */
+struct aa_rx_ik_analytic {
+    const char *root;                /**< Root frame (exclusive), or "" for the global frame */
+    const char *tip;                 /**< Tip frame */
+    size_t config_count;             /**< Number of configurations */
+    const char *const *configs;      /**< Configuration names, in chain order */
+    aa_rx_ik_analytic_fun *solve;    /**< The solver */
+    const void *data;                /**< Data passed to solve */
+};
+
+/**
+ * Register a closed-form IK solver with a scene graph.
+ *
+ * The Jacobian and Levenberg-Marquardt solvers created afterwards for
+ * a matching chain use it for single goals on the chain tip, and fall
+ * back to iteration otherwise.  The solver must remain valid for the
+ * lifetime of scenegraph.
+ */
+AA_API void
+aa_rx_sg_add_ik( struct aa_rx_sg *scenegraph,
+                 const struct aa_rx_ik_analytic *ik );
+
+/**
+ * Find a registered closed-form IK solver for a sub-scenegraph.
+ *
+ * @returns the most recently registered matching solver, or NULL
+ */
+AA_API const struct aa_rx_ik_analytic *
+aa_rx_sg_sub_ik( const struct aa_rx_sg_sub *ssg );
+
+/*-- IK Seed Cache --*/
+
+/**
+ * A cache of converged IK solutions, hashed by the cell of their goal
+ * pose.
+ *
+ * Cells are boxes of the goal translation and rotation vector.  Each
+ * cell keeps a few recent solutions.  A cache may be shared between
+ * threads.
+ */
+struct aa_rx_ik_cache;
+
+/**
+ * Create an IK cache.
+ *
+ * @param n_q        Number of sub-scenegraph configurations
+ * @param cell_trans Cell size for translation
+ * @param cell_angle Cell size for rotation, in radians
+ */
+AA_API struct aa_rx_ik_cache *
+aa_rx_ik_cache_create( size_t n_q, double cell_trans, double cell_angle );
+
+/**
+ * Destroy an IK cache.
+ */
+AA_API void
+aa_rx_ik_cache_destroy( struct aa_rx_ik_cache *cache );
+
+/**
+ * Return the number of cached solutions.
+ */
+AA_API size_t
+aa_rx_ik_cache_size( struct aa_rx_ik_cache *cache );
+
+/**
+ * Add the solution q for goal pose E.
+ */
+AA_API void
+aa_rx_ik_cache_insert( struct aa_rx_ik_cache *cache,
+                       const double E[7], size_t n_q, const double *q );
+
+/**
+ * Find cached solutions for goals near E, nearest first.
+ *
+ * Searches the cell of E and its neighbors in translation and
+ * rotation.
+ *
+ * @returns the number of solutions written to the columns of Q, at
+ * most n_max
+ */
+AA_API size_t
+aa_rx_ik_cache_lookup( struct aa_rx_ik_cache *cache, const double E[7],
+                       size_t n_max,
+                       size_t n_q, double *Q, size_t ld_Q );
+
+/**
+ * Write the cache to a file.
+ *
+ * The file is in binary, native byte order.
+ *
+ * @returns 0 on success, -1 on failure
+ */
+AA_API int
+aa_rx_ik_cache_save( struct aa_rx_ik_cache *cache, const char *filename );
+
+/**
+ * Read a cache written by aa_rx_ik_cache_save().
+ *
+ * @returns the cache, or NULL on failure
+ */
+AA_API struct aa_rx_ik_cache *
+aa_rx_ik_cache_load( const char *filename );
+
+/**
+ * Fill the cache with the poses of frame at random configurations.
+ *
+ * Sub-scenegraph configurations are sampled uniformly within their
+ * position limits, or within [-pi, pi] when unlimited.  Other
+ * configurations are taken from q_all.  Poses are relative to the
+ * parent of the first frame of ssg, so the cache stays valid when
+ * configurations outside ssg change.
+ *
+ * @param cache     The cache
+ * @param ssg       The sub-scenegraph
+ * @param frame     The goal frame, or AA_RX_FRAME_NONE for the last
+ *                  frame of ssg
+ * @param n_all     Size of q_all
+ * @param q_all     Full configuration
+ * @param n_samples Number of samples
+ *
+ * @returns the number of solutions added
+ */
+AA_API size_t
+aa_rx_ik_cache_precompute( struct aa_rx_ik_cache *cache,
+                           const struct aa_rx_sg_sub *ssg, aa_rx_frame_id frame,
+                           size_t n_all, const double *q_all,
+                           size_t n_samples );
+
+/**
+ * Attach an IK cache to a sub-scenegraph, or detach it with NULL.
+ *
+ * For single goals, aa_rx_ik_jac_solve() and aa_rx_ik_lm_solve() then
+ * try the nearest cached solutions as seeds before the seed of the
+ * options, and add converged solutions to the cache.  Goals are poses
+ * of the solver's goal frame relative to the parent of the first frame
+ * of ssg, placed by the seed of the options, so a cache should serve
+ * one goal frame.  The cache must outlive its use by ssg.
+ */
+AA_API void
+aa_rx_sg_sub_set_ik_cache( struct aa_rx_sg_sub *ssg, struct aa_rx_ik_cache *cache );
+
+/**
+ * Return the IK cache of a sub-scenegraph, or NULL.
+ */
+AA_API struct aa_rx_ik_cache *
+aa_rx_sg_sub_get_ik_cache( const struct aa_rx_sg_sub *ssg );
+
 /*-- Jacobian IK Solver --*/
 
 struct aa_rx_ik_jac_cx;
 
 /**
  * Create a Jacobian IK solver.
+ *
+ * If a closed-form solver is registered for ssg (see
+ * aa_rx_sg_sub_ik()), aa_rx_ik_jac_solve() uses it when it applies.
+ *
+ * The solver preallocates all workspace for ssg, so repeated calls to
+ * aa_rx_ik_jac_solve() do not allocate memory.  Because the workspace
+ * is shared between calls, a solver must not be used by multiple
+ * threads at once; create one solver per thread instead.
  */
 AA_API struct aa_rx_ik_jac_cx *
 aa_rx_ik_jac_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ksol_opts *opts );
@@ -211,6 +411,157 @@ AA_API int aa_rx_ik_jac_fun( void *context,
                              size_t n_tf, const double *TF, size_t ld_TF,
                              size_t n_q, double *q );
 
+/*-- Levenberg-Marquardt IK Solver --*/
+
+struct aa_rx_ik_lm_cx;
+
+/**
+ * Create a Levenberg-Marquardt IK solver.
+ *
+ * The solver iterates damped Newton steps directly on the pose error,
+ * adapting the damping from the k_dls option, clamping to joint
+ * limits, and biasing toward the configuration set by
+ * aa_rx_ksol_opts_take_config() in the Jacobian nullspace.  It uses
+ * the same tolerances as the Jacobian IK solver, and typically needs
+ * far fewer kinematics evaluations.
+ *
+ * As with aa_rx_ik_jac_cx_create(), a registered closed-form solver
+ * takes precedence when it applies, the workspace is preallocated,
+ * and a solver must not be used by multiple threads at once.
+ */
+AA_API struct aa_rx_ik_lm_cx *
+aa_rx_ik_lm_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ksol_opts *opts );
+
+/**
+ * Destroy a Levenberg-Marquardt IK solver.
+ */
+AA_API void
+aa_rx_ik_lm_cx_destroy( struct aa_rx_ik_lm_cx *cx );
+
+/**
+ * Solve the IK using Levenberg-Marquardt.
+ *
+ * @returns 0 on success, or AA_RX_NO_SOLUTION | AA_RX_NO_IK if the
+ * tolerances were not reached within max_iterations.
+ */
+AA_API int aa_rx_ik_lm_solve( const struct aa_rx_ik_lm_cx *context,
+                              size_t n_tf, const double *TF, size_t ld_TF,
+                              size_t n_q, double *q );
+
+/**
+ * Solve the IK for a sequence of goals, e.g., a Cartesian path.
+ *
+ * The first point starts from the configuration seed of the options.
+ * Each later point starts from the solution of the previous point and
+ * reuses its kinematics, so closely spaced points take few
+ * iterations and the solutions stay on the same branch.
+ *
+ * @param context The solver
+ * @param n_pts   Number of points
+ * @param n_tf    Number of goal transforms per point
+ * @param TF      Goal transforms.  Goal k of point p is at
+ *                TF + (p*n_tf + k)*ld_TF.
+ * @param ld_TF   Leading dimension of TF
+ * @param n_q     Size of the sub-configuration
+ * @param Q       Output configurations, one column per point
+ * @param ld_Q    Leading dimension of Q
+ * @param status  Output status of each point, as aa_rx_ik_lm_solve(),
+ *                or NULL
+ * @param dq_max  Output largest joint change from the previous point
+ *                (or the seed) to each point, or NULL
+ *
+ * @returns 0 if every point converged, or the status of a failed point
+ */
+AA_API int aa_rx_ik_lm_solve_batch( const struct aa_rx_ik_lm_cx *context,
+                                    size_t n_pts,
+                                    size_t n_tf, const double *TF, size_t ld_TF,
+                                    size_t n_q, double *Q, size_t ld_Q,
+                                    int *status, double *dq_max );
+
+/**
+ * Convenience function for Levenberg-Marquardt IK solver, matching
+ * aa_rx_ik_fun.
+ */
+AA_API int aa_rx_ik_lm_fun( void *context,
+                            size_t n_tf, const double *TF, size_t ld_TF,
+                            size_t n_q, double *q );
+
+/*-- Parallel Multi-Start IK Solver --*/
+
+struct aa_rx_ik_parallel_cx;
+
+/**
+ * Create a multi-start IK solver.
+ *
+ * Each solve runs the Levenberg-Marquardt solver from n_seeds seeds
+ * on a pool of threads, each with its own preallocated solver.  The
+ * first seed is the configuration seed of opts, and the rest are
+ * sampled uniformly within the joint limits.  Restarts help most on
+ * goals that are unreachable or near singularities, where a single
+ * seed often fails.
+ *
+ * @param ssg       The sub-scenegraph to solve for
+ * @param opts      Solver options, read at each solve
+ * @param n_threads Number of worker threads in addition to the
+ *                  calling thread
+ * @param n_seeds   Number of seeds per solve
+ */
+AA_API struct aa_rx_ik_parallel_cx *
+aa_rx_ik_parallel_cx_create( const struct aa_rx_sg_sub *ssg,
+                             const struct aa_rx_ksol_opts *opts,
+                             size_t n_threads, size_t n_seeds );
+
+/**
+ * Destroy a multi-start IK solver.
+ */
+AA_API void
+aa_rx_ik_parallel_cx_destroy( struct aa_rx_ik_parallel_cx *cx );
+
+/**
+ * Solve the IK from multiple seeds, returning the first solution.
+ *
+ * The first seed to converge cancels the remaining solves.
+ *
+ * @returns 0 on success, or AA_RX_NO_SOLUTION | AA_RX_NO_IK if no seed
+ * converged.
+ */
+AA_API int
+aa_rx_ik_parallel_solve( struct aa_rx_ik_parallel_cx *cx,
+                         size_t n_tf, const double *TF, size_t ld_TF,
+                         size_t n_q, double *q );
+
+/**
+ * Convenience function for the multi-start IK solver, matching
+ * aa_rx_ik_fun.
+ */
+AA_API int
+aa_rx_ik_parallel_fun( void *context,
+                       size_t n_tf, const double *TF, size_t ld_TF,
+                       size_t n_q, double *q );
+
+/**
+ * Solve the IK from all seeds and return the best distinct solutions.
+ *
+ * @param cx     The solver
+ * @param n_tf   Number of goal transforms
+ * @param TF     Goal transforms
+ * @param ld_TF  Leading dimension of TF
+ * @param q_ref  Reference sub-configuration for ranking, or NULL to use
+ *               the nullspace reference of the options or the seed.
+ * @param n_sol  Maximum number of solutions to return
+ * @param n_q    Size of the sub-configuration
+ * @param Q      Output solutions, in order of increasing distance to
+ *               q_ref
+ * @param ld_Q   Leading dimension of Q
+ *
+ * @returns the number of solutions found
+ */
+AA_API size_t
+aa_rx_ik_parallel_solve_best( struct aa_rx_ik_parallel_cx *cx,
+                              size_t n_tf, const double *TF, size_t ld_TF,
+                              const double *q_ref,
+                              size_t n_sol, size_t n_q, double *Q, size_t ld_Q );
+
 
 /* AA_API int */
 /* aa_rx_sg_sub_ksol_dls( const struct aa_rx_sg_sub *ssg, */
@@ -49,6 +49,16 @@ struct aa_rx_sg_sub
     size_t config_count;
     aa_rx_frame_id *configs;
 
+    /* Jacobian sparsity: configurations moving each frame */
+    size_t *jac_ptr;                ///< start of each frame's columns, frame_count+1
+    size_t *jac_cols;               ///< configuration indices, ascending per frame
+    aa_rx_frame_id *config_frames;  ///< joint frame of each configuration
+
+    struct aa_rx_ik_cache *ik_cache;  ///< cached IK solutions, or NULL
+
+    /* Compiled Jacobian of a chain, used while its kernels are installed */
+    const struct aa_rx_dl_sg_kin *compiled_kin;
+    const struct aa_rx_dl_sg_chain *compiled_chain;
 };
 
 
@@ -124,6 +134,17 @@ struct aa_rx_ksol_opts {
     size_t max_iterations;
 
     aa_rx_frame_id frame;
+
+    const aa_rx_frame_id *frames;  ///< target frames, one per goal
+    size_t n_frames;
+    aa_rx_frame_id *frames_data;
+
+    const double *frame_weights;   ///< target weights, one per goal
+    size_t n_frame_weights;
+    double *frame_weights_data;
+
+    /** When non-NULL, solvers give up once *cancel is nonzero */
+    const int *cancel;
 };
 
 #endif /*AMINO_RX_SCENE_KIN_H*/
@@ -130,6 +130,18 @@ AA_API void
 aa_rx_mp_set_simplify( struct aa_rx_mp *mp,
                        int simplify );
 
+/**
+ * Set the number of helper threads for workspace goal IK.
+ *
+ * Each workspace goal restarts IK from several seeds.  With zero
+ * helper threads (the default), all seeds run in the planner's
+ * thread.  Applies to goals set by later calls to
+ * aa_rx_mp_set_wsgoal().
+ */
+AA_API void
+aa_rx_mp_set_ik_threads( struct aa_rx_mp *mp,
+                         size_t n_threads );
+
 /**
  * Execute the planner.
  *
@@ -85,4 +85,141 @@ AA_API struct aa_rx_sg *
 aa_rx_dl_sg( const char *filename, const char *name,
              struct aa_rx_sg *scenegraph);
 
+
+/**
+ * Type signature of compiled forward kinematics functions.
+ *
+ * Computes the relative and absolute transforms of every frame, in
+ * frame index order, with the same layout as aa_rx_sg_tf().
+ */
+typedef void (*aa_rx_dl_sg_tf_fun)( const double *q,
+                                    double *TF_rel, size_t ld_rel,
+                                    double *TF_abs, size_t ld_abs );
+
+/**
+ * Type signature of compiled chain Jacobian functions.
+ *
+ * Computes the Jacobian of the chain from the absolute transforms,
+ * with the same layout as aa_rx_sg_sub_jacobian().
+ */
+typedef void (*aa_rx_dl_sg_jac_fun)( const double *TF_abs, size_t ld_abs,
+                                     double *J, size_t ld_J );
+
+/**
+ * A compiled chain Jacobian.
+ *
+ * Chains created by aa_rx_sg_chain_create() with the same root and
+ * tip, while the kernels are installed, compute
+ * aa_rx_sg_sub_jacobian() with the compiled kernel.
+ */
+struct aa_rx_dl_sg_chain {
+    const char *root;                /**< Root frame (exclusive) of the chain, "" for the global frame */
+    const char *tip;                 /**< Tip frame of the chain */
+    size_t config_count;             /**< Number of Jacobian columns */
+    const char *const *configs;      /**< Configuration of each column */
+    aa_rx_dl_sg_jac_fun jacobian;    /**< The Jacobian kernel */
+};
+
+/**
+ * Compiled kinematics of a scene graph.
+ *
+ * The scene compiler emits straight-line kernels for a specific
+ * scene graph.  The frame and configuration names record the
+ * indexing the kernels assume.
+ */
+struct aa_rx_dl_sg_kin {
+    size_t frame_count;                       /**< Number of frames */
+    const char *const *frames;                /**< Frame names, by index */
+    size_t config_count;                      /**< Number of configurations */
+    const char *const *configs;               /**< Configuration names, by index */
+    aa_rx_dl_sg_tf_fun tf;                    /**< Forward kinematics kernel */
+    size_t chain_count;                       /**< Number of compiled chains */
+    const struct aa_rx_dl_sg_chain *chains;   /**< Compiled chains */
+};
+
+/**
+ * Type signature of compiled kinematics functions.
+ */
+typedef const struct aa_rx_dl_sg_kin *(*aa_rx_dl_sg_kin_fun)(void);
+
+/**
+ * Use compiled kinematics for a scene graph.
+ *
+ * After a successful call, aa_rx_sg_tf() evaluates the compiled
+ * kernel instead of the generic kinematics.  Adding or removing
+ * frames discards the compiled kernel.
+ *
+ * @param scenegraph The scene graph
+ * @param kin        The compiled kinematics, or NULL to revert to the
+ *                   generic kinematics.
+ *
+ * The kernels are checked against the generic kinematics and
+ * aa_rx_sg_sub_jacobian() before they are used.
+ *
+ * @returns 0 on success, AA_RX_INVALID_FRAME if the frames or
+ * configurations of kin do not match the indices of scenegraph, or
+ * AA_RX_INVALID_PARAMETER if a kernel computes different transforms
+ * or Jacobians than the generic kinematics.
+ */
+AA_API int
+aa_rx_sg_set_kin( struct aa_rx_sg *scenegraph,
+                  const struct aa_rx_dl_sg_kin *kin );
+
+/**
+ * Return the compiled kinematics of a scene graph, or NULL.
+ */
+AA_API const struct aa_rx_dl_sg_kin *
+aa_rx_sg_get_kin( const struct aa_rx_sg *scenegraph );
+
+/**
+ * Find a compiled chain by its root and tip frames, or NULL.
+ *
+ * A NULL root is the global frame.
+ */
+AA_API const struct aa_rx_dl_sg_chain *
+aa_rx_dl_sg_kin_chain( const struct aa_rx_dl_sg_kin *kin,
+                       const char *root, const char *tip );
+
+/**
+ * Dynamically load compiled kinematics for a scene graph.
+ *
+ * Looks up the kinematics function generated by the scene graph
+ * compiler and installs its kernels in scenegraph via
+ * aa_rx_sg_set_kin().  The plugin remains loaded.
+ *
+ * @param filename   The name of the shared object.
+ * @param name       The name of the scene graph, as specified in the
+ *                   prior call to the scene graph compiler.
+ * @param scenegraph The scene graph that will use the kernels.
+ *
+ * @returns the compiled kinematics, or NULL on failure
+ */
+AA_API const struct aa_rx_dl_sg_kin *
+aa_rx_dl_sg_kin( const char *filename, const char *name,
+                 struct aa_rx_sg *scenegraph );
+
+struct aa_rx_ik_analytic;
+
+/**
+ * Type signature of closed-form IK functions.
+ */
+typedef const struct aa_rx_ik_analytic *(*aa_rx_dl_ik_fun)(void);
+
+/**
+ * Dynamically load a closed-form IK solver.
+ *
+ * Looks up the function `aa_rx_dl_ik__<name>` in the shared object
+ * and registers the solver it returns with scenegraph via
+ * aa_rx_sg_add_ik().  The plugin remains loaded.
+ *
+ * @param filename   The name of the shared object.
+ * @param name       The name of the solver.
+ * @param scenegraph The scene graph that will use the solver.
+ *
+ * @returns the solver, or NULL on failure
+ */
+AA_API const struct aa_rx_ik_analytic *
+aa_rx_dl_ik( const char *filename, const char *name,
+             struct aa_rx_sg *scenegraph );
+
 #endif /*AMINO_RX_SCENE_PLUGIN_H*/
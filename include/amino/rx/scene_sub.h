@@ -132,6 +132,18 @@ AA_API struct aa_rx_sg_sub *
 aa_rx_sg_chain_create( const struct aa_rx_sg *sg,
                        aa_rx_frame_id root, aa_rx_frame_id tip );
 
+/**
+ * Create a sub-scenegraph for the kinematic tree starting at root and
+ * ending at each of the tips.
+ *
+ * Frames shared by several tips appear once.  The frames are in the
+ * same order as in the scenegraph, so each frame follows its parent.
+ */
+AA_API struct aa_rx_sg_sub *
+aa_rx_sg_tree_create( const struct aa_rx_sg *sg,
+                      aa_rx_frame_id root,
+                      size_t n_tips, const aa_rx_frame_id *tips );
+
 
 /**
  * Fill q with the centered positions of each configuration.
@@ -150,11 +162,66 @@ aa_rx_sg_sub_jacobian_size( const struct aa_rx_sg_sub *ssg,
                             size_t *rows, size_t *cols );
 
 /**
- * Compute the Jacobian matrix for the sub-scenegraph.
+ * Compute the Jacobian matrix for the last frame of the sub-scenegraph.
  */
 AA_API void
 aa_rx_sg_sub_jacobian( const struct aa_rx_sg_sub *ssg,
                        size_t n_tf, const double *TF_abs, size_t ld_TF,
                        double *J, size_t ld_J );
 
+/**
+ * Return the number of structural nonzeros in the Jacobian of several
+ * frames of the sub-scenegraph.
+ *
+ * @param ssg      The sub-scenegraph
+ * @param n_frames Number of frames
+ * @param frames   Indices of the frames in the sub-scenegraph, as for
+ *                 aa_rx_sg_sub_frame()
+ */
+AA_API size_t
+aa_rx_sg_sub_jacobian_nnz( const struct aa_rx_sg_sub *ssg,
+                           size_t n_frames, const size_t *frames );
+
+/**
+ * Fill in the sparsity pattern of the Jacobian of several frames in
+ * compressed sparse row (CSR) form.
+ *
+ * Rows 6*j through 6*j+5 are the twist of frames[j], ordered as
+ * AA_TF_DX_V and AA_TF_DX_W.  Columns are the configurations of the
+ * sub-scenegraph.  A frame's row has an entry for each configuration
+ * of the frame and its ancestors in the sub-scenegraph, so configurations
+ * on other branches are structurally zero.  The pattern is computed
+ * when the sub-scenegraph is created.
+ *
+ * @param ssg      The sub-scenegraph
+ * @param n_frames Number of frames
+ * @param frames   Indices of the frames in the sub-scenegraph
+ * @param row_ptr  Output row offsets, length 6*n_frames+1
+ * @param col_ind  Output column indices, ascending within each row,
+ *                 length aa_rx_sg_sub_jacobian_nnz()
+ */
+AA_API void
+aa_rx_sg_sub_jacobian_csr_pattern( const struct aa_rx_sg_sub *ssg,
+                                   size_t n_frames, const size_t *frames,
+                                   size_t *row_ptr, size_t *col_ind );
+
+/**
+ * Compute the nonzero values of the Jacobian of several frames, in
+ * the order of aa_rx_sg_sub_jacobian_csr_pattern().
+ *
+ * @param ssg      The sub-scenegraph
+ * @param n_tf     Number of absolute transforms
+ * @param TF_abs   Absolute transforms of all scenegraph frames, as from
+ *                 aa_rx_sg_tf()
+ * @param ld_TF    Leading dimension of TF_abs
+ * @param n_frames Number of frames
+ * @param frames   Indices of the frames in the sub-scenegraph
+ * @param values   Output values, length aa_rx_sg_sub_jacobian_nnz()
+ */
+AA_API void
+aa_rx_sg_sub_jacobian_csr( const struct aa_rx_sg_sub *ssg,
+                           size_t n_tf, const double *TF_abs, size_t ld_TF,
+                           size_t n_frames, const size_t *frames,
+                           double *values );
+
 #endif /*AMINO_RX_SCENE_SUB_H*/
@@ -98,9 +98,57 @@ AA_API void aa_rx_sg_destroy(struct aa_rx_sg *scene_graph);
  *
  * This function must be called before any frame_ids or config_ids can
  * be used with the scenegraph.
+ *
+ * After frames are added, removed, or reparented, only the frames
+ * following the first changed frame are renumbered.  Use
+ * aa_rx_sg_frame_remap() to update previously obtained frame_ids.
  */
 AA_API int aa_rx_sg_init ( struct aa_rx_sg *scene_graph );
 
+/**
+ * Map frame_ids from before the most recent aa_rx_sg_init() to
+ * current frame_ids.
+ *
+ * @param scene_graph The scene graph
+ * @param n           Length of remap
+ * @param remap       Output array; element i is the current frame_id
+ *                    of old frame_id i, or AA_RX_FRAME_NONE if that
+ *                    frame was removed or replaced.
+ *
+ * @returns the number of frames before re-indexing
+ *
+ * @pre aa_rx_sg_init() has been called after all frames were added to
+ * the scenegraph.
+ */
+AA_API size_t aa_rx_sg_frame_remap (
+    const struct aa_rx_sg *scene_graph, size_t n, aa_rx_frame_id *remap );
+
+/**
+ * Make the scene graph immutable.
+ *
+ * Freezing finalizes the internal indices.  Afterwards, the read-only
+ * operations -- forward kinematics, Jacobians, collision object
+ * creation, and geometry mapping -- do not modify the scene graph and
+ * may run concurrently from multiple threads without locking.
+ *
+ * Collision and GL data are finalized by calling aa_rx_sg_cl_init()
+ * and aa_rx_sg_gl_init() before freezing.
+ *
+ * A frozen scene graph must not be modified.  Debug builds assert on
+ * any mutation after freezing.  To modify a frozen scene graph, use
+ * aa_rx_sg_copy(), which returns an unfrozen snapshot.
+ *
+ * @returns the result of aa_rx_sg_init()
+ */
+AA_API int aa_rx_sg_freeze ( struct aa_rx_sg *scene_graph );
+
+/**
+ * Return non-zero if the scene graph is frozen.
+ *
+ * @sa aa_rx_sg_freeze()
+ */
+AA_API int aa_rx_sg_is_frozen ( const struct aa_rx_sg *scene_graph );
+
 /**
  * Return the type of the given frame
  *
@@ -180,6 +228,9 @@ aa_rx_sg_config_names (
  *
  * @pre aa_rx_sg_init() has been called after all frames were added to
  * the scenegraph.
+ *
+ * @returns the index, or AA_RX_CONFIG_NONE if there is no such
+ * configuration variable.
  */
 AA_API aa_rx_config_id aa_rx_sg_config_id(
     const struct aa_rx_sg *scene_graph, const char *config_name);
@@ -219,8 +270,14 @@ aa_rx_sg_config_set(
 /**
  *  Return the index of a frame in the scene graph
  *
+ * Lookup uses a hash index built by aa_rx_sg_init() and does not
+ * allocate memory.
+ *
  * @pre aa_rx_sg_init() has been called after all frames were added to
  * the scenegraph.
+ *
+ * @returns the index, AA_RX_FRAME_ROOT for the empty string, or
+ * AA_RX_FRAME_NONE if there is no such frame.
  */
 AA_API aa_rx_frame_id aa_rx_sg_frame_id (
     const struct aa_rx_sg *scene_graph, const char *frame_name);
@@ -421,6 +478,58 @@ AA_API void aa_rx_sg_tf
   double *TF_rel, size_t ld_rel,
   double *TF_abs, size_t ld_abs );
 
+/**
+ * Evaluate aa_rx_sg_tf() in parallel over independent root subtrees.
+ *
+ * Frames attached to the global frame root separate subtrees, e.g.,
+ * different robots or fixtures in a scene, whose transforms may be
+ * computed independently.  When enabled, aa_rx_sg_tf() distributes
+ * these subtrees over a pool of worker threads and the calling
+ * thread.  Scenes with fewer than threshold frames or with a single
+ * root subtree are computed sequentially, as are calls made while
+ * another thread is using the pool.
+ *
+ * @param scene_graph The scene graph container
+ * @param n_threads   Number of worker threads, or 0 to disable
+ * @param threshold   Minimum number of frames for parallel evaluation
+ */
+AA_API void aa_rx_sg_set_tf_parallel
+( struct aa_rx_sg *scene_graph, size_t n_threads, size_t threshold );
+
+/**
+ *  Compute transforms for a batch of configurations.
+ *
+ * Equivalent to calling aa_rx_sg_tf() for each of the n_batch
+ * configurations, but evaluates several configurations at once so
+ * that the per-frame arithmetic vectorizes across the batch.
+ *
+ * The transform of frame j for configuration i is stored at
+ * TF[i*stride + j*ld].
+ *
+ * @param scene_graph The scene graph container
+ * @param n_batch     Number of configurations
+ * @param n_q         Size of each configuration vector
+ * @param Q           Configuration vectors
+ * @param ld_q        Space between each configuration vector in Q
+ * @param n_tf        Number of frame entries per configuration
+ * @param TF_rel      Relative transforms, or NULL
+ * @param ld_rel      Space between each frame entry of TF_rel
+ * @param stride_rel  Space between each configuration in TF_rel
+ * @param TF_abs      Absolute transforms
+ * @param ld_abs      Space between each frame entry of TF_abs
+ * @param stride_abs  Space between each configuration in TF_abs
+ *
+ * @pre aa_rx_sg_init() has been called after all frames were added to
+ * the scenegraph.
+ */
+AA_API void aa_rx_sg_tf_batch
+( const struct aa_rx_sg *scene_graph,
+  size_t n_batch,
+  size_t n_q, const double *Q, size_t ld_q,
+  size_t n_tf,
+  double *TF_rel, size_t ld_rel, size_t stride_rel,
+  double *TF_abs, size_t ld_abs, size_t stride_abs );
+
 /**
  *  Updated transforms efficiently when only some configurations change.
  *
@@ -460,7 +569,96 @@ AA_API void aa_rx_sg_tf_update
   double *TF_rel, size_t ld_rel,
   double *TF_abs, size_t ld_abs );
 
+/**
+ *  Update transforms in place for a set of changed configurations.
+ *
+ * Only the frames moved by the changed configurations and their
+ * descendants are recomputed, so the cost is proportional to the size
+ * of the changed subtrees rather than the whole scene.
+ *
+ * @param scene_graph The scene graph container
+ * @param n_q         Size of configuration vector q
+ * @param q           Current configuration vector
+ * @param n_changed   Number of changed configurations
+ * @param changed     Indices of the changed configurations
+ * @param n_tf        Number of entries in the TF array
+ * @param TF_rel      Relative transforms, updated in place
+ * @param ld_rel      Leading dimension of TF_rel
+ * @param TF_abs      Absolute transforms, updated in place
+ * @param ld_abs      Leading dimension of TF_abs
+ *
+ * @pre aa_rx_sg_init() has been called after all frames were added to
+ * the scenegraph.
+ *
+ * @pre TF_rel and TF_abs hold the transforms for a configuration that
+ * differs from q only in the changed indices.
+ */
+AA_API void aa_rx_sg_tf_update_configs
+( const struct aa_rx_sg *scene_graph,
+  size_t n_q, const double *q,
+  size_t n_changed, const aa_rx_config_id *changed,
+  size_t n_tf,
+  double *TF_rel, size_t ld_rel,
+  double *TF_abs, size_t ld_abs );
+
+/**
+ * Compute the relative transform of a single frame.
+ *
+ * Evaluates only the given frame, e.g., to walk a kinematic chain
+ * without computing the transforms of the whole scene graph.
+ *
+ * @param scene_graph The scene graph container
+ * @param frame       The frame to evaluate
+ * @param n_q         Size of configuration vector q
+ * @param q           Configuration vector
+ * @param E           The transform of frame relative to its parent
+ *
+ * @pre aa_rx_sg_init() has been called after all frames were added to
+ * the scenegraph.
+ */
+AA_API void aa_rx_sg_frame_tf_rel
+( const struct aa_rx_sg *scene_graph, aa_rx_frame_id frame,
+  size_t n_q, const double *q,
+  double E[7] );
 
+/**
+ * Padded, aligned transform storage for a scene graph.
+ *
+ * Each transform occupies AA_TF_QUTR_LD_ALIGNED doubles and the arrays
+ * are aligned to AA_TF_QUTR_ALIGN bytes, so no transform straddles a
+ * cache line.  Pass TF_rel or TF_abs with leading dimension ld to any
+ * function that takes a transform array, e.g., aa_rx_sg_tf(),
+ * aa_rx_cl_check(), or aa_rx_sg_render().  Forward kinematics uses
+ * aa_tf_qutr_mul_aligned() on such arrays.
+ */
+struct aa_rx_sg_tf_buf {
+    size_t n_tf;     /**< Number of transforms */
+    size_t ld;       /**< Leading dimension of TF_rel and TF_abs */
+    double *TF_rel;  /**< Relative transforms */
+    double *TF_abs;  /**< Absolute transforms */
+};
+
+/**
+ * Allocate padded transform storage for every frame of the scene graph.
+ *
+ * The buffer is allocated from reg and zero-filled.
+ *
+ * @pre aa_rx_sg_init() has been called after all frames were added to
+ * the scenegraph.
+ */
+AA_API struct aa_rx_sg_tf_buf *
+aa_rx_sg_tf_buf_alloc( const struct aa_rx_sg *scene_graph,
+                       struct aa_mem_region *reg );
+
+/**
+ * Compute the transforms of every frame into buf.
+ *
+ * Equivalent to aa_rx_sg_tf() with the arrays of buf.
+ */
+AA_API void aa_rx_sg_tf_buf_fill
+( const struct aa_rx_sg *scene_graph,
+  size_t n_q, const double *q,
+  struct aa_rx_sg_tf_buf *buf );
 
 /**
  * Call function for every geometry object in the scene graph
@@ -512,9 +710,12 @@ AA_API void aa_rx_sg_reparent_name ( const struct aa_rx_sg *scene_graph,
                                      const double *E1);
 
 /**
- * Deeply copy a scenegraph.
+ * Copy a scenegraph.
  *
- * Note that geometry objects and meshes will be shared via reference-counting.
+ * The copy is a snapshot that shares frames with orig.  Either scene
+ * graph may then be modified independently; a shared frame is copied
+ * only when it is first modified.  Geometry objects and meshes are
+ * shared via reference-counting.
  */
 AA_API  struct aa_rx_sg *  aa_rx_sg_copy( const struct aa_rx_sg * orig);
 
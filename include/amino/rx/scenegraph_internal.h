@@ -69,8 +69,10 @@ struct aa_rx_inertial {
 #include <string>
 #include <map>
 #include <set>
+#include <atomic>
 
-
+struct aa_rx_dl_sg_kin;
+struct aa_rx_ik_analytic;
 
 namespace amino {
 
@@ -86,6 +88,12 @@ struct SceneFrame  {
     //virtual aa_rx_frame_type type() = 0;
     int in_global();
 
+    /** Return an unshared copy of this frame */
+    virtual SceneFrame *clone() const = 0;
+
+    /** Drop a reference, deleting the frame when unreferenced */
+    static void release( SceneFrame *f );
+
     enum aa_rx_frame_type type;
     struct aa_rx_inertial *inertial;
 
@@ -99,6 +107,13 @@ struct SceneFrame  {
 
     /* Geometry */
     std::vector<struct aa_rx_geom*> geometry;
+
+    /** Number of scene graphs sharing this frame */
+    std::atomic<unsigned> refcount;
+
+protected:
+    /** Copy geometry, inertia, and indices into a clone */
+    SceneFrame *clone_into( SceneFrame *f ) const;
 };
 
 
@@ -108,6 +123,7 @@ struct SceneFrameFixed : public SceneFrame {
                      const double q[4], const double v[3] );
     virtual ~SceneFrameFixed();
     virtual void tf_rel( const double *q, double E[7] );
+    virtual SceneFrame *clone() const;
     //virtual aa_rx_frame_type type();
 };
 
@@ -134,6 +150,7 @@ struct SceneFramePrismatic : public SceneFrameJoint {
                          double offset, const double axis[3] );
     virtual ~SceneFramePrismatic();
     virtual void tf_rel( const double *q, double E[7] );
+    virtual SceneFrame *clone() const;
     //virtual aa_rx_frame_type type();
 };
 
@@ -146,17 +163,233 @@ struct SceneFrameRevolute : public SceneFrameJoint {
                         double offset, const double axis[3] );
     virtual ~SceneFrameRevolute();
     virtual void tf_rel( const double *q, double E[7] );
+    virtual SceneFrame *clone() const;
     //virtual aa_rx_frame_type type();
 };
 
 
+/**
+ * Open-addressing hash index from interned names to indices.
+ *
+ * Keys point at names owned by the scene graph, so lookups take a
+ * plain C string and never allocate.  Interned names compare by
+ * pointer before falling back to strcmp().
+ */
+struct SceneNameIndex {
+    SceneNameIndex();
+
+    /** Remove all names and size the table for n names */
+    void reset( size_t n );
+
+    /** Add a name, which must outlive the index */
+    void insert( const char *name, size_t index );
+
+    /** Return the index of name, or SIZE_MAX if absent */
+    size_t find( const char *name ) const;
+
+    /** Return the interned copy of name, or NULL if absent */
+    const char *intern( const char *name ) const;
+
+    /** Replace the key pointer old_name with an equal string new_name */
+    void rename( const char *old_name, const char *new_name );
+
+    static size_t hash( const char *name );
+
+    struct Slot {
+        size_t hash;
+        const char *name;
+        size_t index;
+    };
+
+    /** Probe sequence start for name, or the matching slot */
+    const Slot *lookup( const char *name ) const;
+
+    std::vector<Slot> slots;
+    size_t mask;
+};
+
+
+/**
+ * Compiled kinematics of a scene graph.
+ *
+ * SceneGraph::index() flattens the sorted frames into this
+ * structure-of-arrays "program".  Each frame has an opcode, a parent
+ * index, and an index into the parameter table for its joint type.
+ * Forward kinematics is then a linear sweep over the program without
+ * virtual dispatch.
+ */
+struct SceneKinematics {
+
+    /** Frame opcodes.  The _ROOT variants have the global frame as parent. */
+    enum opcode {
+        FIXED,
+        REVOLUTE,
+        PRISMATIC,
+        FIXED_ROOT,
+        REVOLUTE_ROOT,
+        PRISMATIC_ROOT
+    };
+
+    void compile( const std::vector<SceneFrame*> &frames );
+
+    /** Return the config index of frame i, or SIZE_MAX for fixed frames */
+    inline size_t frame_config( size_t i ) const;
+
+    /** Compute the relative transform of frame i */
+    inline void tf_rel( size_t i, const double *q, double E[7] ) const;
+
+    /** Compute relative and absolute transforms for the first n_tf frames */
+    void tf( const double *q, size_t n_tf,
+             double *TF_rel, size_t ld_rel,
+             double *TF_abs, size_t ld_abs ) const;
+
+    /** Compute transforms for frames [begin,end), which must contain
+     * the parents of its frames */
+    void tf_range( const double *q, size_t begin, size_t end,
+                   double *TF_rel, size_t ld_rel,
+                   double *TF_abs, size_t ld_abs ) const;
+
+    /** Number of configurations evaluated together by tf_batch() */
+    static const size_t BATCH_LANES = 8;
+
+    /** Compute transforms for n_batch configurations */
+    void tf_batch( size_t n_batch, const double *Q, size_t ld_q,
+                   size_t n_tf,
+                   double *TF_rel, size_t ld_rel, size_t stride_rel,
+                   double *TF_abs, size_t ld_abs, size_t stride_abs ) const;
+
+    /** Recompute transforms in place for the subtrees of changed configs */
+    void tf_update( const double *q,
+                    size_t n_changed, const aa_rx_config_id *changed,
+                    size_t n_tf,
+                    double *TF_rel, size_t ld_rel,
+                    double *TF_abs, size_t ld_abs ) const;
+
+    /* Per-frame program */
+    std::vector<uint8_t> ops;
+    std::vector<aa_rx_frame_id> parents;
+    std::vector<size_t> args;
+
+    /** One past the last descendant of each frame.  Frames are in
+     * preorder, so the subtree of frame i is [i, subtree_end[i]). */
+    std::vector<size_t> subtree_end;
+
+    /** Start of each independent root subtree, followed by the frame
+     * count.  Root subtree k is [root_begin[k], root_begin[k+1]). */
+    std::vector<size_t> root_begin;
+
+    /** Frames of each config: config_frames[config_frame_ptr[c] ... config_frame_ptr[c+1]] */
+    std::vector<size_t> config_frame_ptr;
+    std::vector<size_t> config_frames;
+
+    /* Fixed frames */
+    std::vector<double> fixed_E;
+
+    /* Revolute frames: rotation about a unit axis, scaled */
+    std::vector<size_t> revolute_config;
+    std::vector<double> revolute_offset;
+    std::vector<double> revolute_scale;
+    std::vector<double> revolute_axis;
+    std::vector<double> revolute_E;
+
+    /* Prismatic frames: axis is pre-rotated by the fixed rotation */
+    std::vector<size_t> prismatic_config;
+    std::vector<double> prismatic_offset;
+    std::vector<double> prismatic_axis;
+    std::vector<double> prismatic_E;
+};
+
+inline size_t
+SceneKinematics::frame_config( size_t i ) const
+{
+    switch( ops[i] ) {
+    case REVOLUTE:
+    case REVOLUTE_ROOT:
+        return revolute_config[args[i]];
+    case PRISMATIC:
+    case PRISMATIC_ROOT:
+        return prismatic_config[args[i]];
+    default:
+        return SIZE_MAX;
+    }
+}
+
+inline void
+SceneKinematics::tf_rel( size_t i, const double *q, double E[7] ) const
+{
+    size_t j = args[i];
+    switch( ops[i] ) {
+    case FIXED:
+    case FIXED_ROOT:
+        AA_MEM_CPY( E, &fixed_E[7*j], 7 );
+        break;
+    case REVOLUTE:
+    case REVOLUTE_ROOT: {
+        const double *E0 = &revolute_E[7*j];
+        double h[4];
+        double theta = revolute_scale[j] * (q[revolute_config[j]] + revolute_offset[j]);
+        aa_tf_axang2quat2( &revolute_axis[3*j], theta, h );
+        aa_tf_qmul( E0 + AA_TF_QUTR_Q, h, E + AA_TF_QUTR_Q );
+        AA_MEM_CPY( E + AA_TF_QUTR_V, E0 + AA_TF_QUTR_V, 3 );
+        break;
+    }
+    case PRISMATIC:
+    case PRISMATIC_ROOT: {
+        const double *E0 = &prismatic_E[7*j];
+        const double *a = &prismatic_axis[3*j];
+        double d = q[prismatic_config[j]] + prismatic_offset[j];
+        AA_MEM_CPY( E + AA_TF_QUTR_Q, E0 + AA_TF_QUTR_Q, 4 );
+        for( size_t k = 0; k < 3; k ++ ) {
+            E[AA_TF_QUTR_V+k] = E0[AA_TF_QUTR_V+k] + d*a[k];
+        }
+        break;
+    }
+    }
+}
+
+/** Worker threads for parallel forward kinematics */
+struct SceneTFPool;
+
 struct SceneGraph  {
     SceneGraph();
+
+    /** Snapshot other, sharing its frames */
+    SceneGraph( const SceneGraph &other );
+
     ~SceneGraph();
 
     int index();
     void add(SceneFrame *f);
 
+    /** Remove and delete a frame */
+    void remove( const char *name );
+
+    /** Move a frame to a new parent with relative transform E */
+    void reparent( SceneFrame *f, const char *parent, const double E[7] );
+
+    /** Find a frame by name, or NULL */
+    SceneFrame *find_frame( const char *name ) const;
+
+    /** Is f at its position in frames? */
+    bool frame_indexed( const SceneFrame *f ) const;
+
+    /** Mark f, which is about to change, for re-indexing */
+    void touch( SceneFrame *f );
+
+    /** Return a copy of f owned only by this scene graph.
+     *
+     * Shared frames are cloned and the clone replaces f in the frame
+     * tables.  Renamed allowed-collision pointers are appended to
+     * renamed when given, else fixed immediately.
+     */
+    SceneFrame *mutable_frame( SceneFrame *f,
+                               std::vector<std::pair<const char*,const char*> > *renamed = NULL );
+
+    /** Point allowed-collision pairs at renamed frame names */
+    void rename_allowed( const std::vector<std::pair<const char*,const char*> > &renamed );
+
+    size_t sort_suffix( size_t first, std::vector<SceneFrame*> &list );
+
     /** Map from frame name to frame */
     std::map<std::string,SceneFrame*> frame_map;
 
@@ -169,15 +402,49 @@ struct SceneGraph  {
     /** Array of configuration limits */
     std::vector<struct aa_rx_config_limits*> limits;
 
-    /** Map from configuration name to configuration index */
-    std::map<std::string,aa_rx_config_id> config_map;
-
     /** Map from configuration index to configuration name */
     std::vector<const char *> config_rmap;
 
     /** Number of configuration variables */
     size_t config_size;
 
+    /** Hash index of frame names, valid when indices are clean */
+    SceneNameIndex frame_index;
+
+    /** Hash index of configuration names, valid when indices are clean */
+    SceneNameIndex config_index;
+
+    /** Compiled forward kinematics */
+    SceneKinematics kinematics;
+
+    /** Generated kinematics kernels, if any */
+    const struct aa_rx_dl_sg_kin *compiled_kin;
+
+    /** Closed-form IK solvers, matched to chains by name */
+    std::vector<const struct aa_rx_ik_analytic *> analytic_ik;
+
+    /** Threads evaluating root subtrees in parallel, or NULL */
+    SceneTFPool *tf_pool;
+
+    /** Minimum frame count for parallel forward kinematics */
+    size_t tf_parallel_threshold;
+
+    /** Compute transforms, in parallel over root subtrees when enabled */
+    void tf( const double *q, size_t n_tf,
+             double *TF_rel, size_t ld_rel,
+             double *TF_abs, size_t ld_abs ) const;
+
+    void set_tf_parallel( size_t n_threads, size_t threshold );
+
+    /** Frames before this index are unchanged since the last index() */
+    size_t reindex_first;
+
+    /** Frames added or reparented since the last index() */
+    std::vector<std::string> reindex_names;
+
+    /** Frame indices before the last index() mapped to current indices */
+    std::vector<aa_rx_frame_id> frame_remap;
+
     /** Set of allowable collision frames by name */
     std::set<std::pair<const char*,const char*> > allowed;
 
@@ -192,6 +459,9 @@ struct SceneGraph  {
     unsigned dirty_indices : 1;
     unsigned dirty_collision : 1;
     unsigned dirty_gl : 1;
+
+    /** Set by aa_rx_sg_freeze(); the scene graph is then read-only */
+    unsigned frozen : 1;
 };
 
 }
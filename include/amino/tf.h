@@ -1317,6 +1317,29 @@ void aa_tf_duqu2qutr( const double s[8], double e[7] );
 /// quaternion-translation multiply
 void aa_tf_qutr_mul( const double a[7], const double b[7], double c[7] ) ;
 
+/**
+ * Leading dimension of padded quaternion-translation arrays.
+ *
+ * Padding each transform to 8 doubles keeps it within one 64-byte
+ * cache line when the array is aligned to AA_TF_QUTR_ALIGN.
+ */
+#define AA_TF_QUTR_LD_ALIGNED 8
+
+/**
+ * Byte alignment of padded quaternion-translation arrays.
+ */
+#define AA_TF_QUTR_ALIGN 64
+
+/**
+ * Quaternion-translation multiply on padded, aligned operands.
+ *
+ * Each argument is AA_TF_QUTR_LD_ALIGNED doubles aligned to
+ * AA_TF_QUTR_ALIGN bytes.  The padding element of c is set to zero.
+ */
+AA_API void
+aa_tf_qutr_mul_aligned( const double a[AA_RESTRICT 8], const double b[AA_RESTRICT 8],
+                        double c[AA_RESTRICT 8] );
+
 /**
  * Transform a point,
  */
@@ -89,6 +89,10 @@
   (mp rx-mp-t)
   (simplify :boolean))
 
+(cffi:defcfun aa-rx-mp-set-ik-threads :void
+  (mp rx-mp-t)
+  (n-threads amino-ffi:size-t))
+
 (defun motion-planner (sub-scene-graph)
   (let ((mp (aa-rx-mp-create sub-scene-graph)))
     (setf (rx-mp-sub-scene-graph mp)
@@ -304,11 +304,347 @@
 
 (defun scene-graph-gen-header (scene-graph &key
                                              scene-name
-                                             static-mesh)
+                                             static-mesh
+                                             kinematics)
   (declare (ignore static-mesh scene-graph))
   (let ((function-name (scene-graph-scene-function-name scene-name))
         (argument-name "sg"))
-    (cgen-declare-fun "struct aa_rx_sg *" function-name (rope "struct aa_rx_sg *" argument-name))))
+    (list
+     (cgen-declare-fun "struct aa_rx_sg *" function-name (rope "struct aa_rx_sg *" argument-name))
+     (when kinematics
+       (cgen-declare-fun "const struct aa_rx_dl_sg_kin *"
+                         (scene-graph-kin-function-name scene-name)
+                         "void")))))
+
+
+;;;;;;;;;;;;;;;;;;;;;;;;;
+;; Compiled Kinematics ;;
+;;;;;;;;;;;;;;;;;;;;;;;;;
+
+(defparameter *scene-genc-kin-epsilon* 1d-12
+  "Tolerance for constant folding in generated kinematics.")
+
+(defun scene-genc-kin-zerop (x)
+  (< (abs x) *scene-genc-kin-epsilon*))
+
+(defun scene-genc-kin-double (x)
+  (let ((*read-default-float-format* 'double-float))
+    (prin1-to-string (coerce x 'double-float))))
+
+(defun scene-genc-kin-c-string (x)
+  (format nil "~S" (rope-string (or x ""))))
+
+(defun scene-genc-kin-linear (constant &rest terms)
+  "C expression for CONSTANT plus each (COEFFICIENT . EXPRESSION) in
+TERMS, dropping zero terms and unit coefficients."
+  (let ((parts (loop for (k . x) in terms
+                  unless (scene-genc-kin-zerop k)
+                  collect (cond ((scene-genc-kin-zerop (- k 1)) x)
+                                ((scene-genc-kin-zerop (+ k 1)) (format nil "-~A" x))
+                                (t (format nil "~A*~A" (scene-genc-kin-double k) x))))))
+    (unless (scene-genc-kin-zerop constant)
+      (push (scene-genc-kin-double constant) parts))
+    (if parts
+        (format nil "~{~A~^ + ~}" parts)
+        "0")))
+
+(defun scene-genc-kin-assign (var start expressions)
+  (loop for x in expressions
+     for i from start
+     collect (cgen-stmt (format nil "~A[~D] = ~A" var i x))))
+
+(defun scene-genc-kin-constants (var start values)
+  (scene-genc-kin-assign var start (map 'list #'scene-genc-kin-double values)))
+
+(defun scene-genc-kin-quat-ident-p (q)
+  (destructuring-bind (x y z w) q
+    (and (scene-genc-kin-zerop x)
+         (scene-genc-kin-zerop y)
+         (scene-genc-kin-zerop z)
+         (scene-genc-kin-zerop (- w 1)))))
+
+(defun scene-genc-kin-principal-axis (axis)
+  "If AXIS is aligned with x, y, or z, return its index and signed length."
+  (let* ((list (amino::vec-list axis))
+         (nonzero (loop for a in list
+                     for i from 0
+                     unless (scene-genc-kin-zerop a)
+                     collect i)))
+    (when (= 1 (length nonzero))
+      (values (car nonzero) (nth (car nonzero) list)))))
+
+(defun scene-genc-kin-unit-axis (axis)
+  (let* ((list (amino::vec-list axis))
+         (norm (sqrt (reduce #'+ (map 'list (lambda (x) (* x x)) list)))))
+    (values (if (zerop norm)
+                (list 0d0 0d0 0d0)
+                (map 'list (lambda (x) (/ x norm)) list))
+            norm)))
+
+(defun scene-genc-kin-frames (scene-graph)
+  "Frames in the preorder used by the C scene graph indices: children
+of each frame in order of name."
+  (let ((children (make-hash-table :test #'equal))
+        (result))
+    (do-scene-graph-frames (frame scene-graph)
+      (push frame (gethash (rope-string (or (scene-frame-parent frame) ""))
+                           children)))
+    (labels ((visit (name)
+               (dolist (frame (sort (copy-list (gethash name children)) #'string<
+                                    :key (lambda (frame) (rope-string (scene-frame-name frame)))))
+                 (push frame result)
+                 (visit (rope-string (scene-frame-name frame))))))
+      (visit ""))
+    (nreverse result)))
+
+(defun scene-genc-kin-configs (frames)
+  "Configuration names in order of first use by FRAMES."
+  (let ((configs))
+    (dolist (frame frames)
+      (when (scene-frame-joint-p frame)
+        (pushnew (rope-string (scene-frame-joint-configuration-name frame))
+                 configs :test #'string=)))
+    (nreverse configs)))
+
+(defun scene-genc-kin-qmul-axis (q0 k scale)
+  "Components of Q0 * (SCALE*s*e_K + c), where e_K is a unit basis quaternion."
+  (destructuring-bind (x y z w) q0
+    (let ((qe (ecase k
+                (0 (list w z (- y) (- x)))
+                (1 (list (- z) w x (- y)))
+                (2 (list y (- x) w (- z))))))
+      (loop for a in q0
+         for b in qe
+         collect (scene-genc-kin-linear 0 (cons a "c") (cons (* scale b) "s"))))))
+
+(defun scene-genc-kin-rel (frame config-index)
+  "Statements computing the relative transform R of FRAME."
+  (let* ((tf (scene-frame-tf frame))
+         (q0 (amino::vec-list (tf-quaternion tf)))
+         (v0 (amino::vec-list (tf-translation tf))))
+    (etypecase frame
+      (scene-frame-fixed
+       (scene-genc-kin-constants "R" 0 (append q0 v0)))
+      (scene-frame-revolute
+       (multiple-value-bind (axis scale) (scene-genc-kin-unit-axis (scene-frame-joint-axis frame))
+         (list
+          (cgen-stmt (format nil "double theta = ~A"
+                             (scene-genc-kin-linear (* scale (scene-frame-joint-configuration-offset frame))
+                                                    (cons scale (format nil "q[~D]" config-index)))))
+          (multiple-value-bind (k length) (scene-genc-kin-principal-axis (scene-frame-joint-axis frame))
+            (if k
+                ;; Single-axis rotation
+                (list (cgen-stmt "double s = sin(0.5*theta), c = cos(0.5*theta)")
+                      (scene-genc-kin-assign "R" 0 (scene-genc-kin-qmul-axis q0 k (signum length))))
+                ;; General axis
+                (list (cgen-declare-array "static const double" "axis" axis)
+                      (cgen-stmt "double h[4]")
+                      (cgen-call-stmt "aa_tf_axang2quat2" "axis" "theta" "h")
+                      (if (scene-genc-kin-quat-ident-p q0)
+                          (cgen-call-stmt "AA_MEM_CPY" "R" "h" 4)
+                          (list (cgen-declare-array "static const double" "q0" q0)
+                                (cgen-call-stmt "aa_tf_qmul" "q0" "h" "R"))))))
+          (scene-genc-kin-constants "R" 4 v0))))
+      (scene-frame-prismatic
+       (let ((a (amino::vec-list (transform (tf-quaternion tf) (scene-frame-joint-axis frame)))))
+         (list
+          (cgen-stmt (format nil "double d = ~A"
+                             (scene-genc-kin-linear (scene-frame-joint-configuration-offset frame)
+                                                    (cons 1d0 (format nil "q[~D]" config-index)))))
+          (scene-genc-kin-constants "R" 0 q0)
+          (scene-genc-kin-assign "R" 4 (loop for v in v0
+                                          for x in a
+                                          collect (scene-genc-kin-linear v (cons x "d"))))))))))
+
+(defun scene-genc-kin-abs (frame)
+  "Statements computing absolute transform A from parent P and relative R."
+  (let* ((tf (scene-frame-tf frame))
+         (q-ident (scene-genc-kin-quat-ident-p (amino::vec-list (tf-quaternion tf))))
+         (v-zero (every #'scene-genc-kin-zerop (amino::vec-list (tf-translation tf)))))
+    (cond
+      ((and (scene-frame-fixed-p frame) q-ident v-zero)
+       (cgen-call-stmt "AA_MEM_CPY" "A" "P" 7))
+      ((and q-ident (not (scene-frame-revolute-p frame)))
+       ;; Translation only
+       (list (cgen-call-stmt "AA_MEM_CPY" "A" "P" 4)
+             (cgen-call-stmt "aa_tf_qrot" "P" "R+AA_TF_QUTR_T" "A+AA_TF_QUTR_T")
+             (loop for i from 4 below 7
+                collect (cgen-stmt (format nil "A[~D] += P[~D]" i i)))))
+      ((and v-zero (scene-frame-revolute-p frame))
+       ;; Rotation only
+       (list (cgen-call-stmt "aa_tf_qmul" "P" "R" "A")
+             (cgen-call-stmt "AA_MEM_CPY" "A+AA_TF_QUTR_T" "P+AA_TF_QUTR_T" 3)))
+      (t
+       (cgen-call-stmt "aa_tf_qutr_mul" "P" "R" "A")))))
+
+(defun scene-genc-kin-tf (function-name frames configs)
+  "Define a straight-line forward kinematics function for FRAMES."
+  (let ((index (make-hash-table :test #'equal))
+        (constant (make-hash-table :test #'equal)))
+    (loop for frame in frames
+       for i from 0
+       do (setf (gethash (rope-string (scene-frame-name frame)) index) i))
+    (cgen-defun "static void" function-name
+                "const double *q, double *TF_rel, size_t ld_rel, double *TF_abs, size_t ld_abs"
+                (loop for frame in frames
+                   for i from 0
+                   for name = (rope-string (scene-frame-name frame))
+                   for parent = (rope-string (or (scene-frame-parent frame) ""))
+                   for parent-tf = (gethash parent constant)
+                   for root-p = (zerop (length parent))
+                   for config-index = (when (scene-frame-joint-p frame)
+                                        (position (rope-string (scene-frame-joint-configuration-name frame))
+                                                  configs :test #'string=))
+                   collect
+                     (list
+                      (cgen-line-comment (rope "FRAME: " name))
+                      (cgen-block
+                       (cgen-stmt (format nil "double *R = TF_rel + ~D*ld_rel" i))
+                       (cgen-stmt (format nil "double *A = TF_abs + ~D*ld_abs" i))
+                       (scene-genc-kin-rel frame config-index)
+                       (cond
+                         ;; Fold fixed transforms from the global frame
+                         ((and (scene-frame-fixed-p frame)
+                               (or root-p parent-tf))
+                          (let ((tf (if root-p
+                                        (scene-frame-tf frame)
+                                        (tf-mul parent-tf (scene-frame-tf frame)))))
+                            (setf (gethash name constant) tf)
+                            (scene-genc-kin-constants "A" 0 (append (amino::vec-list (tf-quaternion tf))
+                                                                    (amino::vec-list (tf-translation tf))))))
+                         (root-p
+                          (cgen-call-stmt "AA_MEM_CPY" "A" "R" 7))
+                         (t
+                          (list
+                           (cgen-stmt (format nil "const double *P = TF_abs + ~D*ld_abs"
+                                              (gethash parent index)))
+                           (scene-genc-kin-abs frame))))))))))
+
+(defun scene-genc-kin-rotate-axis (axis output)
+  "Statements rotating AXIS by the rotation of E into OUTPUT."
+  (multiple-value-bind (k length) (scene-genc-kin-principal-axis axis)
+    (if k
+        ;; Column K of the rotation matrix
+        (let ((scale (cond ((scene-genc-kin-zerop (- length 1)) "")
+                           ((scene-genc-kin-zerop (+ length 1)) "-")
+                           (t (format nil "~A*" (scene-genc-kin-double length))))))
+          (scene-genc-kin-assign
+           output 0
+           (mapcar (lambda (x) (format nil "~A(~A)" scale x))
+                   (ecase k
+                     (0 '("1 - 2*(E[1]*E[1] + E[2]*E[2])"
+                          "2*(E[0]*E[1] + E[2]*E[3])"
+                          "2*(E[0]*E[2] - E[1]*E[3])"))
+                     (1 '("2*(E[0]*E[1] - E[2]*E[3])"
+                          "1 - 2*(E[0]*E[0] + E[2]*E[2])"
+                          "2*(E[1]*E[2] + E[0]*E[3])"))
+                     (2 '("2*(E[0]*E[2] + E[1]*E[3])"
+                          "2*(E[1]*E[2] - E[0]*E[3])"
+                          "1 - 2*(E[0]*E[0] + E[1]*E[1])"))))))
+        (list (cgen-declare-array "static const double" "axis" (amino::vec-list axis))
+              (cgen-call-stmt "aa_tf_qrot" "E" "axis" output)))))
+
+(defun scene-genc-kin-chain-frames (scene-graph root tip)
+  "Frames from ROOT (exclusive) to TIP (inclusive)."
+  (let ((root (rope-string (or root ""))))
+    (do ((name (rope-string tip) (rope-string (or (scene-frame-parent frame) "")))
+         (frame nil)
+         (result nil))
+        ((or (string= name root) (zerop (length name)))
+         result)
+      (setq frame (scene-graph-lookup scene-graph name))
+      (assert frame () "Frame ~A not found in scene graph" name)
+      (push frame result))))
+
+(defun scene-genc-kin-jacobian (function-name frames chain-frames)
+  "Define a Jacobian function for the chain of CHAIN-FRAMES."
+  (let ((index (lambda (frame)
+                 (position frame frames))))
+    (cgen-defun "static void" function-name
+                "const double *TF_abs, size_t ld_abs, double *J, size_t ld_J"
+                (list
+                 (cgen-stmt (format nil "const double *pe = TF_abs + ~D*ld_abs + AA_TF_QUTR_T"
+                                    (funcall index (car (last chain-frames)))))
+                 (loop for frame in (remove-if-not #'scene-frame-joint-p chain-frames)
+                    for column from 0
+                    for axis = (scene-frame-joint-axis frame)
+                    collect
+                      (list
+                       (cgen-line-comment (rope "FRAME: " (scene-frame-name frame)))
+                       (cgen-block
+                        (cgen-stmt (format nil "const double *E = TF_abs + ~D*ld_abs"
+                                           (funcall index frame)))
+                        (cgen-stmt (format nil "double *Jr = J + ~D*ld_J + AA_TF_DX_W" column))
+                        (cgen-stmt (format nil "double *Jt = J + ~D*ld_J + AA_TF_DX_V" column))
+                        (etypecase frame
+                          (scene-frame-revolute
+                           (list (scene-genc-kin-rotate-axis axis "Jr")
+                                 (cgen-stmt "double r[3] = {pe[0]-E[4], pe[1]-E[5], pe[2]-E[6]}")
+                                 (cgen-call-stmt "aa_tf_cross" "Jr" "r" "Jt")))
+                          (scene-frame-prismatic
+                           (list (scene-genc-kin-constants "Jr" 0 '(0d0 0d0 0d0))
+                                 (scene-genc-kin-rotate-axis axis "Jt")))))))))))
+
+(defun scene-genc-kin-names (name names)
+  (cgen-stmt (format nil "static const char *const ~A[~D] = {~{~A~^, ~}}"
+                     name (max 1 (length names))
+                     (or (mapcar #'scene-genc-kin-c-string names)
+                         (list "NULL")))))
+
+(defun scene-graph-kin-function-name (scene-name)
+  (if (and scene-name (not (zerop (rope-length scene-name))))
+      (rope "aa_rx_dl_sg_kin__" scene-name)
+      (scene-graph-kin-function-name "scenegraph")))
+
+(defun scene-graph-genc-kin (scene-graph &key scene-name chains)
+  "Generate straight-line kinematics for SCENE-GRAPH.
+
+CHAINS is a list of (ROOT TIP) frame names for which to generate
+Jacobians."
+  (let* ((function-name (rope-string (scene-graph-kin-function-name scene-name)))
+         (tf-name (format nil "~A__tf" function-name))
+         (frames (scene-genc-kin-frames scene-graph))
+         (configs (scene-genc-kin-configs frames))
+         (chains (loop for (root tip) in chains
+                    for i from 0
+                    for chain-frames = (scene-genc-kin-chain-frames scene-graph root tip)
+                    collect (list (rope-string (or root ""))
+                                  (rope-string tip)
+                                  chain-frames
+                                  (format nil "~A__jac_~D" function-name i)
+                                  (format nil "~A__jac_~D_configs" function-name i)))))
+    (flatten
+     (list
+      ;; Kernels
+      (scene-genc-kin-tf tf-name frames configs)
+      (loop for (nil nil chain-frames jac-name) in chains
+         collect (scene-genc-kin-jacobian jac-name frames chain-frames))
+      ;; Descriptor
+      (cgen-defun "const struct aa_rx_dl_sg_kin *" function-name "void"
+                  (list
+                   (scene-genc-kin-names "frames"
+                                         (mapcar (lambda (frame) (scene-frame-name frame)) frames))
+                   (scene-genc-kin-names "configs" configs)
+                   (loop for (nil nil chain-frames nil configs-name) in chains
+                      collect (scene-genc-kin-names
+                               configs-name
+                               (loop for frame in chain-frames
+                                  when (scene-frame-joint-p frame)
+                                  collect (scene-frame-joint-configuration-name frame))))
+                   (cgen-stmt
+                    (format nil "static const struct aa_rx_dl_sg_chain chains[~D] = {~{~A~^, ~}}"
+                            (max 1 (length chains))
+                            (or (loop for (root tip chain-frames jac-name configs-name) in chains
+                                   collect (format nil "{~A, ~A, ~D, ~A, ~A}"
+                                                   (scene-genc-kin-c-string root)
+                                                   (scene-genc-kin-c-string tip)
+                                                   (count-if #'scene-frame-joint-p chain-frames)
+                                                   configs-name jac-name))
+                                (list "{NULL, NULL, 0, NULL, NULL}"))))
+                   (cgen-stmt
+                    (format nil "static const struct aa_rx_dl_sg_kin kin = {~D, frames, ~D, configs, ~A, ~D, chains}"
+                            (length frames) (length configs) tf-name (length chains)))
+                   (cgen-return "&kin")))))))
 
 
 ;; (defparameter *scene-graph-compiler* "gcc" "Compiler for scene graphs")
@@ -379,13 +715,16 @@
                               shared-object
                               (reload t)
                               (static-mesh t)
-                              (link-meshes nil))
+                              (link-meshes nil)
+                              (kinematics nil)
+                              chains)
 
   ;; Header
   (when header-file
     (output-rope (rope (scene-graph-gen-header scene-graph
                                                :scene-name scene-name
-                                               :static-mesh static-mesh))
+                                               :static-mesh static-mesh
+                                               :kinematics kinematics))
                  header-file
                  :if-exists :supersede))
   ;; source file
@@ -395,9 +734,14 @@
     (let ((*print-pretty* nil))
       (output-rope (rope (cgen-include-system "amino.h")
                          (cgen-include-system "amino/rx.h")
+                         (cgen-include-system "amino/rx/scene_plugin.h")
                          (scene-graph-genc scene-graph
                                            :scene-name scene-name
-                                           :static-mesh static-mesh))
+                                           :static-mesh static-mesh)
+                         (when kinematics
+                           (scene-graph-genc-kin scene-graph
+                                                 :scene-name scene-name
+                                                 :chains chains)))
                    source-file
                    :if-exists :supersede)))
   ;; build shared object
@@ -48,12 +48,17 @@
 
 
 #include "amino/rx/scene_collision.h"
+#include "amino/rx/scene_sub.h"
 
 #include <fcl/collision.h>
+#include <fcl/continuous_collision.h>
 #include <fcl/shape/geometric_shapes.h>
 #include <fcl/broadphase/broadphase.h>
 #include <fcl/BVH/BVH_model.h>
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "amino/rx/scene_collision_internal.h"
 #include "amino/rx/scene_fcl.h"
 
@@ -219,14 +224,19 @@ static void cl_init_helper( void *cx, aa_rx_frame_id frame_id, struct aa_rx_geom
 
 void aa_rx_sg_cl_init( struct aa_rx_sg *scene_graph )
 {
+    amino::SceneGraph *sg = scene_graph->sg;
+
+    /* Frozen scene graphs are read-only and were initialized before
+     * freezing */
+    if( sg->frozen && aa_rx_sg_is_clean_collision(scene_graph) ) return;
+
     if( ! aa_rx_sg_is_clean_collision(scene_graph) ) {
         aa_rx_cl_init();
-        aa_rx_sg_map_geom( scene_graph, &cl_init_helper, scene_graph );
-        aa_rx_sg_clean_collision(scene_graph);
     }
 
+    /* Frame ids change when frames are added or removed, even without
+     * geometry, so always rebuild the allowed indices */
     aa_rx_sg_map_geom( scene_graph, &cl_init_helper, scene_graph );
-    amino::SceneGraph *sg = scene_graph->sg;
     sg->allowed_indices1.clear();
     sg->allowed_indices2.clear();
 
@@ -239,19 +249,111 @@ void aa_rx_sg_cl_init( struct aa_rx_sg *scene_graph )
 }
 
 
+/* Broadphase managers.  Static geometry does not move between
+ * checks.  Robot geometry moves with the bodies of the moving
+ * sub-scenegraph.  Attached geometry is carried by the sub-scenegraph
+ * on bodies it does not drive, e.g., grippers and grasped objects. */
+enum cl_manager {
+    CL_STATIC = 0,
+    CL_ROBOT = 1,
+    CL_ATTACHED = 2,
+    CL_MANAGER_COUNT = 3
+};
+
+/* Manager pairs with moving geometry, in checking order */
+static const enum cl_manager cl_moving_pairs[][2] = {
+    {CL_ROBOT, CL_STATIC},
+    {CL_ATTACHED, CL_STATIC},
+    {CL_ROBOT, CL_ROBOT},
+    {CL_ROBOT, CL_ATTACHED},
+    {CL_ATTACHED, CL_ATTACHED}
+};
+
+/* Distance between a frame pair, with closest points and the normal
+ * from id[0] toward id[1] */
+struct cl_dist_pair {
+    aa_rx_frame_id id[2];
+    double d;
+    double p[2][3];
+    double n[3];
+};
+
+/* A box bounding the swept volume of a moving object */
+struct cl_sweep {
+    fcl::CollisionObject *obj;
+    AA_FCL_SHARED_PTR<fcl::Box> box;
+    fcl::CollisionObject *proxy;
+    fcl::Transform3f tf_end;
+};
+
 struct aa_rx_cl
 {
     const struct aa_rx_sg *sg;
-    fcl::BroadPhaseCollisionManager *manager;
     std::vector<fcl::CollisionObject*> *objects;
 
     // A bit-matrix of allowable collisions
     struct aa_rx_cl_set *allowed;
+
+    fcl::BroadPhaseCollisionManager *managers[CL_MANAGER_COUNT];
+    std::vector<fcl::CollisionObject*> manager_objects[CL_MANAGER_COUNT];
+    bool manager_skip[CL_MANAGER_COUNT][CL_MANAGER_COUNT];
+
+    /* Filter groups: geometry moving with the same frame, or with the
+     * world.  Objects are filtered by group in the callbacks, so
+     * frame pairs of groups that are entirely allowed are never
+     * looked up. */
+    std::vector<size_t> frame_group;
+    std::vector< std::vector<aa_rx_frame_id> > group_frames;
+    std::vector<aa_rx_frame_id> group_body;
+    std::vector<enum cl_manager> group_manager;
+
+    // Group pairs with all frame pairs allowed, packed lower triangle
+    std::vector<aa_bits> group_skip;
+    bool dirty_skip;
+
+    /* Static geometry is placed and refit only when dirty_static is
+     * set, and its mutual collisions are cached in static_set. */
+    bool dirty_static;
+    bool dirty_static_set;
+    int static_result;
+    struct aa_rx_cl_set *static_set;
+
+    /* Distances among static geometry nearer than static_dist_margin */
+    bool dirty_static_dist;
+    double static_dist_margin;
+    std::vector<struct cl_dist_pair> static_dist;
+
+    /* Proxies of the moving objects for continuous checks, indexed by
+     * their user data */
+    fcl::BroadPhaseCollisionManager *sweep_manager;
+    std::vector<struct cl_sweep> sweeps;
+};
+
+/* The moving frame that carries frame, or AA_RX_FRAME_ROOT */
+static aa_rx_frame_id
+cl_body( const struct aa_rx_sg *sg, aa_rx_frame_id frame )
+{
+    while( frame >= 0 && AA_RX_FRAME_FIXED == aa_rx_sg_frame_type(sg, frame) ) {
+        frame = aa_rx_sg_frame_parent(sg, frame);
+    }
+    return frame;
+}
+
+static inline size_t
+cl_group_i( size_t g, size_t h )
+{
+    return (g < h) ? (h*(h+1)/2 + g) : (g*(g+1)/2 + h);
+}
+
+struct cl_create_cx {
+    struct aa_rx_cl *cl;
+    std::vector<size_t> body_group;
 };
 
 static void cl_create_helper( void *cx_, aa_rx_frame_id frame_id, struct aa_rx_geom *geom )
 {
-    struct aa_rx_cl *cx = (struct aa_rx_cl*)cx_;
+    struct cl_create_cx *cx = (struct cl_create_cx*)cx_;
+    struct aa_rx_cl *cl = cx->cl;
 
     //printf("adding cl_geom for %s\n", aa_rx_sg_frame_name(cx->sg, frame_id) );
 
@@ -260,8 +362,108 @@ static void cl_create_helper( void *cx_, aa_rx_frame_id frame_id, struct aa_rx_g
 
     fcl::CollisionObject *obj = new fcl::CollisionObject( cl_geom->ptr );
     obj->setUserData( (void*) ((intptr_t) frame_id) );
-    cx->manager->registerObject(obj);
-    cx->objects->push_back( obj );
+    cl->objects->push_back( obj );
+
+    aa_rx_frame_id body = cl_body(cl->sg, frame_id);
+    size_t &g = cx->body_group[ (size_t)(body + 1) ];
+    if( SIZE_MAX == g ) {
+        g = cl->group_body.size();
+        cl->group_frames.push_back( std::vector<aa_rx_frame_id>() );
+        cl->group_body.push_back( body );
+    }
+    std::vector<aa_rx_frame_id> &frames = cl->group_frames[g];
+    if( frames.end() == std::find(frames.begin(), frames.end(), frame_id) ) {
+        frames.push_back(frame_id);
+    }
+    cl->frame_group[(size_t)frame_id] = g;
+}
+
+static inline size_t
+cl_obj_group( const struct aa_rx_cl *cl, const fcl::CollisionObject *obj )
+{
+    return cl->frame_group[ (size_t)(intptr_t)obj->getUserData() ];
+}
+
+static void
+cl_sweeps_clear( struct aa_rx_cl *cl )
+{
+    cl->sweep_manager->clear();
+    for( struct cl_sweep &sweep : cl->sweeps ) {
+        delete sweep.proxy;
+    }
+    cl->sweeps.clear();
+}
+
+/* Assign groups to managers by whether they move with
+ * sub-scenegraph configs, or with any config when ssg is NULL */
+static void
+cl_update_moving( struct aa_rx_cl *cl, const struct aa_rx_sg_sub *ssg )
+{
+    size_t n = cl->group_body.size();
+    cl->group_manager.assign( n, CL_STATIC );
+
+    if( ssg ) {
+        size_t n_f = aa_rx_sg_frame_count(cl->sg);
+        std::vector<bool> frame_moving(n_f, false);
+        std::vector<bool> frame_sub(n_f, false);
+        std::vector<bool> config_sub( aa_rx_sg_config_count(cl->sg), false );
+        for( size_t i = 0; i < aa_rx_sg_sub_config_count(ssg); i ++ ) {
+            config_sub[(size_t)aa_rx_sg_sub_config(ssg,i)] = true;
+        }
+        for( size_t i = 0; i < aa_rx_sg_sub_frame_count(ssg); i ++ ) {
+            frame_sub[(size_t)aa_rx_sg_sub_frame(ssg,i)] = true;
+        }
+        /* Frames are in preorder, so parents come first */
+        for( aa_rx_frame_id f = 0; (size_t)f < n_f; f ++ ) {
+            aa_rx_frame_id p = aa_rx_sg_frame_parent(cl->sg, f);
+            aa_rx_config_id c = aa_rx_sg_frame_config(cl->sg, f);
+            frame_moving[(size_t)f] = ( (p >= 0 && frame_moving[(size_t)p]) ||
+                                        (c >= 0 && config_sub[(size_t)c]) );
+        }
+        for( size_t g = 0; g < n; g ++ ) {
+            aa_rx_frame_id b = cl->group_body[g];
+            if( b >= 0 && frame_moving[(size_t)b] ) {
+                cl->group_manager[g] = frame_sub[(size_t)b] ? CL_ROBOT : CL_ATTACHED;
+            }
+        }
+    } else {
+        for( size_t g = 0; g < n; g ++ ) {
+            if( cl->group_body[g] >= 0 ) cl->group_manager[g] = CL_ROBOT;
+        }
+    }
+
+    for( size_t m = 0; m < CL_MANAGER_COUNT; m ++ ) {
+        cl->managers[m]->clear();
+        cl->manager_objects[m].clear();
+    }
+    for( fcl::CollisionObject *obj : *cl->objects ) {
+        enum cl_manager m = cl->group_manager[cl_obj_group(cl, obj)];
+        cl->manager_objects[m].push_back(obj);
+        cl->managers[m]->registerObject(obj);
+    }
+    for( size_t m = 0; m < CL_MANAGER_COUNT; m ++ ) {
+        cl->managers[m]->setup();
+    }
+
+    cl_sweeps_clear(cl);
+    for( size_t m = 0; m < CL_MANAGER_COUNT; m ++ ) {
+        if( CL_STATIC == m ) continue;
+        for( fcl::CollisionObject *obj : cl->manager_objects[m] ) {
+            struct cl_sweep sweep;
+            sweep.obj = obj;
+            sweep.box = AA_FCL_SHARED_PTR<fcl::Box>( new fcl::Box(0,0,0) );
+            sweep.proxy = new fcl::CollisionObject( sweep.box );
+            sweep.proxy->setUserData( (void*) ((intptr_t) cl->sweeps.size()) );
+            cl->sweeps.push_back( sweep );
+            cl->sweep_manager->registerObject( sweep.proxy );
+        }
+    }
+    cl->sweep_manager->setup();
+
+    cl->dirty_skip = true;
+    cl->dirty_static = true;
+    cl->dirty_static_set = true;
+    cl->dirty_static_dist = true;
 }
 
 struct aa_rx_cl *
@@ -272,13 +474,22 @@ aa_rx_cl_create( const struct aa_rx_sg *scene_graph )
     struct aa_rx_cl *cl = new aa_rx_cl;
     cl->sg = scene_graph;
     cl->objects = new std::vector<fcl::CollisionObject*>;
-    cl->manager = new fcl::DynamicAABBTreeCollisionManager();
 
     cl->allowed = aa_rx_cl_set_create(scene_graph);
 
-    aa_rx_sg_map_geom( scene_graph, &cl_create_helper, cl );
+    cl->frame_group.assign( aa_rx_sg_frame_count(scene_graph), SIZE_MAX );
+    struct cl_create_cx cx;
+    cx.cl = cl;
+    cx.body_group.assign( aa_rx_sg_frame_count(scene_graph) + 1, SIZE_MAX );
+    aa_rx_sg_map_geom( scene_graph, &cl_create_helper, &cx );
+
+    for( size_t m = 0; m < CL_MANAGER_COUNT; m ++ ) {
+        cl->managers[m] = new fcl::DynamicAABBTreeCollisionManager();
+    }
+    cl->sweep_manager = new fcl::DynamicAABBTreeCollisionManager();
 
-    cl->manager->setup();
+    cl->static_set = aa_rx_cl_set_create(scene_graph);
+    cl_update_moving(cl, NULL);
 
     return cl;
 }
@@ -290,9 +501,14 @@ aa_rx_cl_destroy( struct aa_rx_cl *cl )
         delete o;
     }
 
-    delete cl->manager;
+    cl_sweeps_clear( cl );
+    delete cl->sweep_manager;
+    for( size_t m = 0; m < CL_MANAGER_COUNT; m ++ ) {
+        delete cl->managers[m];
+    }
     delete cl->objects;
     aa_rx_cl_set_destroy( cl->allowed );
+    aa_rx_cl_set_destroy( cl->static_set );
     delete cl;
 }
 
@@ -303,6 +519,10 @@ aa_rx_cl_allow( struct aa_rx_cl *cl,
                 int allowed )
 {
     aa_rx_cl_set_set( cl->allowed, id0, id1, allowed );
+    cl->dirty_skip = true;
+    cl->dirty_static = true;
+    cl->dirty_static_set = true;
+    cl->dirty_static_dist = true;
 }
 
 AA_API void
@@ -310,6 +530,17 @@ aa_rx_cl_allow_set( struct aa_rx_cl *cl,
                     const struct aa_rx_cl_set *set )
 {
     aa_rx_cl_set_fill( cl->allowed, set );
+    cl->dirty_skip = true;
+    cl->dirty_static = true;
+    cl->dirty_static_set = true;
+    cl->dirty_static_dist = true;
+}
+
+AA_API void
+aa_rx_cl_set_moving( struct aa_rx_cl *cl,
+                     const struct aa_rx_sg_sub *ssg )
+{
+    cl_update_moving(cl, ssg);
 }
 
 
@@ -325,10 +556,64 @@ aa_rx_cl_allow_name( struct aa_rx_cl *cl,
                     allowed );
 }
 
+/* Find the group pairs, and the manager pairs, that need no checking */
+static void
+cl_update_skip( struct aa_rx_cl *cl )
+{
+    size_t n = cl->group_body.size();
+    cl->group_skip.assign( AA_MAX(aa_bits_words(n*(n+1)/2), 1), 0 );
+
+    for( size_t a = 0; a < CL_MANAGER_COUNT; a ++ ) {
+        for( size_t b = 0; b < CL_MANAGER_COUNT; b ++ ) {
+            cl->manager_skip[a][b] = true;
+        }
+    }
+
+    for( size_t g = 0; g < n; g ++ ) {
+        const std::vector<aa_rx_frame_id> &fg = cl->group_frames[g];
+        for( size_t h = 0; h <= g; h ++ ) {
+            const std::vector<aa_rx_frame_id> &fh = cl->group_frames[h];
+            bool skip = true;
+            for( size_t i = 0; skip && i < fg.size(); i ++ ) {
+                for( size_t j = 0; skip && j < fh.size(); j ++ ) {
+                    /* Geometry in the same frame is never checked */
+                    skip = ( fg[i] == fh[j] ||
+                             aa_rx_cl_set_get(cl->allowed, fg[i], fh[j]) );
+                }
+            }
+            if( skip ) {
+                aa_bits_set( cl->group_skip.data(), cl_group_i(g,h), 1 );
+            } else {
+                enum cl_manager a = cl->group_manager[g];
+                enum cl_manager b = cl->group_manager[h];
+                cl->manager_skip[a][b] = cl->manager_skip[b][a] = false;
+            }
+        }
+    }
+
+    cl->dirty_skip = false;
+}
+
+/* Whether the pair of objects needs no checking */
+static inline bool
+cl_skip( struct aa_rx_cl *cl,
+         const fcl::CollisionObject *o1, const fcl::CollisionObject *o2 )
+{
+    aa_rx_frame_id id1 = (intptr_t) o1->getUserData();
+    aa_rx_frame_id id2 = (intptr_t) o2->getUserData();
+    if( id1 == id2 ) return true;
+    size_t g1 = cl->frame_group[(size_t)id1];
+    size_t g2 = cl->frame_group[(size_t)id2];
+    return ( aa_bits_get(cl->group_skip.data(), cl_group_i(g1,g2)) ||
+             aa_rx_cl_set_get(cl->allowed, id1, id2) );
+}
+
 struct cl_check_data {
     int result;
     struct aa_rx_cl *cl;
     struct aa_rx_cl_set *cl_set;
+    fcl::CollisionRequest request;
+    fcl::CollisionResult fcl_result;
 };
 
 static bool
@@ -337,24 +622,17 @@ cl_check_callback( ::fcl::CollisionObject *o1,
                    void *data_ )
 {
     struct cl_check_data *data = (struct cl_check_data*)data_;
-    aa_rx_frame_id id1 = (intptr_t) o1->getUserData();
-    aa_rx_frame_id id2 = (intptr_t) o2->getUserData();
 
     //const struct aa_rx_sg *sg = data->cl->sg;
     //const char *name1 = aa_rx_sg_frame_name(sg, id1);
     //const char *name2 = aa_rx_sg_frame_name(sg, id2);
 
-    /* Skip geometry in the same frame */
-    if( id1 == id2 ) return false;
+    /* Skip geometry in the same frame and allowed collisions */
+    if( cl_skip(data->cl, o1, o2) ) return false;
 
-    /* Check if allowed collision */
-    if( aa_rx_cl_set_get(data->cl->allowed,id1,id2) ) {
-        return false;
-    }
-
-
-    fcl::CollisionRequest request;
-    fcl::CollisionResult result;
+    const fcl::CollisionRequest &request = data->request;
+    fcl::CollisionResult &result = data->fcl_result;
+    result.clear();
     fcl::collide(o1, o2, request, result);
 
     if(!request.enable_cost && (result.isCollision()) && (result.numContacts() >= request.num_max_contacts)) {
@@ -364,6 +642,8 @@ cl_check_callback( ::fcl::CollisionObject *o1,
 
         /* Short Circuit? */
         if( data->cl_set ) {
+            aa_rx_frame_id id1 = (intptr_t) o1->getUserData();
+            aa_rx_frame_id id2 = (intptr_t) o2->getUserData();
             aa_rx_cl_set_set( data->cl_set, id1, id2, 1 );
         } else {
             return true;
@@ -373,51 +653,508 @@ cl_check_callback( ::fcl::CollisionObject *o1,
     return false;
 }
 
+static fcl::Transform3f
+cl_obj_tf( const fcl::CollisionObject *obj, const double *TF, size_t ldTF )
+{
+    aa_rx_frame_id id = (intptr_t) obj->getUserData();
+    const double *TF_obj = TF+id*ldTF;
+
+    enum aa_rx_geom_shape shape_type;
+    struct aa_rx_geom *geom = (struct aa_rx_geom*)obj->collisionGeometry()->getUserData();
+    void *shape_ = aa_rx_geom_shape( geom, &shape_type);
+
+    /* Special case cylinders.
+     * Amino cylinders extend in +Z
+     * FCL cylinders extend in both +/- Z.
+     */
+    if( AA_RX_CYLINDER == shape_type ) {
+        struct aa_rx_shape_cylinder *shape = (struct aa_rx_shape_cylinder *)  shape_;
+        double E[7] = {0,0,0,1, 0,0, shape->height/2};
+        double E1[7];
+        aa_tf_qutr_mul(TF_obj, E, E1);
+        return amino::fcl::qutr2fcltf(E1);
+    } else {
+        return amino::fcl::qutr2fcltf(TF_obj);
+    }
+}
+
+static void
+cl_update_tf( fcl::CollisionObject *obj, const double *TF, size_t ldTF )
+{
+    obj->setTransform( cl_obj_tf(obj, TF, ldTF) );
+    obj->computeAABB();
+}
+
+/* Collide the objects of managers a and b */
+static void
+cl_collide_managers( struct aa_rx_cl *cl, enum cl_manager a, enum cl_manager b,
+                     void *data, fcl::CollisionCallBack callback )
+{
+    if( cl->manager_skip[a][b] ) return;
+    if( a == b ) {
+        cl->managers[a]->collide( data, callback );
+    } else {
+        cl->managers[a]->collide( cl->managers[b], data, callback );
+    }
+}
+
+/* Collide manager pairs with moving geometry */
+static void
+cl_check_moving( struct aa_rx_cl *cl, struct cl_check_data *data )
+{
+    for( size_t i = 0; i < sizeof(cl_moving_pairs)/sizeof(cl_moving_pairs[0]); i ++ ) {
+        cl_collide_managers( cl, cl_moving_pairs[i][0], cl_moving_pairs[i][1],
+                             data, cl_check_callback );
+        /* Short Circuit */
+        if( data->result && NULL == data->cl_set ) return;
+    }
+}
+
+/* Place the moving geometry, and the static geometry if dirty */
+static void
+cl_update_managers( struct aa_rx_cl *cl, const double *TF, size_t ldTF )
+{
+    if( cl->dirty_skip ) cl_update_skip(cl);
+
+    for( size_t m = 0; m < CL_MANAGER_COUNT; m ++ ) {
+        if( CL_STATIC != m || cl->dirty_static ) {
+            for( fcl::CollisionObject *obj : cl->manager_objects[m] ) {
+                cl_update_tf( obj, TF, ldTF );
+            }
+            cl->managers[m]->update();
+        }
+    }
+    cl->dirty_static = false;
+}
+
+/* Collisions among static geometry, found once per placement */
+static int
+cl_check_static( struct aa_rx_cl *cl, struct aa_rx_cl_set *cl_set )
+{
+    if( cl->dirty_static_set ) {
+        struct cl_check_data data;
+        data.result = 0;
+        data.cl = cl;
+        data.cl_set = cl->static_set;
+        aa_rx_cl_set_clear( cl->static_set );
+        cl_collide_managers( cl, CL_STATIC, CL_STATIC, &data, cl_check_callback );
+        cl->static_result = data.result;
+        cl->dirty_static_set = false;
+    }
+
+    if( cl->static_result && cl_set ) {
+        aa_rx_cl_set_merge( cl_set, cl->static_set );
+    }
+    return cl->static_result;
+}
+
 int
 aa_rx_cl_check( struct aa_rx_cl *cl,
                 size_t n_tf,
                 const double *TF, size_t ldTF,
                 struct aa_rx_cl_set *cl_set )
 {
-    /* Update Transforms */
-    for( auto itr = cl->objects->begin();
-         itr != cl->objects->end();
-         itr++ )
-    {
-        fcl::CollisionObject *obj = *itr;
-        aa_rx_frame_id id = (intptr_t) obj->getUserData();
-        const double *TF_obj = TF+id*ldTF;
-
-        enum aa_rx_geom_shape shape_type;
-        struct aa_rx_geom *geom = (struct aa_rx_geom*)obj->collisionGeometry()->getUserData();
-        void *shape_ = aa_rx_geom_shape( geom, &shape_type);
-
-        /* Special case cylinders.
-         * Amino cylinders extend in +Z
-         * FCL cylinders extend in both +/- Z.
-         */
-        if( AA_RX_CYLINDER == shape_type ) {
-            struct aa_rx_shape_cylinder *shape = (struct aa_rx_shape_cylinder *)  shape_;
-            double E[7] = {0,0,0,1, 0,0, shape->height/2};
-            double E1[7];
-            aa_tf_qutr_mul(TF_obj, E, E1);
-            obj->setTransform(amino::fcl::qutr2fcltf(E1));
+    cl_update_managers( cl, TF, ldTF );
+
+    int result = cl_check_static( cl, cl_set );
+    if( result && NULL == cl_set ) return result;
+
+    /* Check Collision */
+    struct cl_check_data data;
+    data.result = result;
+    data.cl = cl;
+    data.cl_set = cl_set;
+    cl_check_moving( cl, &data );
+
+    return data.result;
+}
+
+/*--- Continuous ---*/
+
+struct cl_motion_data {
+    int result;
+    struct aa_rx_cl *cl;
+    struct aa_rx_cl_set *cl_set;
+    bool sweep_static;  ///< whether o2 is static geometry, not a proxy
+    fcl::ContinuousCollisionRequest request;
+};
+
+/* Objects of the calling manager come first, so o1 is always a
+ * proxy */
+static bool
+cl_motion_callback( ::fcl::CollisionObject *o1,
+                    ::fcl::CollisionObject *o2,
+                    void *data_ )
+{
+    struct cl_motion_data *data = (struct cl_motion_data*)data_;
+    struct aa_rx_cl *cl = data->cl;
+
+    const struct cl_sweep &s1 = cl->sweeps[ (size_t)(intptr_t)o1->getUserData() ];
+    fcl::CollisionObject *obj2;
+    fcl::Transform3f tf2_end;
+    if( data->sweep_static ) {
+        obj2 = o2;
+        tf2_end = o2->getTransform();
+    } else {
+        const struct cl_sweep &s2 = cl->sweeps[ (size_t)(intptr_t)o2->getUserData() ];
+        obj2 = s2.obj;
+        tf2_end = s2.tf_end;
+    }
+
+    if( cl_skip(cl, s1.obj, obj2) ) return false;
+
+    fcl::ContinuousCollisionResult ccd_result;
+    fcl::continuousCollide( s1.obj, s1.tf_end, obj2, tf2_end,
+                            data->request, ccd_result );
+    if( ccd_result.is_collide ) {
+        data->result = 1;
+        /* Short Circuit? */
+        if( data->cl_set ) {
+            aa_rx_cl_set_set( data->cl_set,
+                              (intptr_t) s1.obj->getUserData(),
+                              (intptr_t) obj2->getUserData(), 1 );
         } else {
-            obj->setTransform( amino::fcl::qutr2fcltf(TF_obj) );
+            return true;
         }
     }
-    cl->manager->update();
 
-    /* Check Collision */
-    struct cl_check_data data;
-    data.result = 0;
+    return false;
+}
+
+AA_API int
+aa_rx_cl_check_motion( struct aa_rx_cl *cl,
+                       size_t n_tf,
+                       const double *TF_start, size_t ld_start,
+                       const double *TF_end, size_t ld_end,
+                       struct aa_rx_cl_set *cl_set )
+{
+    assert( n_tf == aa_rx_sg_frame_count(cl->sg) );
+    (void)n_tf;
+
+    cl_update_managers( cl, TF_start, ld_start );
+
+    int result = cl_check_static( cl, cl_set );
+    if( result && NULL == cl_set ) return result;
+
+    /* Fit each proxy to the swept bounds of its object */
+    for( struct cl_sweep &sweep : cl->sweeps ) {
+        fcl::CollisionObject *obj = sweep.obj;
+        aa_rx_frame_id id = (intptr_t) obj->getUserData();
+        const fcl::CollisionGeometry *geom = obj->collisionGeometry().get();
+        sweep.tf_end = cl_obj_tf( obj, TF_end, ld_end );
+
+        fcl::AABB bv = obj->getAABB();
+        fcl::FCL_REAL r = geom->aabb_radius;
+        fcl::Vec3f c = sweep.tf_end.transform( geom->aabb_center );
+        bv += fcl::AABB( c - fcl::Vec3f(r,r,r), c + fcl::Vec3f(r,r,r) );
+        /* Rotation moves points off the chord by at most their radius
+         * times the angle */
+        fcl::FCL_REAL theta = 2 * aa_tf_qangle_rel( TF_start + id*ld_start,
+                                                    TF_end + id*ld_end );
+        fcl::FCL_REAL pad = theta * (geom->aabb_center.length() + r);
+        fcl::Vec3f v_pad(pad,pad,pad);
+        bv = fcl::AABB( bv.min_ - v_pad, bv.max_ + v_pad );
+
+        sweep.box->side = bv.max_ - bv.min_;
+        sweep.box->computeLocalAABB();
+        sweep.proxy->setTransform( fcl::Transform3f(bv.center()) );
+        sweep.proxy->computeAABB();
+    }
+    cl->sweep_manager->update();
+
+    struct cl_motion_data data;
+    data.result = result;
     data.cl = cl;
     data.cl_set = cl_set;
+    data.request.ccd_motion_type = fcl::CCDM_LINEAR;
+    data.request.ccd_solver_type = fcl::CCDC_CONSERVATIVE_ADVANCEMENT;
+
+    /* Moving against moving geometry */
+    if( ! ( cl->manager_skip[CL_ROBOT][CL_ROBOT] &&
+            cl->manager_skip[CL_ROBOT][CL_ATTACHED] &&
+            cl->manager_skip[CL_ATTACHED][CL_ATTACHED] ) )
+    {
+        data.sweep_static = false;
+        cl->sweep_manager->collide( &data, cl_motion_callback );
+        if( data.result && NULL == cl_set ) return data.result;
+    }
+
+    /* Moving against static geometry */
+    if( ! ( cl->manager_skip[CL_ROBOT][CL_STATIC] &&
+            cl->manager_skip[CL_ATTACHED][CL_STATIC] ) )
+    {
+        data.sweep_static = true;
+        cl->sweep_manager->collide( cl->managers[CL_STATIC], &data, cl_motion_callback );
+    }
 
-    cl->manager->collide( &data, cl_check_callback );
     return data.result;
 }
 
+/*--- Distance ---*/
+
+struct cl_dist_entry {
+    double d;
+    double p[2][3];     ///< Closest points on the larger and smaller frame id
+    double n[3];        ///< Unit normal from p[0] toward p[1]
+};
+
+struct cl_dist_frame {
+    double d;
+    aa_rx_frame_id other;
+};
+
+struct aa_rx_cl_dist {
+    const struct aa_rx_sg *sg;
+    std::unordered_map<size_t, cl_dist_entry> pairs;
+    std::vector<cl_dist_frame> frames;
+};
+
+static inline size_t
+cl_dist_key( aa_rx_frame_id i, aa_rx_frame_id j )
+{
+    return cl_group_i( (size_t)i, (size_t)j );
+}
+
+AA_API struct aa_rx_cl_dist *
+aa_rx_cl_dist_create( const struct aa_rx_cl *cl )
+{
+    struct aa_rx_cl_dist *dist = new aa_rx_cl_dist;
+    dist->sg = cl->sg;
+    dist->frames.resize( aa_rx_sg_frame_count(cl->sg) );
+    return dist;
+}
+
+AA_API void
+aa_rx_cl_dist_destroy( struct aa_rx_cl_dist *dist )
+{
+    delete dist;
+}
+
+AA_API double
+aa_rx_cl_dist_get( const struct aa_rx_cl_dist *dist,
+                   aa_rx_frame_id i, aa_rx_frame_id j,
+                   double p_i[3], double p_j[3], double n[3] )
+{
+    auto itr = dist->pairs.find( cl_dist_key(i,j) );
+    if( dist->pairs.end() == itr ) return INFINITY;
+
+    const struct cl_dist_entry &e = itr->second;
+    int k = (i < j);
+    if( p_i ) AA_MEM_CPY( p_i, e.p[k], 3 );
+    if( p_j ) AA_MEM_CPY( p_j, e.p[!k], 3 );
+    if( n ) {
+        for( size_t a = 0; a < 3; a ++ ) n[a] = k ? -e.n[a] : e.n[a];
+    }
+    return e.d;
+}
+
+AA_API double
+aa_rx_cl_dist_frame( const struct aa_rx_cl_dist *dist,
+                     aa_rx_frame_id i, aa_rx_frame_id *j )
+{
+    const struct cl_dist_frame &f = dist->frames[(size_t)i];
+    if( j ) *j = f.other;
+    return f.d;
+}
+
+struct cl_dist_data {
+    struct aa_rx_cl *cl;
+    struct aa_rx_cl_dist *dist;
+    std::vector<struct cl_dist_pair> *pairs;
+    double margin;
+    double min;
+    fcl::DistanceRequest request;
+    fcl::DistanceResult result;
+    fcl::CollisionRequest cl_request;
+    fcl::CollisionResult cl_result;
+};
+
+static void
+cl_dist_frame_update( struct aa_rx_cl_dist *dist, aa_rx_frame_id i, aa_rx_frame_id j, double d )
+{
+    struct cl_dist_frame &f = dist->frames[(size_t)i];
+    if( d < f.d ) {
+        f.d = d;
+        f.other = j;
+    }
+}
+
+/* Record a pair nearer than the margin */
+static void
+cl_dist_record( struct cl_dist_data *data, const struct cl_dist_pair *pair )
+{
+    double d = pair->d;
+    if( d >= data->margin ) return;
+    data->min = AA_MIN(data->min, d);
+
+    if( data->pairs ) data->pairs->push_back(*pair);
+
+    struct aa_rx_cl_dist *dist = data->dist;
+    if( NULL == dist ) return;
+
+    /* Frames may have several geometries; keep the nearest */
+    aa_rx_frame_id id1 = pair->id[0];
+    aa_rx_frame_id id2 = pair->id[1];
+    auto ins = dist->pairs.emplace( cl_dist_key(id1,id2), cl_dist_entry() );
+    struct cl_dist_entry &e = ins.first->second;
+    if( ins.second || d < e.d ) {
+        int k = (id1 < id2);
+        e.d = d;
+        AA_MEM_CPY( e.p[k], pair->p[0], 3 );
+        AA_MEM_CPY( e.p[!k], pair->p[1], 3 );
+        for( size_t a = 0; a < 3; a ++ ) e.n[a] = k ? -pair->n[a] : pair->n[a];
+        cl_dist_frame_update( dist, id1, id2, d );
+        cl_dist_frame_update( dist, id2, id1, d );
+    }
+}
+
+static bool
+cl_dist_callback( ::fcl::CollisionObject *o1,
+                  ::fcl::CollisionObject *o2,
+                  void *data_,
+                  fcl::FCL_REAL &bound )
+{
+    struct cl_dist_data *data = (struct cl_dist_data*)data_;
+    aa_rx_frame_id id1 = (intptr_t) o1->getUserData();
+    aa_rx_frame_id id2 = (intptr_t) o2->getUserData();
+
+    /* Keep the broadphase visiting every pair within the margin, or
+     * only pairs that could be nearer than the minimum */
+    bound = (data->dist || data->pairs) ? data->margin : AA_MIN(data->margin, data->min);
+
+    if( cl_skip(data->cl, o1, o2) ) return false;
+
+    double d, p[2][3], n[3];
+
+    fcl::DistanceResult &result = data->result;
+    result.clear();
+    fcl::distance(o1, o2, data->request, result);
+
+    /* Nearest points are in each object's local frame */
+    fcl::Vec3f np0 = o1->getTransform().transform( result.nearest_points[0] );
+    fcl::Vec3f np1 = o2->getTransform().transform( result.nearest_points[1] );
+
+    if( result.min_distance > 0 ) {
+        d = result.min_distance;
+        for( size_t a = 0; a < 3; a ++ ) {
+            p[0][a] = np0[a];
+            p[1][a] = np1[a];
+            n[a] = (p[1][a] - p[0][a]) / d;
+        }
+    } else {
+        /* Penetrating: use the deepest contact */
+        fcl::CollisionResult &cl_result = data->cl_result;
+        cl_result.clear();
+        fcl::collide(o1, o2, data->cl_request, cl_result);
+        if( 0 == cl_result.numContacts() ) {
+            /* Touching */
+            d = 0;
+            for( size_t a = 0; a < 3; a ++ ) {
+                p[0][a] = p[1][a] = np0[a];
+                n[a] = 0;
+            }
+        } else {
+            size_t i_max = 0;
+            for( size_t i = 1; i < cl_result.numContacts(); i ++ ) {
+                if( cl_result.getContact(i).penetration_depth >
+                    cl_result.getContact(i_max).penetration_depth )
+                {
+                    i_max = i;
+                }
+            }
+            const fcl::Contact &c = cl_result.getContact(i_max);
+            d = -c.penetration_depth;
+            for( size_t a = 0; a < 3; a ++ ) {
+                n[a] = c.normal[a];
+                p[0][a] = c.pos[a] + n[a]*c.penetration_depth/2;
+                p[1][a] = c.pos[a] - n[a]*c.penetration_depth/2;
+            }
+        }
+    }
+
+    struct cl_dist_pair pair;
+    pair.id[0] = id1;
+    pair.id[1] = id2;
+    pair.d = d;
+    AA_MEM_CPY( pair.p[0], p[0], 3 );
+    AA_MEM_CPY( pair.p[1], p[1], 3 );
+    AA_MEM_CPY( pair.n, n, 3 );
+    cl_dist_record( data, &pair );
+
+    return false;
+}
+
+static void
+cl_dist_data_init( struct cl_dist_data *data, struct aa_rx_cl *cl, double margin )
+{
+    data->cl = cl;
+    data->dist = NULL;
+    data->pairs = NULL;
+    data->margin = margin;
+    data->min = margin;
+    data->request.enable_nearest_points = true;
+    data->cl_request.num_max_contacts = 16;
+    data->cl_request.enable_contact = true;
+}
+
+/* Distances between the objects of managers a and b */
+static void
+cl_distance_managers( struct aa_rx_cl *cl, enum cl_manager a, enum cl_manager b,
+                      struct cl_dist_data *data )
+{
+    if( cl->manager_skip[a][b] ) return;
+    if( a == b ) {
+        cl->managers[a]->distance( data, cl_dist_callback );
+    } else {
+        cl->managers[a]->distance( cl->managers[b], data, cl_dist_callback );
+    }
+}
+
+AA_API double
+aa_rx_cl_distance( struct aa_rx_cl *cl,
+                   size_t n_tf,
+                   const double *TF, size_t ldTF,
+                   double margin,
+                   struct aa_rx_cl_dist *dist )
+{
+    assert( n_tf == aa_rx_sg_frame_count(cl->sg) );
+    (void)n_tf;
+
+    cl_update_managers( cl, TF, ldTF );
+
+    struct cl_dist_data data;
+    cl_dist_data_init( &data, cl, margin );
+    data.dist = dist;
+
+    /* Static pairs, found once per placement unless the margin grows */
+    if( cl->dirty_static_dist || margin > cl->static_dist_margin ) {
+        struct cl_dist_data static_data;
+        cl_dist_data_init( &static_data, cl, margin );
+        static_data.pairs = &cl->static_dist;
+        cl->static_dist.clear();
+        cl_distance_managers( cl, CL_STATIC, CL_STATIC, &static_data );
+        cl->static_dist_margin = margin;
+        cl->dirty_static_dist = false;
+    }
+
+    if( dist ) {
+        dist->pairs.clear();
+        for( struct cl_dist_frame &f : dist->frames ) {
+            f.d = margin;
+            f.other = AA_RX_FRAME_NONE;
+        }
+    }
+
+    for( const struct cl_dist_pair &pair : cl->static_dist ) {
+        cl_dist_record( &data, &pair );
+    }
+    for( size_t i = 0; i < sizeof(cl_moving_pairs)/sizeof(cl_moving_pairs[0]); i ++ ) {
+        cl_distance_managers( cl, cl_moving_pairs[i][0], cl_moving_pairs[i][1], &data );
+    }
+
+    return data.min;
+}
+
 AA_API void
 aa_rx_sg_get_collision(const struct aa_rx_sg* scene_graph, size_t n_q_arg, const double* q, struct aa_rx_cl_set* cl_set)
 {
@@ -446,18 +1183,19 @@ aa_rx_sg_get_collision(const struct aa_rx_sg* scene_graph, size_t n_q_arg, const
     aa_rx_cl_destroy(cl);
 }
 
+static void allow_config_pair( void *cx, aa_rx_frame_id i, aa_rx_frame_id j )
+{
+    if( i != j ) {
+        aa_rx_sg_allow_collision( (struct aa_rx_sg*)cx, i, j, 1 );
+    }
+}
+
 AA_API void aa_rx_sg_allow_config( struct aa_rx_sg* scene_graph, size_t n_q, const double* q)
 {
     struct aa_rx_cl_set* allowed = aa_rx_cl_set_create(scene_graph);
     aa_rx_sg_get_collision(scene_graph, n_q, q, allowed);
 
-    for (size_t i = 0; i<aa_rx_sg_frame_count(scene_graph); i++){
-        for (size_t j=0; j<i; j++){
-            if (aa_rx_cl_set_get(allowed, i, j)) {
-                aa_rx_sg_allow_collision(scene_graph, i, j, 1);
-            }
-        }
-    }
+    aa_rx_cl_set_map( allowed, allow_config_pair, scene_graph );
 
     aa_rx_cl_set_destroy(allowed);
 
@@ -44,11 +44,12 @@
 #include "amino/rx/scene_geom.h"
 #include "amino/rx/scene_collision.h"
 
-// TODO: packed storage for the triangular bit vector
-
+/* Packed lower triangle, including the diagonal: pair (i,j) with
+ * j <= i is bit i*(i+1)/2 + j. */
 struct aa_rx_cl_set {
     size_t n;
-    std::vector<bool> *v;
+    size_t n_bits;
+    aa_bits *bits;
 };
 
 AA_API struct aa_rx_cl_set*
@@ -57,7 +58,8 @@ aa_rx_cl_set_create( const struct aa_rx_sg *sg )
     struct aa_rx_cl_set *set = AA_NEW(struct aa_rx_cl_set);
 
     set->n = aa_rx_sg_frame_count(sg);
-    set->v = new std::vector<bool>(set->n*set->n);
+    set->n_bits = set->n*(set->n+1)/2;
+    set->bits = AA_NEW0_AR( aa_bits, AA_MAX(aa_bits_words(set->n_bits), 1) );
 
     return set;
 }
@@ -65,7 +67,7 @@ aa_rx_cl_set_create( const struct aa_rx_sg *sg )
 AA_API void
 aa_rx_cl_set_destroy(struct aa_rx_cl_set *cl_set)
 {
-    delete cl_set->v;
+    free(cl_set->bits);
     free(cl_set);
 }
 
@@ -80,30 +82,29 @@ static inline size_t cl_set_i(
     size_t j = (size_t)jj;
 
     size_t r = (i < j) ?
-        (set->n*j + i) :
-        (set->n*i + j);
+        (j*(j+1)/2 + i) :
+        (i*(i+1)/2 + j);
 
-    assert( r < set->v->size() );
+    assert( r < set->n_bits );
+    (void)set;
     return r;
 }
 
-#define CLSET_REF(set,i,j) ( (*(set)->v)[ cl_set_i(set,i,j) ] )
-
 AA_API void
 aa_rx_cl_set_set( struct aa_rx_cl_set *cl_set,
                   aa_rx_frame_id i,
                   aa_rx_frame_id j,
                   int is_colliding )
 {
-    CLSET_REF(cl_set, i, j) = is_colliding ? 1 : 0;
+    aa_bits_set( cl_set->bits, cl_set_i(cl_set, i, j), is_colliding );
 }
 
 AA_API void
 aa_rx_cl_set_fill( struct aa_rx_cl_set *dst,
                    const struct aa_rx_cl_set *src )
 {
-    dst->v->assign( src->v->begin(),
-                    src->v->end() );
+    assert( dst->n == src->n );
+    AA_MEM_CPY( dst->bits, src->bits, aa_bits_words(src->n_bits) );
 }
 
 AA_API int
@@ -111,7 +112,7 @@ aa_rx_cl_set_get( const struct aa_rx_cl_set *cl_set,
                   aa_rx_frame_id i,
                   aa_rx_frame_id j )
 {
-    return (*cl_set->v)[ cl_set_i(cl_set,i,j) ];
+    return aa_bits_get( cl_set->bits, cl_set_i(cl_set,i,j) );
 }
 
 AA_API void
@@ -127,14 +128,61 @@ aa_rx_sg_cl_set_copy(const struct aa_rx_sg* sg, struct aa_rx_cl_set * set){
 
 AA_API void
 aa_rx_cl_set_merge(struct aa_rx_cl_set* into, const struct aa_rx_cl_set* from){
-    aa_rx_frame_id n_f = (aa_rx_frame_id)into->n;
-    assert(n_f == (aa_rx_frame_id)from->n);
+    assert( into->n == from->n );
+    aa_bits_or( into->bits, from->bits, into->n_bits );
+}
+
+AA_API void
+aa_rx_cl_set_intersect(struct aa_rx_cl_set* into, const struct aa_rx_cl_set* from){
+    assert( into->n == from->n );
+    aa_bits_and( into->bits, from->bits, into->n_bits );
+}
 
-    for (aa_rx_frame_id i = 0; i<n_f; i++){
-        for (aa_rx_frame_id j=0; j<i; j++){
-            if (aa_rx_cl_set_get(from, i, j)) {
-                aa_rx_cl_set_set(into, i, j, 1);
+AA_API void
+aa_rx_cl_set_symdiff(struct aa_rx_cl_set* into, const struct aa_rx_cl_set* from){
+    assert( into->n == from->n );
+    aa_bits_xor( into->bits, from->bits, into->n_bits );
+}
+
+AA_API void
+aa_rx_cl_set_clear( struct aa_rx_cl_set *cl_set )
+{
+    AA_MEM_ZERO( cl_set->bits, aa_bits_words(cl_set->n_bits) );
+}
+
+AA_API size_t
+aa_rx_cl_set_count( const struct aa_rx_cl_set *cl_set )
+{
+    return aa_bits_count( cl_set->bits, cl_set->n_bits );
+}
+
+static inline size_t
+cl_set_ctz( unsigned x )
+{
+#ifdef __GNUC__
+    return (size_t)__builtin_ctz(x);
+#else
+    size_t k = 0;
+    while( !(x & 1u) ) { x >>= 1; k++; }
+    return k;
+#endif
+}
+
+AA_API void
+aa_rx_cl_set_map( const struct aa_rx_cl_set *cl_set,
+                  aa_rx_cl_set_fun *fun, void *cx )
+{
+    /* Row i starts at bit i*(i+1)/2 */
+    size_t i = 0, row = 0;
+    size_t n_words = aa_bits_words(cl_set->n_bits);
+    for( size_t w = 0; w < n_words; w ++ ) {
+        for( unsigned x = (unsigned)cl_set->bits[w]; x; x &= x-1 ) {
+            size_t b = w*AA_BITS_BITS + cl_set_ctz(x);
+            while( b >= row + i + 1 ) {
+                row += i + 1;
+                i++;
             }
+            fun( cx, (aa_rx_frame_id)i, (aa_rx_frame_id)(b - row) );
         }
     }
 }
@@ -0,0 +1,378 @@
+/* -*- mode: C++; c-basic-offset: 4; -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2015, Rice University
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@rice.edu>
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of copyright holder the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "amino.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/rxerr.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_kin.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_kin_internal.h"
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace amino {
+
+/** Cell of the pose space: quantized translation and rotation vector */
+struct IKCacheKey {
+    int k[6];
+
+    bool operator==( const IKCacheKey &other ) const {
+        return std::equal( k, k+6, other.k );
+    }
+};
+
+struct IKCacheKeyHash {
+    size_t operator()( const IKCacheKey &key ) const {
+        size_t h = 0;
+        for( size_t i = 0; i < 6; i ++ ) {
+            h = h*1000003u ^ (size_t)(unsigned)key.k[i];
+        }
+        return h;
+    }
+};
+
+/** A converged solution and its goal pose */
+struct IKCacheEntry {
+    double E[7];
+    std::vector<double> q;
+};
+
+}
+
+/* Solutions kept per cell; the oldest is replaced */
+#define IK_CACHE_CELL_MAX 4
+
+static const char ik_cache_magic[8] = {'a','a','r','x','i','k','c','1'};
+
+struct aa_rx_ik_cache {
+    aa_rx_ik_cache( size_t n_q_, double cell_trans_, double cell_angle_ ) :
+        n_q(n_q_), cell_trans(cell_trans_), cell_angle(cell_angle_), count(0)
+    {}
+
+    amino::IKCacheKey key( const double E[7], const double rv[3] ) const;
+
+    amino::IKCacheKey key( const double E[7] ) const;
+
+    /** Keys of the cells equivalent to the cell of E, returns the count */
+    size_t keys( const double E[7], amino::IKCacheKey k[2] ) const;
+
+    /** Distance between poses, in units of cells */
+    double distance( const double E0[7], const double E1[7] ) const;
+
+    void insert( const double E[7], const double *q );
+
+    size_t n_q;
+    double cell_trans;
+    double cell_angle;
+    size_t count;
+
+    std::unordered_map<amino::IKCacheKey, std::vector<amino::IKCacheEntry>,
+                       amino::IKCacheKeyHash> cells;
+    std::mutex mutex;
+};
+
+static void
+ik_cache_rotvec( const double *q, double *rv )
+{
+    double qm[4];
+    AA_MEM_CPY( qm, q, 4 );
+    aa_tf_qminimize( qm );
+    aa_tf_quat2rotvec( qm, rv );
+}
+
+amino::IKCacheKey
+aa_rx_ik_cache::key( const double E[7], const double rv[3] ) const
+{
+    amino::IKCacheKey key;
+    for( size_t i = 0; i < 3; i ++ ) {
+        key.k[i] = (int)floor( E[AA_TF_QUTR_T+i] / cell_trans );
+        key.k[3+i] = (int)floor( rv[i] / cell_angle );
+    }
+    return key;
+}
+
+amino::IKCacheKey
+aa_rx_ik_cache::key( const double E[7] ) const
+{
+    double rv[3];
+    ik_cache_rotvec( E+AA_TF_QUTR_Q, rv );
+    return key( E, rv );
+}
+
+size_t
+aa_rx_ik_cache::keys( const double E[7], amino::IKCacheKey k[2] ) const
+{
+    double rv[3];
+    ik_cache_rotvec( E+AA_TF_QUTR_Q, rv );
+    k[0] = key( E, rv );
+
+    /* Near pi, the same rotations also have rotation vectors of the
+     * opposite direction */
+    double theta = aa_la_norm( 3, rv );
+    if( theta > 0 && theta > M_PI - cell_angle ) {
+        double rv_alt[3];
+        for( size_t i = 0; i < 3; i ++ ) {
+            rv_alt[i] = rv[i] * (theta - 2*M_PI) / theta;
+        }
+        k[1] = key( E, rv_alt );
+        return 2;
+    }
+    return 1;
+}
+
+double
+aa_rx_ik_cache::distance( const double E0[7], const double E1[7] ) const
+{
+    double q_rel[4], rv[3];
+    aa_tf_qcmul( E0+AA_TF_QUTR_Q, E1+AA_TF_QUTR_Q, q_rel );
+    ik_cache_rotvec( q_rel, rv );
+    return sqrt( aa_la_ssd(3, E0+AA_TF_QUTR_T, E1+AA_TF_QUTR_T) ) / cell_trans
+        + aa_la_norm(3, rv) / cell_angle;
+}
+
+void
+aa_rx_ik_cache::insert( const double E[7], const double *q )
+{
+    std::vector<amino::IKCacheEntry> &cell = cells[key(E)];
+
+    /* Skip duplicates */
+    for( const amino::IKCacheEntry &e : cell ) {
+        if( aa_la_ssd(n_q, q, e.q.data()) < 1e-6 ) return;
+    }
+
+    if( cell.size() >= IK_CACHE_CELL_MAX ) {
+        cell.erase( cell.begin() );
+        count--;
+    }
+    amino::IKCacheEntry e;
+    AA_MEM_CPY( e.E, E, 7 );
+    e.q.assign( q, q + n_q );
+    cell.push_back( e );
+    count++;
+}
+
+AA_API struct aa_rx_ik_cache *
+aa_rx_ik_cache_create( size_t n_q, double cell_trans, double cell_angle )
+{
+    return new aa_rx_ik_cache( n_q, cell_trans, cell_angle );
+}
+
+AA_API void
+aa_rx_ik_cache_destroy( struct aa_rx_ik_cache *cache )
+{
+    delete cache;
+}
+
+AA_API size_t
+aa_rx_ik_cache_size( struct aa_rx_ik_cache *cache )
+{
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    return cache->count;
+}
+
+AA_API void
+aa_rx_ik_cache_insert( struct aa_rx_ik_cache *cache,
+                       const double E[7], size_t n_q, const double *q )
+{
+    assert( n_q == cache->n_q );
+    (void)n_q;
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->insert( E, q );
+}
+
+AA_API size_t
+aa_rx_ik_cache_lookup( struct aa_rx_ik_cache *cache, const double E[7],
+                       size_t n_max,
+                       size_t n_q, double *Q, size_t ld_Q )
+{
+    assert( n_q == cache->n_q );
+    std::vector< std::pair<double, const amino::IKCacheEntry *> > near;
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    /* The goal's cell and its neighbors in translation and rotation */
+    amino::IKCacheKey k0[2];
+    size_t n_k0 = cache->keys(E, k0);
+    for( size_t j = 0; j < n_k0; j ++ ) {
+        for( int d = 0; d < 729; d ++ ) {
+            amino::IKCacheKey k = k0[j];
+            for( int i = 0, r = d; i < 6; i ++, r /= 3 ) {
+                k.k[i] += r % 3 - 1;
+            }
+            auto itr = cache->cells.find(k);
+            if( cache->cells.end() == itr ) continue;
+            for( const amino::IKCacheEntry &e : itr->second ) {
+                near.push_back( std::make_pair(cache->distance(E, e.E), &e) );
+            }
+        }
+    }
+
+    /* Nearest first; the neighborhoods around pi may overlap */
+    std::sort( near.begin(), near.end() );
+    near.erase( std::unique( near.begin(), near.end() ), near.end() );
+
+    size_t n = std::min( n_max, near.size() );
+    for( size_t j = 0; j < n; j ++ ) {
+        AA_MEM_CPY( Q + j*ld_Q, near[j].second->q.data(), n_q );
+    }
+
+    return n;
+}
+
+AA_API int
+aa_rx_ik_cache_save( struct aa_rx_ik_cache *cache, const char *filename )
+{
+    FILE *f = fopen( filename, "wb" );
+    if( NULL == f ) return -1;
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    uint64_t header[2] = { cache->n_q, cache->count };
+    double cell[2] = { cache->cell_trans, cache->cell_angle };
+    bool ok =
+        1 == fwrite( ik_cache_magic, sizeof(ik_cache_magic), 1, f ) &&
+        1 == fwrite( header, sizeof(header), 1, f ) &&
+        1 == fwrite( cell, sizeof(cell), 1, f );
+    for( auto itr = cache->cells.begin(); ok && itr != cache->cells.end(); itr++ ) {
+        for( const amino::IKCacheEntry &e : itr->second ) {
+            ok = ok &&
+                1 == fwrite( e.E, sizeof(e.E), 1, f ) &&
+                cache->n_q == fwrite( e.q.data(), sizeof(double), cache->n_q, f );
+        }
+    }
+
+    return (0 == fclose(f) && ok) ? 0 : -1;
+}
+
+AA_API struct aa_rx_ik_cache *
+aa_rx_ik_cache_load( const char *filename )
+{
+    FILE *f = fopen( filename, "rb" );
+    if( NULL == f ) return NULL;
+
+    char magic[sizeof(ik_cache_magic)];
+    uint64_t header[2];
+    double cell[2];
+    struct aa_rx_ik_cache *cache = NULL;
+    if( 1 == fread( magic, sizeof(magic), 1, f ) &&
+        0 == memcmp( magic, ik_cache_magic, sizeof(magic) ) &&
+        1 == fread( header, sizeof(header), 1, f ) &&
+        1 == fread( cell, sizeof(cell), 1, f ) )
+    {
+        size_t n_q = (size_t)header[0];
+        cache = new aa_rx_ik_cache( n_q, cell[0], cell[1] );
+        std::vector<double> q(n_q);
+        for( uint64_t i = 0; i < header[1]; i ++ ) {
+            double E[7];
+            if( 1 != fread( E, sizeof(E), 1, f ) ||
+                n_q != fread( q.data(), sizeof(double), n_q, f ) )
+            {
+                delete cache;
+                cache = NULL;
+                break;
+            }
+            cache->insert( E, q.data() );
+        }
+    }
+
+    fclose(f);
+    return cache;
+}
+
+AA_API size_t
+aa_rx_ik_cache_precompute( struct aa_rx_ik_cache *cache,
+                           const struct aa_rx_sg_sub *ssg, aa_rx_frame_id frame,
+                           size_t n_all, const double *q_all,
+                           size_t n_samples )
+{
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    size_t n_q = aa_rx_sg_sub_config_count(ssg);
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    assert( n_q == cache->n_q );
+    assert( n_all == aa_rx_sg_config_count(sg) );
+    if( 0 == aa_rx_sg_sub_frame_count(ssg) ) return 0;
+    if( AA_RX_FRAME_NONE == frame ) {
+        frame = aa_rx_sg_sub_frame( ssg, aa_rx_sg_sub_frame_count(ssg) - 1 );
+    }
+
+    std::vector<double> q(n_all), q_s(n_q), TF(14*n_f);
+    double *TF_rel = TF.data(), *TF_abs = TF.data() + 7*n_f;
+    aa_rx_frame_id root = aa_rx_sg_frame_parent( sg, aa_rx_sg_sub_frame(ssg, 0) );
+    std::copy( q_all, q_all + n_all, q.begin() );
+
+    size_t n0 = aa_rx_ik_cache_size(cache);
+    for( size_t k = 0; k < n_samples; k ++ ) {
+        /* Uniform within the joint limits */
+        for( size_t i = 0; i < n_q; i ++ ) {
+            double min, max;
+            if( aa_rx_sg_get_limit_pos(sg, aa_rx_sg_sub_config(ssg, i), &min, &max) ) {
+                min = -M_PI;
+                max = M_PI;
+            }
+            q_s[i] = min + (max - min) * aa_frand();
+        }
+        aa_rx_sg_sub_config_set( ssg, n_q, q_s.data(), n_all, q.data() );
+        aa_rx_sg_tf( sg, n_all, q.data(), n_f, TF_rel, 7, TF_abs, 7 );
+
+        /* Relative to the root, which q_all places */
+        double E[7];
+        if( root >= 0 ) {
+            aa_tf_qutr_cmul( TF_abs + 7*(size_t)root, TF_abs + 7*(size_t)frame, E );
+        } else {
+            AA_MEM_CPY( E, TF_abs + 7*(size_t)frame, 7 );
+        }
+        aa_rx_ik_cache_insert( cache, E, n_q, q_s.data() );
+    }
+
+    return aa_rx_ik_cache_size(cache) - n0;
+}
+
+AA_API void
+aa_rx_sg_sub_set_ik_cache( struct aa_rx_sg_sub *ssg, struct aa_rx_ik_cache *cache )
+{
+    ssg->ik_cache = cache;
+}
+
+AA_API struct aa_rx_ik_cache *
+aa_rx_sg_sub_get_ik_cache( const struct aa_rx_sg_sub *ssg )
+{
+    return ssg->ik_cache;
+}
@@ -56,69 +56,648 @@
 typedef int (*rfx_kin_duqu_fun) ( const void *cx, const double *q, double S[8],  double *J);
 
 
+/*
+ * Workspace for the Jacobian IK solvers, allocated when the context is
+ * created so that repeated solves do not allocate.
+ *
+ * Sub-scenegraph frames are in preorder, so the parent of each frame is
+ * either an earlier sub-scenegraph frame or a frame outside the
+ * sub-scenegraph, which stays fixed during a solve.  Each evaluation
+ * walks only the sub-scenegraph frames, starting from the fixed
+ * transforms of those outside parents.
+ */
+struct kin_solve_work {
+    size_t n;           ///< sub-scenegraph configurations
+    size_t n_all;       ///< scenegraph configurations
+    size_t n_c;         ///< sub-scenegraph frames
+
+    const aa_rx_frame_id *frames; ///< sub-scenegraph frames, preorder
+    size_t *parent;     ///< index of each frame's parent, or SIZE_MAX if outside
+    size_t *sub_end;    ///< one past the last descendant of each frame
+    size_t *col_frame;  ///< frame index of each Jacobian column, n
+    double *E_base;     ///< absolute transforms of outside parents, 7*n_c
+    double *E_sub;      ///< absolute frame transforms, 7*n_c
+
+    double *q_all;      ///< current full configuration, n_all
+    double *q0_sub;     ///< seed sub-configuration, n
+    double *dqnull;     ///< nullspace velocity, n
+    double *q_trial;    ///< Levenberg-Marquardt trial configuration, n
+    double *dq;         ///< Levenberg-Marquardt step, n
+    double *axis;       ///< joint axes in the global frame, 3*n
+    double *origin;     ///< joint origins in the global frame, 3*n
+    double *P;          ///< nullspace projector, n*n
+    double *Vt;         ///< SVD right singular vectors, n*n
+    double *data;
+
+    /* Targets, sized for up to n_e_max targets */
+    size_t n_e;         ///< number of targets
+    size_t n_e_max;
+    size_t m;           ///< rows of the stacked Jacobian, 6*n_e
+    size_t *ee_anchor;  ///< frame index each target follows, or SIZE_MAX
+    double *E_ee_off;   ///< targets relative to their anchors, 7*n_e
+    double *E_ee;       ///< current target frame transforms, 7*n_e
+    double *S_ref;      ///< desired target poses, 8*n_e
+    double *S_cur;      ///< target poses at the current configuration, 8*n_e
+    double *S_trial;    ///< Levenberg-Marquardt trial target poses, 8*n_e
+    double *weight;     ///< target weights, n_e
+
+    double *J;          ///< stacked Jacobian, m*n
+    double *J_star;     ///< damped pseudoinverse, n*m
+    double *J_trial;    ///< Levenberg-Marquardt trial Jacobian, m*n
+    double *A;          ///< copy of J for factorizations, m*n
+    double *B;          ///< J*J^T + kI, m*m
+    double *U;          ///< SVD left singular vectors, m*m
+    double *S;          ///< SVD singular values, min(m,n)
+    double *e;          ///< weighted error, m
+    double *e_trial;    ///< Levenberg-Marquardt trial error, m
+    double *svd_work;
+    int svd_lwork;
+    int *svd_iwork;
+    double *data_e;
+};
+
 struct kin_solve_cx {
     size_t n;
     const struct aa_rx_ksol_opts *opts;
     const struct aa_rx_sg_sub *ssg;
-    const double *S1;
     const double *dq_dt;
 
     size_t iteration;
 
-    struct aa_mem_region *reg;
+    struct kin_solve_work *work;
 
     const double *q0_all;
     size_t n_all;
-    double *TF_rel0;
-    double *TF_abs0;
 };
 
 
-static int ksol_duqu ( const struct kin_solve_cx *cx, const double *q_s, double S[8],  double *J)
+/* Size the target workspace for n_e targets.  Only allocates when n_e
+ * exceeds any previous target count. */
+static void
+kin_solve_work_reserve( struct kin_solve_work *w, size_t n_e )
+{
+    if( w->data_e && n_e <= w->n_e_max ) return;
+
+    free( w->data_e );
+    free( w->svd_iwork );
+    free( w->ee_anchor );
+
+    size_t n = w->n;
+    size_t m = 6*n_e;
+    size_t mn = AA_MIN(m,n);
+
+    /* Query SVD workspace size */
+    {
+        double qwork;
+        int iwork;
+        aa_cla_dgesdd( 'A', (int)m, (int)n,
+                       NULL, (int)m, NULL,
+                       NULL, (int)m, NULL, (int)AA_MAX(n,1),
+                       &qwork, -1, &iwork );
+        w->svd_lwork = (int)qwork;
+    }
+
+    size_t n_data = 7*n_e + 7*n_e + 3*8*n_e + n_e
+        + 4*m*n + 2*m*m + mn + 2*m
+        + (size_t)w->svd_lwork;
+    double *d = w->data_e = AA_NEW0_AR( double, n_data );
+    w->E_ee_off = d;   d += 7*n_e;
+    w->E_ee = d;       d += 7*n_e;
+    w->S_ref = d;      d += 8*n_e;
+    w->S_cur = d;      d += 8*n_e;
+    w->S_trial = d;    d += 8*n_e;
+    w->weight = d;     d += n_e;
+    w->J = d;          d += m*n;
+    w->J_star = d;     d += m*n;
+    w->J_trial = d;    d += m*n;
+    w->A = d;          d += m*n;
+    w->B = d;          d += m*m;
+    w->U = d;          d += m*m;
+    w->S = d;          d += mn;
+    w->e = d;          d += m;
+    w->e_trial = d;    d += m;
+    w->svd_work = d;   d += (size_t)w->svd_lwork;
+    assert( d == w->data_e + n_data );
+
+    w->svd_iwork = AA_NEW_AR( int, 8*AA_MAX(mn,1) );
+    w->ee_anchor = AA_NEW_AR( size_t, n_e );
+    w->n_e_max = n_e;
+}
+
+static void
+kin_solve_work_init( struct kin_solve_work *w, const struct aa_rx_sg_sub *ssg )
+{
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    size_t n = aa_rx_sg_sub_config_count(ssg);
+    size_t n_c = aa_rx_sg_sub_frame_count(ssg);
+    w->n = n;
+    w->n_all = aa_rx_sg_config_count(sg);
+    w->n_c = n_c;
+    w->frames = ssg->frames;
+    assert( n_c > 0 );
+
+    /* Frame structure */
+    w->parent = AA_NEW_AR( size_t, 2*n_c + n );
+    w->sub_end = w->parent + n_c;
+    w->col_frame = w->sub_end + n_c;
+    size_t j = 0;
+    for( size_t i = 0; i < n_c; i ++ ) {
+        aa_rx_frame_id p = aa_rx_sg_frame_parent( sg, w->frames[i] );
+        w->parent[i] = SIZE_MAX;
+        for( size_t k = i; k > 0; k -- ) {
+            if( w->frames[k-1] == p ) {
+                w->parent[i] = k-1;
+                break;
+            }
+        }
+        w->sub_end[i] = i+1;
+        if( AA_RX_FRAME_FIXED != aa_rx_sg_frame_type(sg, w->frames[i]) ) {
+            assert( j < n );
+            w->col_frame[j++] = i;
+        }
+    }
+    assert( j == n );
+    for( size_t i = n_c; i > 0; i -- ) {
+        size_t p = w->parent[i-1];
+        if( SIZE_MAX != p ) {
+            w->sub_end[p] = AA_MAX( w->sub_end[p], w->sub_end[i-1] );
+        }
+    }
+
+    size_t n_data = 2*7*n_c + w->n_all
+        + 4*n + 2*3*n + 2*n*n;
+    double *d = w->data = AA_NEW0_AR( double, n_data );
+    w->E_base = d;     d += 7*n_c;
+    w->E_sub = d;      d += 7*n_c;
+    w->q_all = d;      d += w->n_all;
+    w->q0_sub = d;     d += n;
+    w->dqnull = d;     d += n;
+    w->q_trial = d;    d += n;
+    w->dq = d;         d += n;
+    w->axis = d;       d += 3*n;
+    w->origin = d;     d += 3*n;
+    w->P = d;          d += n*n;
+    w->Vt = d;         d += n*n;
+    assert( d == w->data + n_data );
+
+    /* Preallocate for one target per leaf */
+    size_t n_leaves = 0;
+    for( size_t i = 0; i < n_c; i ++ ) {
+        if( w->sub_end[i] == i+1 ) n_leaves++;
+    }
+    kin_solve_work_reserve( w, AA_MAX(n_leaves,(size_t)1) );
+}
+
+static void
+kin_solve_work_destroy( struct kin_solve_work *w )
+{
+    free( w->data );
+    free( w->data_e );
+    free( w->parent );
+    free( w->ee_anchor );
+    free( w->svd_iwork );
+}
+
+/* Damped pseudoinverse J^* := J^T (JJ^T + kI)^{-1} via Cholesky.
+ *
+ * When s2_lb is non-NULL, it receives a lower bound on the smallest
+ * eigenvalue of JJ^T + kI, 1/||L^{-1}||_F^2.  Returns nonzero if the
+ * factorization fails. */
+static int
+ksol_chol_pinv( size_t m, size_t n, const double *J, double k,
+                double *L, double *J_star, double *s2_lb )
+{
+    // L := lower(JJ^T + kI)
+    for( size_t j = 0; j < m; j ++ ) {
+        for( size_t i = j; i < m; i ++ ) {
+            double x = 0;
+            for( size_t c = 0; c < n; c ++ ) x += J[i + c*m] * J[j + c*m];
+            L[i + j*m] = x;
+        }
+        L[j + j*m] += k;
+    }
+
+    // L L^T := JJ^T + kI
+    for( size_t j = 0; j < m; j ++ ) {
+        double d = L[j + j*m];
+        for( size_t p = 0; p < j; p ++ ) d -= L[j + p*m] * L[j + p*m];
+        if( !(d > 0) ) return -1;
+        double ljj = sqrt(d);
+        L[j + j*m] = ljj;
+        for( size_t i = j+1; i < m; i ++ ) {
+            double x = L[i + j*m];
+            for( size_t p = 0; p < j; p ++ ) x -= L[i + p*m] * L[j + p*m];
+            L[i + j*m] = x / ljj;
+        }
+    }
+
+    // J^* := (L^{-T} L^{-1} J)^T, one column of J at a time
+    for( size_t c = 0; c < n; c ++ ) {
+        double x[m];
+        for( size_t i = 0; i < m; i ++ ) {
+            double y = J[i + c*m];
+            for( size_t p = 0; p < i; p ++ ) y -= L[i + p*m] * x[p];
+            x[i] = y / L[i + i*m];
+        }
+        for( size_t i = m; i > 0; i -- ) {
+            double y = x[i-1];
+            for( size_t p = i; p < m; p ++ ) y -= L[p + (i-1)*m] * x[p];
+            x[i-1] = y / L[(i-1) + (i-1)*m];
+        }
+        for( size_t i = 0; i < m; i ++ ) J_star[c + i*n] = x[i];
+    }
+
+    // ||(LL^T)^{-1}||_2 <= ||L^{-1}||_F^2
+    if( s2_lb ) {
+        double f = 0;
+        for( size_t j = 0; j < m; j ++ ) {
+            double x[m];
+            for( size_t i = j; i < m; i ++ ) {
+                double y = (i == j) ? 1 : 0;
+                for( size_t p = j; p < i; p ++ ) y -= L[i + p*m] * x[p];
+                x[i] = y / L[i + i*m];
+                f += x[i]*x[i];
+            }
+        }
+        *s2_lb = 1 / f;
+    }
+
+    return 0;
+}
+
+/* Solve L y = b in place, for L the packed lower triangle of a 6x6
+ * Cholesky factor and r the reciprocals of its diagonal. */
+static inline void
+ksol_chol6_fwd( const double L[21], const double r[6], double y[6] )
+{
+    y[0] = y[0] * r[0];
+    y[1] = (y[1] - L[1]*y[0]) * r[1];
+    y[2] = (y[2] - L[3]*y[0] - L[4]*y[1]) * r[2];
+    y[3] = (y[3] - L[6]*y[0] - L[7]*y[1] - L[8]*y[2]) * r[3];
+    y[4] = (y[4] - L[10]*y[0] - L[11]*y[1] - L[12]*y[2] - L[13]*y[3]) * r[4];
+    y[5] = (y[5] - L[15]*y[0] - L[16]*y[1] - L[17]*y[2] - L[18]*y[3] - L[19]*y[4]) * r[5];
+}
+
+/* Solve L^T x = y in place, as ksol_chol6_fwd() */
+static inline void
+ksol_chol6_back( const double L[21], const double r[6], double x[6] )
+{
+    x[5] = x[5] * r[5];
+    x[4] = (x[4] - L[19]*x[5]) * r[4];
+    x[3] = (x[3] - L[13]*x[4] - L[18]*x[5]) * r[3];
+    x[2] = (x[2] - L[8]*x[3] - L[12]*x[4] - L[17]*x[5]) * r[2];
+    x[1] = (x[1] - L[4]*x[2] - L[7]*x[3] - L[11]*x[4] - L[16]*x[5]) * r[1];
+    x[0] = (x[0] - L[1]*x[1] - L[3]*x[2] - L[6]*x[3] - L[10]*x[4] - L[15]*x[5]) * r[0];
+}
+
+/* Unrolled ksol_chol_pinv() for a single target, m = 6.
+ *
+ * JJ^T + kI and its factor are packed by rows, L[i(i+1)/2 + j] for
+ * i >= j, and stay on the stack. */
+static int
+ksol_chol_pinv6( size_t n, const double *J, double k,
+                 double *J_star, double *s2_lb )
+{
+    // L := lower(JJ^T + kI), one column of J at a time
+    double L[21] = {0};
+    for( size_t c = 0; c < n; c ++ ) {
+        const double *x = J + 6*c;
+        double x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3], x4 = x[4], x5 = x[5];
+        L[0] += x0*x0;
+        L[1] += x1*x0;  L[2] += x1*x1;
+        L[3] += x2*x0;  L[4] += x2*x1;  L[5] += x2*x2;
+        L[6] += x3*x0;  L[7] += x3*x1;  L[8] += x3*x2;  L[9] += x3*x3;
+        L[10] += x4*x0; L[11] += x4*x1; L[12] += x4*x2; L[13] += x4*x3; L[14] += x4*x4;
+        L[15] += x5*x0; L[16] += x5*x1; L[17] += x5*x2; L[18] += x5*x3; L[19] += x5*x4;
+        L[20] += x5*x5;
+    }
+    L[0] += k; L[2] += k; L[5] += k; L[9] += k; L[14] += k; L[20] += k;
+
+    // L L^T := JJ^T + kI
+    double r[6], d;
+    d = L[0];
+    if( !(d > 0) ) return -1;
+    L[0] = sqrt(d); r[0] = 1 / L[0];
+    L[1] *= r[0]; L[3] *= r[0]; L[6] *= r[0]; L[10] *= r[0]; L[15] *= r[0];
+
+    d = L[2] - L[1]*L[1];
+    if( !(d > 0) ) return -1;
+    L[2] = sqrt(d); r[1] = 1 / L[2];
+    L[4] = (L[4] - L[3]*L[1]) * r[1];
+    L[7] = (L[7] - L[6]*L[1]) * r[1];
+    L[11] = (L[11] - L[10]*L[1]) * r[1];
+    L[16] = (L[16] - L[15]*L[1]) * r[1];
+
+    d = L[5] - L[3]*L[3] - L[4]*L[4];
+    if( !(d > 0) ) return -1;
+    L[5] = sqrt(d); r[2] = 1 / L[5];
+    L[8] = (L[8] - L[6]*L[3] - L[7]*L[4]) * r[2];
+    L[12] = (L[12] - L[10]*L[3] - L[11]*L[4]) * r[2];
+    L[17] = (L[17] - L[15]*L[3] - L[16]*L[4]) * r[2];
+
+    d = L[9] - L[6]*L[6] - L[7]*L[7] - L[8]*L[8];
+    if( !(d > 0) ) return -1;
+    L[9] = sqrt(d); r[3] = 1 / L[9];
+    L[13] = (L[13] - L[10]*L[6] - L[11]*L[7] - L[12]*L[8]) * r[3];
+    L[18] = (L[18] - L[15]*L[6] - L[16]*L[7] - L[17]*L[8]) * r[3];
+
+    d = L[14] - L[10]*L[10] - L[11]*L[11] - L[12]*L[12] - L[13]*L[13];
+    if( !(d > 0) ) return -1;
+    L[14] = sqrt(d); r[4] = 1 / L[14];
+    L[19] = (L[19] - L[15]*L[10] - L[16]*L[11] - L[17]*L[12] - L[18]*L[13]) * r[4];
+
+    d = L[20] - L[15]*L[15] - L[16]*L[16] - L[17]*L[17] - L[18]*L[18] - L[19]*L[19];
+    if( !(d > 0) ) return -1;
+    L[20] = sqrt(d); r[5] = 1 / L[20];
+
+    // J^* := (L^{-T} L^{-1} J)^T, one column of J at a time
+    for( size_t c = 0; c < n; c ++ ) {
+        double x[6];
+        AA_MEM_CPY( x, J + 6*c, 6 );
+        ksol_chol6_fwd( L, r, x );
+        ksol_chol6_back( L, r, x );
+        for( size_t i = 0; i < 6; i ++ ) J_star[c + i*n] = x[i];
+    }
+
+    // ||(LL^T)^{-1}||_2 <= ||L^{-1}||_F^2
+    if( s2_lb ) {
+        double f = 0;
+        for( size_t j = 0; j < 6; j ++ ) {
+            double x[6] = {0};
+            x[j] = 1;
+            ksol_chol6_fwd( L, r, x );
+            for( size_t i = j; i < 6; i ++ ) f += x[i]*x[i];
+        }
+        *s2_lb = 1 / f;
+    }
+
+    return 0;
+}
+
+/* Largest column count for the single-target kernel */
+#define KSOL_SMALL_N 8
+
+/* Damped pseudoinverse, as aa_la_dpinv() */
+static void
+ksol_dpinv( struct kin_solve_work *w, double k, const double *J, double *J_star )
+{
+    if( 6 == w->m && w->n <= KSOL_SMALL_N &&
+        0 == ksol_chol_pinv6( w->n, J, k, J_star, NULL ) )
+    {
+        return;
+    }
+
+    // J^* := J^T (JJ^T + kI)^{-1}
+    int n = (int)w->n;
+    int m = (int)w->m;
+    AA_MEM_CPY( w->A, J, w->m*w->n );
+
+    cblas_dsyrk( CblasColMajor, CblasUpper, CblasNoTrans,
+                 m, n,
+                 1, w->A, m,
+                 0, w->B, m );
+    for( size_t i = 0; i < w->m; i ++ ) AA_MATREF(w->B, w->m, i, i) += k;
+
+    aa_cla_dposv( 'U', m, n,
+                  w->B, m,
+                  w->A, m );
+
+    aa_la_d_transpose( w->m, w->n, w->A, w->m, J_star, w->n );
+}
+
+/* Deadzone damped pseudoinverse, as aa_la_dzdpinv() */
+static void
+ksol_dzdpinv( struct kin_solve_work *w, double s2_min, const double *J, double *J_star )
+{
+    /* Away from singularities, every s_i^2 >= s2_min, so the deadzone is
+     * inactive and J^* is the undamped pseudoinverse */
+    double s2_lb;
+    int r = ( 6 == w->m && w->n <= KSOL_SMALL_N )
+        ? ksol_chol_pinv6( w->n, J, 0, J_star, &s2_lb )
+        : ksol_chol_pinv( w->m, w->n, J, 0, w->B, J_star, &s2_lb );
+    if( 0 == r && s2_lb >= s2_min ) return;
+
+    int n = (int)w->n;
+    int m = (int)w->m;
+    AA_MEM_CPY( w->A, J, w->m*w->n );
+
+    // J = U S V^T
+    aa_cla_dgesdd( 'A', m, n,
+                   w->A, m, w->S,
+                   w->U, m, w->Vt, n,
+                   w->svd_work, w->svd_lwork, w->svd_iwork );
+
+    AA_MEM_ZERO( J_star, w->m*w->n );
+    // \sum s_i/(s_i**2+k) * v_i * u_i^T
+    for( size_t i = 0; i < AA_MIN(w->m,w->n); i ++ ) {
+        double s2 = AA_MAX( (w->S[i]*w->S[i]), s2_min );
+        cblas_dger( CblasColMajor, n, m, w->S[i] / s2,
+                    w->Vt + i, n,
+                    w->U + w->m*i, 1,
+                    J_star, n );
+    }
+}
+
+/* Least-squares with nullspace projection, as aa_la_xlsnp() */
+static void
+ksol_xlsnp( struct kin_solve_work *w, const double *J, const double *J_star,
+            const double *x, const double *yp, double *y )
+{
+    int n = (int)w->n;
+    int m = (int)w->m;
+    aa_la_mvmul( w->n, w->m, J_star, x, y );
+
+    // P = J^* J - I
+    cblas_dgemm( CblasColMajor, CblasNoTrans, CblasNoTrans,
+                 n, n, m,
+                 1, J_star, n, J, m, 0, w->P, n );
+    for( size_t i = 0; i < w->n; i ++ ) AA_MATREF(w->P, w->n, i, i) -= 1;
+
+    // y = y - P yp
+    cblas_dgemv( CblasColMajor, CblasNoTrans, n, n,
+                 -1.0, w->P, n,
+                 yp, 1,
+                 1, y, 1 );
+}
+
+
+/* Transform of frame relative to ancestor, or absolute for AA_RX_FRAME_ROOT */
+static void
+ksol_walk( const struct aa_rx_sg *sg, size_t n_q, const double *q,
+           aa_rx_frame_id ancestor, aa_rx_frame_id frame, double E[7] )
+{
+    AA_MEM_CPY( E, aa_tf_qutr_ident, 7 );
+    for( ; frame != ancestor && frame >= 0; frame = aa_rx_sg_frame_parent(sg, frame) ) {
+        double E_rel[7], E_tmp[7];
+        aa_rx_sg_frame_tf_rel( sg, frame, n_q, q, E_rel );
+        aa_tf_qutr_mul( E_rel, E, E_tmp );
+        AA_MEM_CPY( E, E_tmp, 7 );
+    }
+}
+
+/* Set up the targets and the transforms of frames held fixed during a
+ * solve, i.e., all frames outside the sub-scenegraph. */
+static int
+ksol_begin( const struct kin_solve_cx *cx, size_t n_tf )
 {
     const struct aa_rx_sg_sub *ssg = cx->ssg;
     const struct aa_rx_sg *sg = ssg->scenegraph;
+    const struct aa_rx_ksol_opts *opts = cx->opts;
+    struct kin_solve_work *w = cx->work;
+
+    if( 0 == n_tf ||
+        (opts->n_frames && opts->n_frames != n_tf) ||
+        (opts->frame_weights && opts->n_frame_weights != n_tf) )
+    {
+        return AA_RX_INVALID_PARAMETER;
+    }
 
-    size_t n_f = aa_rx_sg_frame_count(sg);
-    size_t n_q = aa_rx_sg_config_count(sg);
-    size_t n_sq = aa_rx_sg_sub_config_count(ssg);
+    AA_MEM_CPY( w->q_all, cx->q0_all, w->n_all );
 
-    /* Get the configuration */
-    double q_all[n_q];
-    AA_MEM_CPY(q_all, cx->q0_all, n_q);
-    aa_rx_sg_sub_config_set( ssg,
-                             n_sq, q_s,
-                             n_q, q_all);
+    /* Outside parents */
+    for( size_t i = 0; i < w->n_c; i ++ ) {
+        if( SIZE_MAX == w->parent[i] ) {
+            ksol_walk( sg, w->n_all, w->q_all,
+                       AA_RX_FRAME_ROOT, aa_rx_sg_frame_parent(sg, w->frames[i]),
+                       w->E_base + 7*i );
+        }
+    }
+
+    /* Targets */
+    kin_solve_work_reserve( w, n_tf );
+    w->n_e = n_tf;
+    w->m = 6*n_tf;
+
+    size_t i_leaf = 0;
+    for( size_t k = 0; k < n_tf; k ++ ) {
+        aa_rx_frame_id id_ee;
+        if( opts->n_frames ) {
+            /* use specified frames */
+            id_ee = opts->frames[k];
+        } else if( 1 == n_tf ) {
+            id_ee = ( AA_RX_FRAME_NONE == opts->frame )
+                /* default to last frame in chain */
+                ? w->frames[w->n_c - 1]
+                /* use specified frame */
+                : opts->frame;
+        } else {
+            /* default to the leaves of the sub-scenegraph */
+            while( i_leaf < w->n_c && w->sub_end[i_leaf] != i_leaf+1 ) i_leaf++;
+            if( i_leaf >= w->n_c ) return AA_RX_INVALID_PARAMETER;
+            id_ee = w->frames[i_leaf++];
+        }
+
+        /* Find the nearest ancestor in the sub-scenegraph */
+        size_t anchor = SIZE_MAX;
+        for( aa_rx_frame_id f = id_ee;
+             f >= 0 && SIZE_MAX == anchor;
+             f = aa_rx_sg_frame_parent(sg, f) )
+        {
+            for( size_t i = 0; i < w->n_c; i ++ ) {
+                if( w->frames[i] == f ) {
+                    anchor = i;
+                    break;
+                }
+            }
+        }
+        w->ee_anchor[k] = anchor;
 
-    /* Compute the transforms */
-    double *TF_rel = AA_MEM_REGION_NEW_N(cx->reg, double, 7*n_f);
-    double *TF_abs = AA_MEM_REGION_NEW_N(cx->reg, double, 7*n_f);
+        ksol_walk( sg, w->n_all, w->q_all,
+                   ( SIZE_MAX == anchor ) ? AA_RX_FRAME_ROOT : w->frames[anchor],
+                   id_ee, w->E_ee_off + 7*k );
 
-    aa_rx_sg_tf_update( sg,
-                        n_q, cx->q0_all, q_all,
-                        n_f,
-                        cx->TF_rel0, 7, cx->TF_abs0, 7,
-                        TF_rel, 7, TF_abs, 7 );
+        w->weight[k] = opts->frame_weights ? opts->frame_weights[k] : 1;
+    }
 
-    /* Fill the desired transform */
-    if( S ) {
-        aa_rx_frame_id id_ee = ( AA_RX_FRAME_NONE == cx->opts->frame )
-            /* default to last frame in chain */
-            ? aa_rx_sg_sub_frame(ssg, aa_rx_sg_sub_frame_count(ssg) - 1 )
-            /* use specified frame */
-            : cx->opts->frame;
+    return 0;
+}
 
-        double *E_ee = TF_abs + 7*id_ee;
-        aa_tf_qutr2duqu( E_ee, S );
+/* Set the desired target poses */
+static void
+ksol_set_goals( struct kin_solve_work *w, const double *TF, size_t ld_TF )
+{
+    for( size_t k = 0; k < w->n_e; k ++ ) {
+        aa_tf_qutr2duqu( TF + k*ld_TF, w->S_ref + 8*k );
+    }
+}
+
+/* Forward kinematics of the sub-scenegraph, target poses, and the
+ * stacked, weighted Jacobian of all targets. */
+static int ksol_duqu ( const struct kin_solve_cx *cx, const double *q_s, double *S,  double *J)
+{
+    const struct aa_rx_sg_sub *ssg = cx->ssg;
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    struct kin_solve_work *w = cx->work;
+
+    /* Get the configuration */
+    double *q_all = w->q_all;
+    aa_rx_sg_sub_config_set( ssg,
+                             w->n, q_s,
+                             w->n_all, q_all);
+
+    /* Walk the sub-scenegraph */
+    for( size_t i = 0; i < w->n_c; i ++ ) {
+        const double *E_parent = ( SIZE_MAX == w->parent[i] )
+            ? w->E_base + 7*i
+            : w->E_sub + 7*w->parent[i];
+        double E_rel[7];
+        aa_rx_sg_frame_tf_rel( sg, w->frames[i], w->n_all, q_all, E_rel );
+        aa_tf_qutr_mul( E_parent, E_rel, w->E_sub + 7*i );
+    }
+
+    /* Targets */
+    for( size_t k = 0; k < w->n_e; k ++ ) {
+        size_t anchor = w->ee_anchor[k];
+        double *E_ee = w->E_ee + 7*k;
+        aa_tf_qutr_mul( ( SIZE_MAX == anchor )
+                        ? aa_tf_qutr_ident
+                        : w->E_sub + 7*anchor,
+                        w->E_ee_off + 7*k, E_ee );
+        if( S ) {
+            aa_tf_qutr2duqu( E_ee, S + 8*k );
+        }
     }
 
     /* Fill the Jacobian */
     if( J ) {
-        aa_rx_sg_sub_jacobian( ssg, n_f, TF_abs, 7,
-                               J, 6 );
+        /* Joint axes, shared by all targets */
+        for( size_t j = 0; j < w->n; j ++ ) {
+            size_t i = w->col_frame[j];
+            const double *E = w->E_sub + 7*i;
+            aa_tf_qrot( E+AA_TF_QUTR_Q, aa_rx_sg_frame_axis(sg, w->frames[i]),
+                        w->axis + 3*j );
+            AA_MEM_CPY( w->origin + 3*j, E+AA_TF_QUTR_T, 3 );
+        }
+
+        AA_MEM_ZERO( J, w->m*w->n );
+        for( size_t k = 0; k < w->n_e; k ++ ) {
+            size_t anchor = w->ee_anchor[k];
+            if( SIZE_MAX == anchor ) continue;
+            const double *pe = w->E_ee + 7*k + AA_TF_QUTR_T;
+            double wk = w->weight[k];
+            for( size_t j = 0; j < w->n; j ++ ) {
+                size_t i = w->col_frame[j];
+                /* Does joint i move target k? */
+                if( anchor < i || anchor >= w->sub_end[i] ) continue;
+
+                double *Jr = J + j*w->m + 6*k + AA_TF_DX_W; // rotational part
+                double *Jt = J + j*w->m + 6*k + AA_TF_DX_V; // translational part
+                const double *a = w->axis + 3*j;
+                if( AA_RX_FRAME_REVOLUTE == aa_rx_sg_frame_type(sg, w->frames[i]) ) {
+                    double tmp[3];
+                    for( size_t l = 0; l < 3; l++ ) tmp[l] = pe[l] - w->origin[3*j+l];
+                    aa_tf_cross( a, tmp, Jt );
+                    for( size_t l = 0; l < 3; l++ ) {
+                        Jr[l] = wk * a[l];
+                        Jt[l] *= wk;
+                    }
+                } else {
+                    for( size_t l = 0; l < 3; l++ ) Jt[l] = wk * a[l];
+                }
+            }
+        }
     }
 
-    aa_mem_region_pop(cx->reg, TF_rel);
     return 0;
 }
 
@@ -149,6 +728,47 @@ static void rfx_kin_duqu_serr( const double S[8], const double S_ref[8],
     *x = sqrt( xe[0]*xe[0] + xe[1]*xe[1] + xe[2]*xe[2] );
 }
 
+/* Stacked, weighted pose error of all targets, and its squared norm */
+static double
+ksol_err( const struct kin_solve_cx *cx, const double *S, double *e )
+{
+    const struct kin_solve_work *w = cx->work;
+    for( size_t k = 0; k < w->n_e; k ++ ) {
+        double *ek = e + 6*k;
+        rfx_kin_duqu_werr( S + 8*k, w->S_ref + 8*k, ek );
+        for( size_t i = 0; i < 3; i ++ ) {
+            ek[AA_TF_DX_V + i] *= w->weight[k] * cx->opts->gain_trans;
+            ek[AA_TF_DX_W + i] *= w->weight[k] * cx->opts->gain_angle;
+        }
+    }
+    return aa_la_dot( w->m, e, e );
+}
+
+/* Are all weighted targets within tolerance? */
+static int
+ksol_within( const struct kin_solve_cx *cx, const double *S,
+             double tol_angle, double tol_trans )
+{
+    const struct kin_solve_work *w = cx->work;
+    for( size_t k = 0; k < w->n_e; k ++ ) {
+        if( 0 == w->weight[k] ) continue;
+        double theta_err, x_err;
+        rfx_kin_duqu_serr( S + 8*k, w->S_ref + 8*k, &theta_err, &x_err );
+        if( theta_err >= tol_angle || x_err >= tol_trans ) return 0;
+    }
+    return 1;
+}
+
+/* Nullspace velocity toward q_ref */
+static void
+ksol_dqnull( const struct kin_solve_cx *cx, const double *q, double *dqnull )
+{
+    for( size_t i = 0; i < cx->n; i ++ )  {
+        double k = cx->dq_dt ? cx->dq_dt[i] : 1;
+        dqnull[i] = - k * ( q[i] - cx->opts->q_ref[i] );
+    }
+}
+
 
 static void kin_solve_sys( const void *vcx,
                            double t, const double *AA_RESTRICT q,
@@ -158,45 +778,34 @@ static void kin_solve_sys( const void *vcx,
     //printf("ksolve\n");
 
     // compute kinematics
-    double S[8];
-    double J[6*cx->n];
-    double J_star[6*cx->n];
+    struct kin_solve_work *w = cx->work;
+    double S[8*w->n_e];
+    double *J = w->J;
+    double *J_star = w->J_star;
     ksol_duqu( cx, q, S, J );
 
     // position error
-    double w_e[6];
-    rfx_kin_duqu_werr( S, cx->S1, w_e );
-    for( size_t i = 0; i < 3; i ++ ) {
-        w_e[AA_TF_DX_V + i] *= -cx->opts->gain_trans;
-        w_e[AA_TF_DX_W + i] *= -cx->opts->gain_angle;
-    }
-
-    double theta_err, x_err;
-    rfx_kin_duqu_serr( S, cx->S1, &theta_err, &x_err );
-
-    // TODO: Try DGECON to avoid damping when possible without taking the SVD
+    double *w_e = w->e;
+    ksol_err( cx, S, w_e );
+    for( size_t i = 0; i < w->m; i ++ ) w_e[i] *= -1;
 
     // damped least squares
-    if( theta_err < cx->opts->tol_angle_svd &&
-        x_err < cx->opts->tol_trans_svd )
-    {
-        aa_la_dzdpinv( 6, cx->n, cx->opts->s2min, J, J_star );
+    if( ksol_within( cx, S, cx->opts->tol_angle_svd, cx->opts->tol_trans_svd ) ) {
+        ksol_dzdpinv( w, cx->opts->s2min, J, J_star );
     } else {
-        aa_la_dpinv( 6, cx->n, cx->opts->k_dls, J, J_star );
+        ksol_dpinv( w, cx->opts->k_dls, J, J_star );
     }
 
     if( cx->opts->q_ref ) {
         //printf("nullspace projection\n");
         // nullspace projection
-        double dqnull[cx->n];
-        for( size_t i = 0; i < cx->n; i ++ )  {
-            dqnull[i] = - cx->dq_dt[i] * ( q[i] - cx->opts->q_ref[i] );
-        }
+        double *dqnull = w->dqnull;
+        ksol_dqnull( cx, q, dqnull );
         //aa_dump_vec( stdout, dqnull, cx->n );
-        aa_la_xlsnp( 6, cx->n, J, J_star, w_e, dqnull, dq );
+        ksol_xlsnp( w, J, J_star, w_e, dqnull, dq );
     } else {
         //printf("no projection\n");
-        aa_la_mvmul(cx->n,6,J_star,w_e,dq);
+        aa_la_mvmul(cx->n,w->m,J_star,w_e,dq);
     }
 }
 
@@ -204,6 +813,18 @@ static void kin_solve_sys( const void *vcx,
 /*     const struct aa_rx_sg_sub *ssg; */
 /* } */
 
+/* Has another thread asked the solver to stop? */
+static int
+ksol_cancelled( const struct aa_rx_ksol_opts *opts )
+{
+    if( NULL == opts->cancel ) return 0;
+#ifdef __GNUC__
+    return __atomic_load_n( opts->cancel, __ATOMIC_RELAXED );
+#else
+    return *(const volatile int*)opts->cancel;
+#endif
+}
+
 static int kin_solve_check( void *vcx, double t, double *AA_RESTRICT x, double *AA_RESTRICT y )
 {
     //printf("check\n");
@@ -222,23 +843,20 @@ static int kin_solve_check( void *vcx, double t, double *AA_RESTRICT x, double *
     /* Check term */
     double dq_norm = aa_la_dot( cx->n, y, y );
 
-    double S[8];
+    double S[8*cx->work->n_e];
     ksol_duqu( cx, x, S, NULL );
-    double theta_err, x_err;
-    rfx_kin_duqu_serr( S, cx->S1, &theta_err, &x_err );
-    //printf("%f, %f, %f\n", t, theta_err, x_err );
     //printf("x: ");
     //aa_dump_vec(stdout, x, cx->n);
     //printf("y: ");
     //aa_dump_vec(stdout, y, cx->n);
 
     cx->iteration++;
-    if( (theta_err < cx->opts->tol_angle) &&
-        (x_err < cx->opts->tol_trans) &&
+    if( ksol_within( cx, S, cx->opts->tol_angle, cx->opts->tol_trans ) &&
         (dq_norm < cx->opts->tol_dq) )
     {
         return 1;
-    } else if( cx->iteration > cx->opts->max_iterations ) {
+    } else if( cx->iteration > cx->opts->max_iterations ||
+               ksol_cancelled(cx->opts) ) {
         return -1;
     } else {
         return 0;
@@ -250,15 +868,12 @@ static int kin_solve_check( void *vcx, double t, double *AA_RESTRICT x, double *
 static int
 aa_rx_sg_sub_ksol_dls( const struct aa_rx_sg_sub *ssg,
                        const struct aa_rx_ksol_opts *opts,
+                       struct kin_solve_work *work,
                        size_t n_tf, const double *TF, size_t ld_TF,
                        size_t n_q_all, const double *q_start_all,
                        size_t n_q, double *q_subset )
 {
-
-    /* Only chains for now */
-    assert(n_tf == 1 );
     assert(n_q == aa_rx_sg_sub_config_count(ssg) );
-    (void)ld_TF;
 
     if( 0 == n_q_all || NULL == q_start_all ) {
         q_start_all = opts->q_all_seed;
@@ -270,15 +885,9 @@ aa_rx_sg_sub_ksol_dls( const struct aa_rx_sg_sub *ssg,
 
     assert( aa_rx_sg_sub_all_config_count(ssg) == n_q_all );
 
-    const struct aa_rx_sg *sg = ssg->scenegraph;
-    size_t n_f = aa_rx_sg_frame_count(sg);
-
-    double S[8];
-    aa_tf_qutr2duqu( TF, S );
-
-    assert( aa_rx_sg_sub_config_count(ssg) == n_q);
+    assert( work->n == n_q );
 
-    double q0_sub[n_q];
+    double *q0_sub = work->q0_sub;
 
     aa_rx_sg_config_get( ssg->scenegraph, n_q_all, n_q, aa_rx_sg_sub_configs(ssg),
                          q_start_all, q0_sub );
@@ -293,7 +902,6 @@ aa_rx_sg_sub_ksol_dls( const struct aa_rx_sg_sub *ssg,
     struct kin_solve_cx cx;
     cx.n = n_q;
     cx.opts = opts;
-    cx.S1 = S;
     cx.ssg = ssg;
     cx.dq_dt = opts->dq_dt;
     cx.iteration = 0;
@@ -307,23 +915,16 @@ aa_rx_sg_sub_ksol_dls( const struct aa_rx_sg_sub *ssg,
     cx.q0_all = q_start_all;
     cx.n_all = n_q_all;
 
-    cx.reg = aa_mem_region_local_get();
-    cx.TF_rel0 = AA_MEM_REGION_NEW_N(cx.reg, double, 7*n_f);
-    cx.TF_abs0 = AA_MEM_REGION_NEW_N(cx.reg, double, 7*n_f);
-
-    aa_rx_sg_tf( ssg->scenegraph,
-                 cx.n_all, cx.q0_all,
-                 n_f,
-                 cx.TF_rel0, 7,
-                 cx.TF_abs0, 7 );
+    cx.work = work;
+    int rb = ksol_begin( &cx, n_tf );
+    if( rb ) return rb;
+    ksol_set_goals( work, TF, ld_TF );
 
     int r = aa_ode_sol( AA_ODE_RK23_BS, &sol_opts, n_q,
                         kin_solve_sys, &cx,
                         kin_solve_check, &cx,
                         0, opts->dt, q0_sub, q_subset );
 
-    aa_mem_region_pop(cx.reg, cx.TF_rel0);
-
     if( r ) {
         return AA_RX_NO_SOLUTION | AA_RX_NO_IK;
     } else {
@@ -337,10 +938,78 @@ aa_rx_sg_sub_ksol_dls( const struct aa_rx_sg_sub *ssg,
 
 }
 
+/* Closed-form fast path.  Returns nonzero when the analytic solver
+ * applies, with its status in r. */
+static int
+ksol_analytic( const struct aa_rx_ik_analytic *ik,
+               const struct aa_rx_sg_sub *ssg,
+               const struct aa_rx_ksol_opts *opts,
+               size_t n_tf, const double *TF, size_t ld_TF,
+               size_t n_q, double *q, int *r )
+{
+    if( NULL == ik || 1 != n_tf ||
+        0 == opts->n_all_seed || NULL == opts->q_all_seed )
+    {
+        return 0;
+    }
+
+    /* The goal must be for the chain tip, whether given as the frame
+     * or as a one-element frame list */
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    aa_rx_frame_id tip = ssg->frames[ssg->frame_count-1];
+    if( AA_RX_FRAME_NONE != opts->frame && tip != opts->frame ) return 0;
+    if( opts->n_frames && (1 != opts->n_frames || tip != opts->frames[0]) ) return 0;
+
+    /* Goal relative to the chain root */
+    double E_root[7], E_rel[7];
+    ksol_walk( sg, opts->n_all_seed, opts->q_all_seed,
+               AA_RX_FRAME_ROOT, aa_rx_sg_frame_parent(sg, ssg->frames[0]),
+               E_root );
+    aa_tf_qutr_cmul( E_root, TF, E_rel );
+    (void)ld_TF;
+
+    aa_rx_sg_config_get( sg, opts->n_all_seed, n_q, aa_rx_sg_sub_configs(ssg),
+                         opts->q_all_seed, q );
+    *r = ik->solve( ik->data, E_rel, n_q, q ) ? (AA_RX_NO_SOLUTION | AA_RX_NO_IK) : 0;
+    return 1;
+}
+
+/* Cached seeds tried before the seed of the options */
+#define KSOL_CACHE_SEEDS 2
+
+/* The sub-scenegraph's IK cache, when it applies to this solve */
+static struct aa_rx_ik_cache *
+ksol_cache( const struct aa_rx_sg_sub *ssg, const struct aa_rx_ksol_opts *opts,
+            size_t n_tf )
+{
+    if( NULL == ssg->ik_cache || 1 != n_tf || 0 == ssg->frame_count ||
+        0 == opts->n_all_seed || NULL == opts->q_all_seed )
+    {
+        return NULL;
+    }
+    return ssg->ik_cache;
+}
+
+/* The goal relative to the chain root, as the IK cache keys it.
+ * Frames outside the sub-scenegraph stay at the seed. */
+static void
+ksol_cache_goal( const struct aa_rx_sg_sub *ssg, const struct aa_rx_ksol_opts *opts,
+                 const double *TF, double E_rel[7] )
+{
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    double E_root[7];
+    ksol_walk( sg, opts->n_all_seed, opts->q_all_seed,
+               AA_RX_FRAME_ROOT, aa_rx_sg_frame_parent(sg, ssg->frames[0]),
+               E_root );
+    aa_tf_qutr_cmul( E_root, TF, E_rel );
+}
+
 struct aa_rx_ik_jac_cx
 {
     const struct aa_rx_sg_sub *ssg;
     const struct aa_rx_ksol_opts *opts;
+    struct kin_solve_work *work;
+    const struct aa_rx_ik_analytic *analytic;
 };
 
 AA_API struct aa_rx_ik_jac_cx *
@@ -349,12 +1018,17 @@ aa_rx_ik_jac_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ksol_o
     struct aa_rx_ik_jac_cx *cx = AA_NEW0(struct aa_rx_ik_jac_cx);
     cx->ssg = ssg;
     cx->opts = opts;
+    cx->analytic = aa_rx_sg_sub_ik( ssg );
+    cx->work = AA_NEW0(struct kin_solve_work);
+    kin_solve_work_init( cx->work, ssg );
     return cx;
 }
 
 AA_API void
 aa_rx_ik_jac_cx_destroy( struct aa_rx_ik_jac_cx *cx )
 {
+    kin_solve_work_destroy( cx->work );
+    free( cx->work );
     free(cx);
 }
 
@@ -363,10 +1037,41 @@ AA_API int aa_rx_ik_jac_solve( const struct aa_rx_ik_jac_cx *context,
                                size_t n_tf, const double *TF, size_t ld_TF,
                                size_t n_q, double *q )
 {
-    return aa_rx_sg_sub_ksol_dls( context->ssg, context->opts,
-                                  n_tf, TF, ld_TF,
-                                  0, NULL,
-                                  n_q, q );
+    int r;
+    if( ksol_analytic( context->analytic, context->ssg, context->opts,
+                       n_tf, TF, ld_TF, n_q, q, &r ) )
+    {
+        return r;
+    }
+
+    /* Seed from cached solutions */
+    const struct aa_rx_ksol_opts *opts = context->opts;
+    struct aa_rx_ik_cache *cache = ksol_cache( context->ssg, opts, n_tf );
+    double E_rel[7];
+    if( cache ) {
+        size_t n_all = opts->n_all_seed;
+        double Q[KSOL_CACHE_SEEDS*n_q], q_all[n_all];
+        ksol_cache_goal( context->ssg, opts, TF, E_rel );
+        size_t n_c = aa_rx_ik_cache_lookup( cache, E_rel, KSOL_CACHE_SEEDS, n_q, Q, n_q );
+        for( size_t j = 0; j < n_c; j ++ ) {
+            AA_MEM_CPY( q_all, opts->q_all_seed, n_all );
+            aa_rx_sg_sub_config_set( context->ssg, n_q, Q + j*n_q, n_all, q_all );
+            if( 0 == aa_rx_sg_sub_ksol_dls( context->ssg, opts, context->work,
+                                            n_tf, TF, ld_TF,
+                                            n_all, q_all,
+                                            n_q, q ) )
+            {
+                return 0;
+            }
+        }
+    }
+
+    r = aa_rx_sg_sub_ksol_dls( context->ssg, opts, context->work,
+                               n_tf, TF, ld_TF,
+                               0, NULL,
+                               n_q, q );
+    if( cache && 0 == r ) aa_rx_ik_cache_insert( cache, E_rel, n_q, q );
+    return r;
 }
 
 AA_API int aa_rx_ik_jac_fun( void *context_,
@@ -380,6 +1085,292 @@ AA_API int aa_rx_ik_jac_fun( void *context_,
 }
 
 
+/* Levenberg-Marquardt
+ *
+ *   dq = J^T (J J^T + lambda I)^{-1} (-e) + (I - J^* J) dq_dt (q_ref - q)
+ *
+ * Steps that reduce the weighted pose error are taken and lambda
+ * decreases; otherwise the step is rejected and lambda increases.
+ */
+
+static void
+ksol_lm_clamp( const struct aa_rx_sg_sub *ssg, size_t n, double *q )
+{
+    for( size_t i = 0; i < n; i ++ ) {
+        double min,max;
+        aa_rx_config_id id = aa_rx_sg_sub_config(ssg,i);
+        if( 0 == aa_rx_sg_get_limit_pos(ssg->scenegraph, id, &min, &max ) ) {
+            q[i] = aa_fclamp(q[i], min, max );
+        }
+    }
+}
+
+/* Iterate from q.  When warm, the work Jacobian and target poses
+ * already hold the values at q, e.g., from the previous solve. */
+static int
+ksol_lm_run( struct kin_solve_cx *cx, double *q, int warm )
+{
+    const struct aa_rx_sg_sub *ssg = cx->ssg;
+    const struct aa_rx_ksol_opts *opts = cx->opts;
+    struct kin_solve_work *work = cx->work;
+    size_t n_q = cx->n;
+    size_t m = work->m;
+
+    double *J = work->J;
+    double *J_trial = work->J_trial;
+    double *S = work->S_cur;
+    double *S_trial = work->S_trial;
+    double *e = work->e;
+    double *e_trial = work->e_trial;
+    double *q_trial = work->q_trial;
+    double *dq = work->dq;
+
+    if( !warm ) {
+        ksol_lm_clamp( ssg, n_q, q );
+        ksol_duqu( cx, q, S, J );
+    }
+    double err = ksol_err( cx, S, e );
+    int converged = ksol_within( cx, S, opts->tol_angle, opts->tol_trans );
+
+    double lambda = opts->k_dls;
+    const double lambda_max = 1e8;
+
+    for( cx->iteration = 0;
+         cx->iteration < opts->max_iterations;
+         cx->iteration++ )
+    {
+        if( converged && NULL == opts->q_ref ) break;
+        if( ksol_cancelled(opts) ) break;
+
+        /* Compute the step */
+        double x[m];
+        for( size_t i = 0; i < m; i ++ ) x[i] = -e[i];
+        ksol_dpinv( work, lambda, J, work->J_star );
+        if( opts->q_ref ) {
+            ksol_dqnull( cx, q, work->dqnull );
+            ksol_xlsnp( work, J, work->J_star, x, work->dqnull, dq );
+            /* Pose reached and nullspace motion settled */
+            if( converged && aa_la_dot( n_q, dq, dq ) < opts->tol_dq ) break;
+        } else {
+            aa_la_mvmul( n_q, m, work->J_star, x, dq );
+        }
+
+        /* Try the step */
+        for( size_t i = 0; i < n_q; i ++ ) q_trial[i] = q[i] + dq[i];
+        ksol_lm_clamp( ssg, n_q, q_trial );
+
+        ksol_duqu( cx, q_trial, S_trial, J_trial );
+        double err_trial = ksol_err( cx, S_trial, e_trial );
+        int converged_trial = ksol_within( cx, S_trial, opts->tol_angle, opts->tol_trans );
+
+        if( converged ? converged_trial : err_trial < err ) {
+            /* Accept */
+            double *tmp;
+            AA_MEM_CPY( q, q_trial, n_q );
+            tmp = J; J = J_trial; J_trial = tmp;
+            tmp = S; S = S_trial; S_trial = tmp;
+            tmp = e; e = e_trial; e_trial = tmp;
+            err = err_trial;
+            converged = converged_trial;
+            lambda = AA_MAX( lambda / 3, opts->k_dls );
+        } else if( converged ) {
+            /* The nullspace step would leave the tolerance */
+            break;
+        } else {
+            /* Reject */
+            lambda *= 4;
+            if( lambda > lambda_max ) break;
+        }
+    }
+
+    /* Keep the values at q for a warm start */
+    work->J = J;
+    work->J_trial = J_trial;
+    work->S_cur = S;
+    work->S_trial = S_trial;
+    work->e = e;
+    work->e_trial = e_trial;
+
+    return converged ? 0 : (AA_RX_NO_SOLUTION | AA_RX_NO_IK);
+}
+
+/* Set up a solver context from the options' seed */
+static int
+ksol_lm_cx( struct kin_solve_cx *cx,
+            const struct aa_rx_sg_sub *ssg,
+            const struct aa_rx_ksol_opts *opts,
+            struct kin_solve_work *work,
+            size_t n_tf, size_t n_q )
+{
+    assert(n_q == aa_rx_sg_sub_config_count(ssg) );
+    assert( work->n == n_q );
+
+    if( 0 == opts->n_all_seed || NULL == opts->q_all_seed ) {
+        return AA_RX_INVALID_PARAMETER;
+    }
+    assert( aa_rx_sg_sub_all_config_count(ssg) == opts->n_all_seed );
+
+    cx->n = n_q;
+    cx->opts = opts;
+    cx->ssg = ssg;
+    cx->dq_dt = opts->dq_dt;
+    cx->iteration = 0;
+    cx->q0_all = opts->q_all_seed;
+    cx->n_all = opts->n_all_seed;
+    cx->work = work;
+    return ksol_begin( cx, n_tf );
+}
+
+static int
+aa_rx_sg_sub_ksol_lm( const struct aa_rx_sg_sub *ssg,
+                      const struct aa_rx_ksol_opts *opts,
+                      struct kin_solve_work *work,
+                      size_t n_tf, const double *TF, size_t ld_TF,
+                      const double *q_seed,
+                      size_t n_q, double *q )
+{
+    struct kin_solve_cx cx;
+    int r = ksol_lm_cx( &cx, ssg, opts, work, n_tf, n_q );
+    if( r ) return r;
+
+    ksol_set_goals( work, TF, ld_TF );
+    if( q_seed ) {
+        AA_MEM_CPY( q, q_seed, n_q );
+    } else {
+        aa_rx_sg_config_get( ssg->scenegraph, cx.n_all, n_q, aa_rx_sg_sub_configs(ssg),
+                             cx.q0_all, q );
+    }
+    return ksol_lm_run( &cx, q, 0 );
+}
+
+static int
+aa_rx_sg_sub_ksol_lm_batch( const struct aa_rx_sg_sub *ssg,
+                            const struct aa_rx_ksol_opts *opts,
+                            struct kin_solve_work *work,
+                            size_t n_pts,
+                            size_t n_tf, const double *TF, size_t ld_TF,
+                            size_t n_q, double *Q, size_t ld_Q,
+                            int *status, double *dq_max )
+{
+    struct kin_solve_cx cx;
+    int r = ksol_lm_cx( &cx, ssg, opts, work, n_tf, n_q );
+    if( r ) return r;
+
+    double *q0 = work->q0_sub;
+    aa_rx_sg_config_get( ssg->scenegraph, cx.n_all, n_q, aa_rx_sg_sub_configs(ssg),
+                         cx.q0_all, q0 );
+
+    int result = 0;
+    for( size_t p = 0; p < n_pts; p ++ ) {
+        /* Warm start from the previous point */
+        const double *q_prev = p ? Q + (p-1)*ld_Q : q0;
+        double *q = Q + p*ld_Q;
+        AA_MEM_CPY( q, q_prev, n_q );
+
+        ksol_set_goals( work, TF + p*n_tf*ld_TF, ld_TF );
+        int r_p = ksol_lm_run( &cx, q, p > 0 );
+
+        if( status ) status[p] = r_p;
+        if( dq_max ) {
+            double d = 0;
+            for( size_t i = 0; i < n_q; i ++ ) d = AA_MAX( d, fabs(q[i] - q_prev[i]) );
+            dq_max[p] = d;
+        }
+        if( r_p ) result = r_p;
+    }
+
+    return result;
+}
+
+struct aa_rx_ik_lm_cx
+{
+    const struct aa_rx_sg_sub *ssg;
+    const struct aa_rx_ksol_opts *opts;
+    struct kin_solve_work *work;
+    const struct aa_rx_ik_analytic *analytic;
+};
+
+AA_API struct aa_rx_ik_lm_cx *
+aa_rx_ik_lm_cx_create(const struct aa_rx_sg_sub *ssg, const struct aa_rx_ksol_opts *opts )
+{
+    struct aa_rx_ik_lm_cx *cx = AA_NEW0(struct aa_rx_ik_lm_cx);
+    cx->ssg = ssg;
+    cx->opts = opts;
+    cx->analytic = aa_rx_sg_sub_ik( ssg );
+    cx->work = AA_NEW0(struct kin_solve_work);
+    kin_solve_work_init( cx->work, ssg );
+    return cx;
+}
+
+AA_API void
+aa_rx_ik_lm_cx_destroy( struct aa_rx_ik_lm_cx *cx )
+{
+    kin_solve_work_destroy( cx->work );
+    free( cx->work );
+    free(cx);
+}
+
+AA_API int aa_rx_ik_lm_solve( const struct aa_rx_ik_lm_cx *context,
+                              size_t n_tf, const double *TF, size_t ld_TF,
+                              size_t n_q, double *q )
+{
+    int r;
+    if( ksol_analytic( context->analytic, context->ssg, context->opts,
+                       n_tf, TF, ld_TF, n_q, q, &r ) )
+    {
+        return r;
+    }
+
+    /* Seed from cached solutions */
+    struct aa_rx_ik_cache *cache = ksol_cache( context->ssg, context->opts, n_tf );
+    double E_rel[7];
+    if( cache ) {
+        double Q[KSOL_CACHE_SEEDS*n_q];
+        ksol_cache_goal( context->ssg, context->opts, TF, E_rel );
+        size_t n_c = aa_rx_ik_cache_lookup( cache, E_rel, KSOL_CACHE_SEEDS, n_q, Q, n_q );
+        for( size_t j = 0; j < n_c; j ++ ) {
+            if( 0 == aa_rx_sg_sub_ksol_lm( context->ssg, context->opts, context->work,
+                                           n_tf, TF, ld_TF,
+                                           Q + j*n_q,
+                                           n_q, q ) )
+            {
+                return 0;
+            }
+        }
+    }
+
+    r = aa_rx_sg_sub_ksol_lm( context->ssg, context->opts, context->work,
+                              n_tf, TF, ld_TF,
+                              NULL,
+                              n_q, q );
+    if( cache && 0 == r ) aa_rx_ik_cache_insert( cache, E_rel, n_q, q );
+    return r;
+}
+
+AA_API int aa_rx_ik_lm_solve_batch( const struct aa_rx_ik_lm_cx *context,
+                                    size_t n_pts,
+                                    size_t n_tf, const double *TF, size_t ld_TF,
+                                    size_t n_q, double *Q, size_t ld_Q,
+                                    int *status, double *dq_max )
+{
+    return aa_rx_sg_sub_ksol_lm_batch( context->ssg, context->opts, context->work,
+                                       n_pts,
+                                       n_tf, TF, ld_TF,
+                                       n_q, Q, ld_Q,
+                                       status, dq_max );
+}
+
+AA_API int aa_rx_ik_lm_fun( void *context_,
+                            size_t n_tf, const double *TF, size_t ld_TF,
+                            size_t n_q, double *q )
+{
+    struct aa_rx_ik_lm_cx *cx = (struct aa_rx_ik_lm_cx*)context_;
+    return aa_rx_ik_lm_solve( cx,
+                              n_tf, TF, ld_TF,
+                              n_q, q );
+}
+
+
 
 /* Levenberg Marquardt
  *
@@ -88,6 +88,8 @@ aa_rx_ksol_opts_destroy( struct aa_rx_ksol_opts *opts)
 {
     if( opts->dq_dt_data ) free( opts->dq_dt_data );
     if( opts->q_ref_data ) free( opts->q_ref_data );
+    if( opts->frames_data ) free( opts->frames_data );
+    if( opts->frame_weights_data ) free( opts->frame_weights_data );
 }
 
 
@@ -126,6 +128,24 @@ aa_rx_ksol_opts_take_gain_config( struct aa_rx_ksol_opts *opts, size_t n_q,
     opts->n_dq_dt = n_q;
 }
 
+AA_API void
+aa_rx_ksol_opts_take_frames( struct aa_rx_ksol_opts *opts, size_t n,
+                             aa_rx_frame_id *frames, enum aa_mem_refop refop )
+{
+    AA_MEM_DUPOP( refop, aa_rx_frame_id, opts->frames,
+                  opts->frames_data, frames, n );
+    opts->n_frames = n;
+}
+
+AA_API void
+aa_rx_ksol_opts_take_frame_weights( struct aa_rx_ksol_opts *opts, size_t n,
+                                    double *weights, enum aa_mem_refop refop )
+{
+    AA_MEM_DUPOP( refop, double, opts->frame_weights,
+                  opts->frame_weights_data, weights, n );
+    opts->n_frame_weights = n;
+}
+
 AA_API void
 aa_rx_ksol_opts_take_seed( struct aa_rx_ksol_opts *opts, size_t n_q,
                            double *q, enum aa_mem_refop refop )
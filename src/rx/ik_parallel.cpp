@@ -0,0 +1,320 @@
+/* -*- mode: C++; c-basic-offset: 4; -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2015, Rice University
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@rice.edu>
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of copyright holder the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "amino.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/rxerr.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_kin.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_kin_internal.h"
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace amino {
+
+/** One solver per thread, each with its own options and workspace */
+struct IKParallelSolver {
+    struct aa_rx_ksol_opts opts;
+    struct aa_rx_ik_lm_cx *lm;
+    std::vector<double> q_all;
+};
+
+}
+
+struct aa_rx_ik_parallel_cx {
+    aa_rx_ik_parallel_cx( const struct aa_rx_sg_sub *ssg,
+                          const struct aa_rx_ksol_opts *opts,
+                          size_t n_threads, size_t n_seeds );
+    ~aa_rx_ik_parallel_cx();
+
+    /** Solve from all seeds, stopping at the first solution if first */
+    int run( size_t n_tf, const double *TF, size_t ld_TF, bool first );
+
+    void work( size_t i_solver );
+    void worker( size_t i_solver );
+
+    const struct aa_rx_sg_sub *ssg;
+    const struct aa_rx_ksol_opts *opts;
+    size_t n_q;
+    size_t n_all;
+    size_t n_seeds;
+
+    /* Solver 0 belongs to the calling thread */
+    std::vector<amino::IKParallelSolver> solvers;
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+    size_t generation;
+    size_t active;
+    bool stop;
+
+    /* Current job */
+    size_t n_tf;
+    const double *TF;
+    size_t ld_TF;
+    bool first;
+    int cancel;
+    std::atomic<size_t> next;
+    std::atomic<size_t> winner;
+
+    /* Seeds and results, one column per seed */
+    std::vector<double> Q_seed;
+    std::vector<double> Q_sol;
+    std::vector<int> status;
+};
+
+aa_rx_ik_parallel_cx::aa_rx_ik_parallel_cx( const struct aa_rx_sg_sub *ssg_,
+                                            const struct aa_rx_ksol_opts *opts_,
+                                            size_t n_threads, size_t n_seeds_ ) :
+    ssg(ssg_),
+    opts(opts_),
+    n_q(aa_rx_sg_sub_config_count(ssg_)),
+    n_all(aa_rx_sg_sub_all_config_count(ssg_)),
+    n_seeds(AA_MAX(n_seeds_,(size_t)1)),
+    solvers(n_threads+1),
+    generation(0),
+    active(0),
+    stop(false),
+    cancel(0),
+    Q_seed(n_q*n_seeds),
+    Q_sol(n_q*n_seeds),
+    status(n_seeds)
+{
+    for( amino::IKParallelSolver &s : solvers ) {
+        s.opts = *opts;
+        s.lm = aa_rx_ik_lm_cx_create( ssg, &s.opts );
+        s.q_all.resize(n_all);
+    }
+    for( size_t i = 1; i < solvers.size(); i ++ ) {
+        threads.push_back( std::thread( &aa_rx_ik_parallel_cx::worker, this, i ) );
+    }
+}
+
+aa_rx_ik_parallel_cx::~aa_rx_ik_parallel_cx()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    cv_start.notify_all();
+    for( std::thread &t : threads ) t.join();
+    for( amino::IKParallelSolver &s : solvers ) {
+        aa_rx_ik_lm_cx_destroy( s.lm );
+    }
+}
+
+void aa_rx_ik_parallel_cx::work( size_t i_solver )
+{
+    amino::IKParallelSolver &s = solvers[i_solver];
+    for( size_t k = next++; k < n_seeds; k = next++ ) {
+        if( first && __atomic_load_n(&cancel, __ATOMIC_RELAXED) ) {
+            status[k] = AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+            continue;
+        }
+        double *q_seed = &Q_seed[k*n_q];
+        double *q_sol = &Q_sol[k*n_q];
+        AA_MEM_CPY( s.q_all.data(), opts->q_all_seed, n_all );
+        aa_rx_sg_sub_config_set( ssg, n_q, q_seed, n_all, s.q_all.data() );
+        status[k] = aa_rx_ik_lm_solve( s.lm, n_tf, TF, ld_TF, n_q, q_sol );
+        if( 0 == status[k] && first ) {
+            size_t none = SIZE_MAX;
+            winner.compare_exchange_strong( none, k );
+            __atomic_store_n( &cancel, 1, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+void aa_rx_ik_parallel_cx::worker( size_t i_solver )
+{
+    size_t seen = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv_start.wait( guard, [&]{ return stop || generation != seen; } );
+            if( stop ) return;
+            seen = generation;
+        }
+        work( i_solver );
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if( 0 == --active ) cv_done.notify_one();
+        }
+    }
+}
+
+int aa_rx_ik_parallel_cx::run( size_t n_tf_, const double *TF_, size_t ld_TF_, bool first_ )
+{
+    if( n_all != opts->n_all_seed || NULL == opts->q_all_seed ) {
+        return AA_RX_INVALID_PARAMETER;
+    }
+
+    /* Seeds: the given seed, then uniform samples within the limits */
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    aa_rx_sg_sub_config_get( ssg, n_all, opts->q_all_seed, n_q, &Q_seed[0] );
+    for( size_t k = 1; k < n_seeds; k ++ ) {
+        for( size_t i = 0; i < n_q; i ++ ) {
+            double min, max;
+            if( 0 == aa_rx_sg_get_limit_pos(sg, aa_rx_sg_sub_config(ssg,i), &min, &max) ) {
+                Q_seed[k*n_q + i] = min + (max-min)*aa_frand();
+            } else {
+                Q_seed[k*n_q + i] = Q_seed[i] + M_PI*(2*aa_frand() - 1);
+            }
+        }
+    }
+
+    /* Options may have changed since the last call */
+    for( amino::IKParallelSolver &s : solvers ) {
+        s.opts = *opts;
+        s.opts.dq_dt_data = NULL;
+        s.opts.q_ref_data = NULL;
+        s.opts.q_all_seed_data = NULL;
+        s.opts.frames_data = NULL;
+        s.opts.frame_weights_data = NULL;
+        s.opts.q_all_seed = s.q_all.data();
+        s.opts.cancel = first_ ? &cancel : NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        n_tf = n_tf_;
+        TF = TF_;
+        ld_TF = ld_TF_;
+        first = first_;
+        cancel = 0;
+        next = 0;
+        winner = SIZE_MAX;
+        active = threads.size();
+        generation++;
+    }
+    cv_start.notify_all();
+
+    work( 0 );
+
+    std::unique_lock<std::mutex> guard(lock);
+    cv_done.wait( guard, [&]{ return 0 == active; } );
+    return 0;
+}
+
+
+AA_API struct aa_rx_ik_parallel_cx *
+aa_rx_ik_parallel_cx_create( const struct aa_rx_sg_sub *ssg,
+                             const struct aa_rx_ksol_opts *opts,
+                             size_t n_threads, size_t n_seeds )
+{
+    return new aa_rx_ik_parallel_cx( ssg, opts, n_threads, n_seeds );
+}
+
+AA_API void
+aa_rx_ik_parallel_cx_destroy( struct aa_rx_ik_parallel_cx *cx )
+{
+    delete cx;
+}
+
+AA_API int
+aa_rx_ik_parallel_solve( struct aa_rx_ik_parallel_cx *cx,
+                         size_t n_tf, const double *TF, size_t ld_TF,
+                         size_t n_q, double *q )
+{
+    assert( n_q == cx->n_q );
+    int r = cx->run( n_tf, TF, ld_TF, true );
+    if( r ) return r;
+
+    size_t k = cx->winner;
+    if( SIZE_MAX == k ) {
+        return AA_RX_NO_SOLUTION | AA_RX_NO_IK;
+    }
+    AA_MEM_CPY( q, &cx->Q_sol[k*cx->n_q], n_q );
+    return 0;
+}
+
+AA_API int
+aa_rx_ik_parallel_fun( void *context,
+                       size_t n_tf, const double *TF, size_t ld_TF,
+                       size_t n_q, double *q )
+{
+    return aa_rx_ik_parallel_solve( (struct aa_rx_ik_parallel_cx*)context,
+                                    n_tf, TF, ld_TF,
+                                    n_q, q );
+}
+
+AA_API size_t
+aa_rx_ik_parallel_solve_best( struct aa_rx_ik_parallel_cx *cx,
+                              size_t n_tf, const double *TF, size_t ld_TF,
+                              const double *q_ref,
+                              size_t n_sol, size_t n_q, double *Q, size_t ld_Q )
+{
+    assert( n_q == cx->n_q );
+    if( cx->run( n_tf, TF, ld_TF, false ) ) return 0;
+
+    if( NULL == q_ref ) {
+        q_ref = cx->opts->q_ref ? cx->opts->q_ref : &cx->Q_seed[0];
+    }
+
+    /* Rank the solutions */
+    std::vector< std::pair<double,size_t> > ranked;
+    for( size_t k = 0; k < cx->n_seeds; k ++ ) {
+        if( 0 == cx->status[k] ) {
+            ranked.push_back( std::make_pair( aa_la_ssd(n_q, q_ref, &cx->Q_sol[k*n_q]), k ) );
+        }
+    }
+    std::sort( ranked.begin(), ranked.end() );
+
+    /* Copy out, skipping duplicates */
+    double tol_dq2 = cx->opts->tol_dq * cx->opts->tol_dq;
+    size_t n_found = 0;
+    for( size_t j = 0; j < ranked.size() && n_found < n_sol; j ++ ) {
+        const double *q = &cx->Q_sol[ranked[j].second*n_q];
+        bool dup = false;
+        for( size_t i = 0; i < n_found && !dup; i ++ ) {
+            dup = aa_la_ssd( n_q, q, Q + i*ld_Q ) < tol_dq2;
+        }
+        if( !dup ) {
+            AA_MEM_CPY( Q + n_found*ld_Q, q, n_q );
+            n_found++;
+        }
+    }
+
+    return n_found;
+}
@@ -0,0 +1,147 @@
+/* -*- mode: C++; c-basic-offset: 4; -*- */
+/* ex: set shiftwidth=4 tabstop=4 expandtab: */
+/*
+ * Copyright (c) 2016, Rice University
+ * All rights reserved.
+ *
+ * Author(s): Neil T. Dantam <ntd@rice.edu>
+ *
+ *   Redistribution and use in source and binary forms, with or
+ *   without modification, are permitted provided that the following
+ *   conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of copyright holder the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *   CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *   INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *   MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ *   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ *   USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *   AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *   POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "amino.h"
+#include "amino/rx/rxerr.h"
+#include "amino/rx/rxtype.h"
+#include "amino/rx/scenegraph.h"
+#include "amino/rx/scene_kin.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_collision.h"
+
+
+#include "amino/rx/ompl/scene_motion_validator.h"
+
+namespace amino {
+
+sgMotionValidator::sgMotionValidator(sgSpaceInformation *si,
+                                     sgStateValidityChecker *checker_)
+    :
+    MotionValidator(si),
+    segment_steps(8),
+    space(si->getTypedStateSpace()),
+    checker(checker_)
+{
+}
+
+bool sgMotionValidator::check_segment(const ompl::base::State *s1,
+                                      const ompl::base::State *s2) const
+{
+    size_t n_f = space->frame_count();
+    double *TF_1 = space->get_tf_abs(s1, checker->q_all);
+    double *TF_2 = space->get_tf_abs(s2, checker->q_all);
+
+    int collision;
+    {
+        std::lock_guard<std::mutex> lock(checker->mutex);
+        collision = aa_rx_cl_check_motion( checker->cl, n_f,
+                                           TF_1, 7,
+                                           TF_2, 7,
+                                           NULL );
+    }
+    space->region_pop(TF_1);
+
+    return !collision;
+}
+
+bool sgMotionValidator::checkMotion(const ompl::base::State *s1,
+                                    const ompl::base::State *s2,
+                                    std::pair<ompl::base::State*, double> &lastValid) const
+{
+    unsigned n_steps = AA_MAX( 1u, space->validSegmentCount(s1, s2) );
+
+    /* s_a: last state passing both checks, at step i_a
+     * s_p: last state passing the discrete check
+     * s_i: current state */
+    ompl::base::State *s_a = si_->allocState();
+    ompl::base::State *s_p = si_->allocState();
+    ompl::base::State *s_i = si_->allocState();
+    si_->copyState(s_a, s1);
+    unsigned i_a = 0;
+
+    bool valid = true;
+    for( unsigned i = 1; i <= n_steps; i ++ ) {
+        if( i == n_steps ) {
+            si_->copyState(s_i, s2);
+        } else {
+            space->interpolate(s1, s2, (double)i / n_steps, s_i);
+        }
+
+        /* Check every resolution state, as DiscreteMotionValidator does */
+        bool ok = si_->isValid(s_i);
+        if( ok ) std::swap(s_p, s_i);
+        unsigned i_p = ok ? i : i - 1;
+
+        /* Sweep between the discretely valid states */
+        if( i_p > i_a &&
+            (!ok || i == n_steps || i - i_a >= segment_steps) )
+        {
+            if( check_segment(s_a, s_p) ) {
+                std::swap(s_a, s_p);
+                i_a = i_p;
+            } else {
+                ok = false;
+            }
+        }
+
+        if( !ok ) {
+            valid = false;
+            lastValid.second = (double)i_a / n_steps;
+            if( lastValid.first ) si_->copyState(lastValid.first, s_a);
+            break;
+        }
+    }
+
+    si_->freeState(s_a);
+    si_->freeState(s_p);
+    si_->freeState(s_i);
+
+    if( valid ) valid_++;
+    else invalid_++;
+
+    return valid;
+}
+
+bool sgMotionValidator::checkMotion(const ompl::base::State *s1,
+                                    const ompl::base::State *s2) const
+{
+    std::pair<ompl::base::State*, double> lastValid(NULL, 0);
+    return checkMotion(s1, s2, lastValid);
+}
+
+} /* namespace amino */
@@ -51,6 +51,7 @@
 
 #include "amino/rx/ompl/scene_state_space.h"
 #include "amino/rx/ompl/scene_state_validity_checker.h"
+#include "amino/rx/ompl/scene_motion_validator.h"
 #include "amino/rx/ompl/scene_workspace_goal.h"
 #include "amino/rx/ompl/scene_ompl_internal.h"
 
@@ -74,11 +75,15 @@ aa_rx_mp::aa_rx_mp( const struct aa_rx_sg_sub *sub_sg ) :
                 new amino::sgStateSpace (sub_sg)))),
     problem_definition(new ompl::base::ProblemDefinition(space_information)),
     simplify(0),
+    ik_threads(0),
     validity_checker(new amino::sgStateValidityChecker(space_information.get())),
     lazy_samples(NULL)
 {
 
     space_information->setStateValidityChecker( ompl::base::StateValidityCheckerPtr(validity_checker) );
+    space_information->setMotionValidator(
+        ompl::base::MotionValidatorPtr(
+            new amino::sgMotionValidator(space_information.get(), validity_checker)));
     space_information->setup();
 }
 
@@ -263,6 +268,13 @@ aa_rx_mp_set_simplify( struct aa_rx_mp *mp,
     mp->simplify = simplify ? 1 : 0;
 }
 
+AA_API void
+aa_rx_mp_set_ik_threads( struct aa_rx_mp *mp,
+                         size_t n_threads )
+{
+    mp->ik_threads = n_threads;
+}
+
 AA_API struct aa_rx_cl_set*
 aa_rx_mp_get_allowed( const struct aa_rx_mp* mp)
 {
@@ -55,6 +55,7 @@ sgStateValidityChecker::sgStateValidityChecker(sgSpaceInformation *si)
     q_all(new double[getTypedStateSpace()->config_count_all()]),
     cl(aa_rx_cl_create(getTypedStateSpace()->scene_graph))
 {
+    aa_rx_cl_set_moving(cl, getTypedStateSpace()->sub_scene_graph);
     this->allow();
 }
 
@@ -86,10 +86,10 @@ sampler_fun( const ob::GoalLazySamples *arg, ob::State *state )
                                  n_all, q );
         aa_rx_ksol_opts_take_seed( wsg->ko, n_all, q, AA_MEM_COPY );
 
-        /* solve */
-        r = aa_rx_ik_jac_solve( wsg->ik_cx,
-                                wsg->n_e, wsg->E, 7,
-                                n_s, qs );
+        /* solve, restarting from further seeds in parallel */
+        r = aa_rx_ik_parallel_solve( wsg->ik_cx,
+                                     wsg->n_e, wsg->E, 7,
+                                     n_s, qs );
     }
 
     if( AA_RX_OK == r ) {
@@ -104,11 +104,13 @@ sampler_fun( const ob::GoalLazySamples *arg, ob::State *state )
 sgWorkspaceGoal::sgWorkspaceGoal (const sgSpaceInformation::Ptr &si,
                                   size_t n_e_,
                                   const aa_rx_frame_id *frame_arg,
-                                  const double *E_arg, size_t ldE ) :
+                                  const double *E_arg, size_t ldE,
+                                  size_t n_threads ) :
     typed_si(si),
     ob::GoalLazySamples(si, ob::GoalSamplingFn(sampler_fun), false),
     ko( aa_rx_ksol_opts_create() ),
-    ik_cx( aa_rx_ik_jac_cx_create(si->getTypedStateSpace()->sub_scene_graph, ko) ),
+    ik_cx( aa_rx_ik_parallel_cx_create(si->getTypedStateSpace()->sub_scene_graph, ko,
+                                       n_threads, 8) ),
     n_e(n_e_),
     state_sampler( si->allocStateSampler() ),
     seed(typed_si->allocTypedState()),
@@ -129,8 +131,7 @@ sgWorkspaceGoal::sgWorkspaceGoal (const sgSpaceInformation::Ptr &si,
         aa_rx_frame_id id_last = aa_rx_sg_sub_frame(ssg, n_s-1);
         AA_MEM_SET(this->frames, id_last, n_e);
     }
-    // TODO: multiple frames
-    aa_rx_ksol_opts_set_frame(ko, this->frames[0]);
+    aa_rx_ksol_opts_take_frames(ko, n_e, this->frames, AA_MEM_BORROW);
 
     /* Set goals */
     this->E = new double[n_e*7];
@@ -149,7 +150,7 @@ sgWorkspaceGoal::~sgWorkspaceGoal ()
 {
     typed_si->freeState(this->seed);
     aa_rx_ksol_opts_destroy(this->ko);
-    aa_rx_ik_jac_cx_destroy(this->ik_cx);
+    aa_rx_ik_parallel_cx_destroy(this->ik_cx);
     delete [] this->E;
     delete[] this->frames;
     aa_checked_free( this->q_start );
@@ -204,7 +205,8 @@ aa_rx_mp_set_wsgoal( struct aa_rx_mp *mp,
 {
     // TODO: add interface to set IK options for motion planner
     amino::sgWorkspaceGoal *g = new amino::sgWorkspaceGoal(mp->space_information,
-                                                           n_e, frames, E, ldE);
+                                                           n_e, frames, E, ldE,
+                                                           mp->ik_threads);
     mp->problem_definition->setGoal(ompl::base::GoalPtr(g));
     mp->lazy_samples = g;
     return 0;
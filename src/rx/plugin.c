@@ -46,6 +46,7 @@
 #include "amino/rx/scene_geom.h"
 #include "amino/rx/scene_geom_internal.h"
 #include "amino/rx/scene_plugin.h"
+#include "amino/rx/scene_kin.h"
 
 
 /* TODO: register destructors to close files when destroying meshes
@@ -131,3 +132,54 @@ aa_rx_dl_sg( const char *filename, const char *name,
         return NULL;
     }
 }
+
+AA_API const struct aa_rx_dl_sg_chain *
+aa_rx_dl_sg_kin_chain( const struct aa_rx_dl_sg_kin *kin,
+                       const char *root, const char *tip )
+{
+    if( NULL == root ) root = "";
+    for( size_t i = 0; i < kin->chain_count; i ++ ) {
+        const struct aa_rx_dl_sg_chain *c = kin->chains + i;
+        if( 0 == strcmp(root, c->root) && 0 == strcmp(tip, c->tip) ) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+AA_API const struct aa_rx_dl_sg_kin *
+aa_rx_dl_sg_kin( const char *filename, const char *name,
+                 struct aa_rx_sg *sg )
+{
+    size_t n = strlen(name);
+    char buf[32+n];
+    snprintf(buf, sizeof(buf), "aa_rx_dl_sg_kin__%s", name);
+
+    void *handle;
+    aa_rx_dl_sg_kin_fun fun = (aa_rx_dl_sg_kin_fun)rx_dlopen(filename, buf, &handle);
+    if( NULL == fun ) return NULL;
+
+    const struct aa_rx_dl_sg_kin *kin = fun();
+    if( aa_rx_sg_set_kin(sg, kin) ) {
+        fprintf(stderr, "ERROR: compiled kinematics `%s' do not match scene graph\n", name);
+        return NULL;
+    }
+    return kin;
+}
+
+AA_API const struct aa_rx_ik_analytic *
+aa_rx_dl_ik( const char *filename, const char *name,
+             struct aa_rx_sg *sg )
+{
+    size_t n = strlen(name);
+    char buf[32+n];
+    snprintf(buf, sizeof(buf), "aa_rx_dl_ik__%s", name);
+
+    void *handle;
+    aa_rx_dl_ik_fun fun = (aa_rx_dl_ik_fun)rx_dlopen(filename, buf, &handle);
+    if( NULL == fun ) return NULL;
+
+    const struct aa_rx_ik_analytic *ik = fun();
+    aa_rx_sg_add_ik(sg, ik);
+    return ik;
+}
@@ -40,12 +40,16 @@
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scene_kin.h"
 #include "amino/rx/scene_kin_internal.h"
+#include "amino/rx/scene_plugin.h"
 
 AA_API void
 aa_rx_sg_sub_destroy( struct aa_rx_sg_sub *ssg )
 {
     if( ssg->frames ) free( ssg->frames );
     if( ssg->configs ) free( ssg->configs );
+    free( ssg->jac_ptr );
+    free( ssg->jac_cols );
+    free( ssg->config_frames );
 
     free(ssg);
 }
@@ -216,11 +220,83 @@ aa_rx_sg_sub_config_set(
 }
 
 
+static int
+sub_is_joint( const struct aa_rx_sg *sg, aa_rx_frame_id frame )
+{
+    switch( aa_rx_sg_frame_type(sg, frame) ) {
+    case AA_RX_FRAME_FIXED:
+        return 0;
+    case AA_RX_FRAME_REVOLUTE:
+    case AA_RX_FRAME_PRISMATIC:
+        return 1;
+    }
+    return 0;
+}
+
+/* Find the configurations that move each frame of the sub-scenegraph.
+ * A frame depends on its own configuration and those of its ancestors
+ * within the sub-scenegraph. */
+static void
+sub_jacobian_pattern( struct aa_rx_sg_sub *ssg )
+{
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_c = ssg->frame_count;
+
+    size_t *index = AA_NEW_AR( size_t, n_f + n_c );
+    size_t *parent = index + n_f;
+    for( size_t i = 0; i < n_f; i ++ ) index[i] = SIZE_MAX;
+    for( size_t i = 0; i < n_c; i ++ ) index[ssg->frames[i]] = i;
+
+    /* Nearest ancestor within the sub-scenegraph */
+    for( size_t i = 0; i < n_c; i ++ ) {
+        parent[i] = SIZE_MAX;
+        for( aa_rx_frame_id f = aa_rx_sg_frame_parent(sg, ssg->frames[i]);
+             f >= 0;
+             f = aa_rx_sg_frame_parent(sg, f) )
+        {
+            if( SIZE_MAX != index[f] ) {
+                parent[i] = index[f];
+                break;
+            }
+        }
+    }
+
+    /* Column counts; parents precede children */
+    ssg->jac_ptr = AA_NEW_AR( size_t, n_c + 1 );
+    size_t *len = AA_NEW_AR( size_t, n_c );
+    ssg->jac_ptr[0] = 0;
+    for( size_t i = 0; i < n_c; i ++ ) {
+        len[i] = (SIZE_MAX == parent[i] ? 0 : len[parent[i]])
+            + (size_t)sub_is_joint(sg, ssg->frames[i]);
+        ssg->jac_ptr[i+1] = ssg->jac_ptr[i] + len[i];
+    }
+
+    /* Columns, in the configuration order of aa_rx_sg_chain_configs() */
+    ssg->jac_cols = AA_NEW_AR( size_t, AA_MAX(ssg->jac_ptr[n_c], 1) );
+    ssg->config_frames = AA_NEW_AR( aa_rx_frame_id, AA_MAX(ssg->config_count, 1) );
+    for( size_t i = 0, c = 0; i < n_c; i ++ ) {
+        size_t *cols = ssg->jac_cols + ssg->jac_ptr[i];
+        size_t n_p = 0;
+        if( SIZE_MAX != parent[i] ) {
+            n_p = len[parent[i]];
+            AA_MEM_CPY( cols, ssg->jac_cols + ssg->jac_ptr[parent[i]], n_p );
+        }
+        if( sub_is_joint(sg, ssg->frames[i]) && c < ssg->config_count ) {
+            ssg->config_frames[c] = ssg->frames[i];
+            cols[n_p] = c++;
+        }
+    }
+
+    free( len );
+    free( index );
+}
+
 AA_API struct aa_rx_sg_sub *
 aa_rx_sg_chain_create( const struct aa_rx_sg *sg,
                        aa_rx_frame_id root, aa_rx_frame_id tip )
 {
-    struct aa_rx_sg_sub *ssg = AA_NEW( struct aa_rx_sg_sub );
+    struct aa_rx_sg_sub *ssg = AA_NEW0( struct aa_rx_sg_sub );
     ssg->scenegraph = sg;
 
     ssg->frame_count = aa_rx_sg_chain_frame_count( sg, root, tip);
@@ -232,10 +308,86 @@ aa_rx_sg_chain_create( const struct aa_rx_sg *sg,
     ssg->configs = AA_NEW_AR(aa_rx_config_id, ssg->config_count );
     aa_rx_sg_chain_configs( sg, ssg->frame_count, ssg->frames,
                             ssg->config_count, ssg->configs );
+    sub_jacobian_pattern( ssg );
+
+    ssg->compiled_kin = aa_rx_sg_get_kin( sg );
+    if( ssg->compiled_kin ) {
+        ssg->compiled_chain = aa_rx_dl_sg_kin_chain( ssg->compiled_kin,
+                                                     aa_rx_sg_frame_name(sg, root),
+                                                     aa_rx_sg_frame_name(sg, tip) );
+    }
 
     return ssg;
 }
 
+AA_API struct aa_rx_sg_sub *
+aa_rx_sg_tree_create( const struct aa_rx_sg *sg,
+                      aa_rx_frame_id root,
+                      size_t n_tips, const aa_rx_frame_id *tips )
+{
+    struct aa_rx_sg_sub *ssg = AA_NEW0( struct aa_rx_sg_sub );
+    ssg->scenegraph = sg;
+
+    /* Mark the frames between root and each tip */
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    unsigned char *mark = AA_NEW0_AR( unsigned char, n_f );
+    for( size_t i = 0; i < n_tips; i ++ ) {
+        for( aa_rx_frame_id f = tips[i];
+             f != root && f >= 0 && !mark[f];
+             f = aa_rx_sg_frame_parent(sg, f) )
+        {
+            mark[f] = 1;
+        }
+    }
+
+    /* Frame ids are in preorder, so each parent precedes its children */
+    ssg->frame_count = 0;
+    for( size_t i = 0; i < n_f; i ++ ) ssg->frame_count += mark[i];
+    ssg->frames =  AA_NEW_AR(aa_rx_frame_id, ssg->frame_count );
+    for( size_t i = 0, j = 0; i < n_f; i ++ ) {
+        if( mark[i] ) ssg->frames[j++] = (aa_rx_frame_id)i;
+    }
+    free( mark );
+
+    ssg->config_count = aa_rx_sg_chain_config_count( sg, ssg->frame_count, ssg->frames );
+    ssg->configs = AA_NEW_AR(aa_rx_config_id, ssg->config_count );
+    aa_rx_sg_chain_configs( sg, ssg->frame_count, ssg->frames,
+                            ssg->config_count, ssg->configs );
+    sub_jacobian_pattern( ssg );
+
+    return ssg;
+}
+
+/* Jacobian column of a joint frame for a point pe */
+static void
+sg_jacobian_column( const struct aa_rx_sg *sg, aa_rx_frame_id frame,
+                    const double *TF_abs, size_t ld_TF,
+                    const double *pe, double *J )
+{
+    double *Jr = J + AA_TF_DX_W; // rotational part
+    double *Jt = J + AA_TF_DX_V; // translational part
+
+    const double *a = aa_rx_sg_frame_axis(sg, frame);
+    const double *E = TF_abs + (size_t)frame*ld_TF;
+    const double *q = E+AA_TF_QUTR_Q;
+    const double *t = E+AA_TF_QUTR_T;
+
+    switch( aa_rx_sg_frame_type(sg, frame) )  {
+    case AA_RX_FRAME_REVOLUTE: {
+        aa_tf_qrot(q,a,Jr);
+        double tmp[3];
+        for( size_t j = 0; j < 3; j++ ) tmp[j] = pe[j] - t[j];
+        aa_tf_cross(Jr, tmp, Jt);
+        break;
+    }
+    case AA_RX_FRAME_PRISMATIC:
+        AA_MEM_ZERO(Jr, 3);
+        aa_tf_qrot(q,a,Jt);
+        break;
+    default: assert(0);
+    }
+}
+
 AA_API void
 aa_rx_sg_chain_jacobian( const struct aa_rx_sg *sg,
                          size_t n_tf, const double *TF_abs, size_t ld_TF,
@@ -252,9 +404,6 @@ aa_rx_sg_chain_jacobian( const struct aa_rx_sg *sg,
          i_frame < n_frames && i_config < n_configs;
          i_frame++ )
     {
-        double *Jr = J + AA_TF_DX_W; // rotational part
-        double *Jt = J + AA_TF_DX_V; // translational part
-
         aa_rx_frame_id frame = chain_frames[i_frame];
         assert( frame >= 0 );
         assert( (size_t)frame < n_tf );
@@ -266,27 +415,7 @@ aa_rx_sg_chain_jacobian( const struct aa_rx_sg *sg,
 
         case AA_RX_FRAME_REVOLUTE:
         case AA_RX_FRAME_PRISMATIC: {
-
-            const double *a = aa_rx_sg_frame_axis(sg, frame);
-            const double *E = TF_abs + (size_t)frame*ld_TF;
-            const double *q = E+AA_TF_QUTR_Q;
-            const double *t = E+AA_TF_QUTR_T;
-
-            switch(ft)  {
-            case AA_RX_FRAME_REVOLUTE: {
-                aa_tf_qrot(q,a,Jr);
-                double tmp[3];
-                for( size_t j = 0; j < 3; j++ ) tmp[j] = pe[j] - t[j];
-                aa_tf_cross(Jr, tmp, Jt);
-                break;
-            }
-            case AA_RX_FRAME_PRISMATIC:
-                AA_MEM_ZERO(Jr, 3);
-                aa_tf_qrot(q,a,Jt);
-                break;
-            default: assert(0);
-            }
-
+            sg_jacobian_column( sg, frame, TF_abs, ld_TF, pe, J );
             i_config++;
             J += ld_J;
             break;
@@ -309,11 +438,79 @@ aa_rx_sg_sub_jacobian( const struct aa_rx_sg_sub *ssg,
                        size_t n_tf, const double *TF_abs, size_t ld_TF,
                        double *J, size_t ld_J )
 {
-    aa_rx_sg_chain_jacobian( ssg->scenegraph,
-                             n_tf, TF_abs, ld_TF,
-                             ssg->frame_count, ssg->frames,
-                             ssg->config_count, ssg->configs,
-                             J, ld_J );
+    (void)n_tf;
+    if( 0 == ssg->frame_count ) return;
+
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    if( ssg->compiled_chain && aa_rx_sg_get_kin(sg) == ssg->compiled_kin ) {
+        ssg->compiled_chain->jacobian( TF_abs, ld_TF, J, ld_J );
+        return;
+    }
+
+    size_t i = ssg->frame_count - 1;
+    const double *pe = TF_abs + (size_t)ssg->frames[i]*ld_TF + AA_TF_QUTR_T;
+
+    /* Configurations on other branches do not move the last frame */
+    for( size_t c = 0; c < ssg->config_count; c ++ ) {
+        AA_MEM_ZERO( J + c*ld_J, 6 );
+    }
+    for( size_t k = ssg->jac_ptr[i]; k < ssg->jac_ptr[i+1]; k ++ ) {
+        size_t c = ssg->jac_cols[k];
+        sg_jacobian_column( sg, ssg->config_frames[c], TF_abs, ld_TF, pe, J + c*ld_J );
+    }
+}
+
+AA_API size_t
+aa_rx_sg_sub_jacobian_nnz( const struct aa_rx_sg_sub *ssg,
+                           size_t n_frames, const size_t *frames )
+{
+    size_t nnz = 0;
+    for( size_t j = 0; j < n_frames; j ++ ) {
+        assert( frames[j] < ssg->frame_count );
+        nnz += 6 * (ssg->jac_ptr[frames[j]+1] - ssg->jac_ptr[frames[j]]);
+    }
+    return nnz;
+}
+
+AA_API void
+aa_rx_sg_sub_jacobian_csr_pattern( const struct aa_rx_sg_sub *ssg,
+                                   size_t n_frames, const size_t *frames,
+                                   size_t *row_ptr, size_t *col_ind )
+{
+    size_t nz = 0;
+    row_ptr[0] = 0;
+    for( size_t j = 0; j < n_frames; j ++ ) {
+        size_t i = frames[j];
+        size_t len = ssg->jac_ptr[i+1] - ssg->jac_ptr[i];
+        for( size_t d = 0; d < 6; d ++ ) {
+            AA_MEM_CPY( col_ind + nz, ssg->jac_cols + ssg->jac_ptr[i], len );
+            nz += len;
+            row_ptr[6*j + d + 1] = nz;
+        }
+    }
+}
+
+AA_API void
+aa_rx_sg_sub_jacobian_csr( const struct aa_rx_sg_sub *ssg,
+                           size_t n_tf, const double *TF_abs, size_t ld_TF,
+                           size_t n_frames, const size_t *frames,
+                           double *values )
+{
+    (void)n_tf;
+    const struct aa_rx_sg *sg = ssg->scenegraph;
+    for( size_t j = 0; j < n_frames; j ++ ) {
+        size_t i = frames[j];
+        const double *pe = TF_abs + (size_t)ssg->frames[i]*ld_TF + AA_TF_QUTR_T;
+        size_t len = ssg->jac_ptr[i+1] - ssg->jac_ptr[i];
+        const size_t *cols = ssg->jac_cols + ssg->jac_ptr[i];
+        /* Rows of this frame are contiguous, each with len entries */
+        for( size_t k = 0; k < len; k ++ ) {
+            double Jc[6];
+            sg_jacobian_column( sg, ssg->config_frames[cols[k]], TF_abs, ld_TF, pe, Jc );
+            for( size_t d = 0; d < 6; d ++ ) values[d*len + k] = Jc[d];
+        }
+        values += 6*len;
+    }
 }
 
 AA_API void
@@ -43,8 +43,10 @@
 #include "amino/rx/scene_geom.h"
 #include "sg_convenience.h"
 
-#include <list>
 #include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 namespace amino {
@@ -56,9 +58,12 @@ SceneFrame::SceneFrame(
     const double q[4], const double v[3]
     ) :
     type(type_),
+    inertial(NULL),
     name(_name),
     parent(_parent),
-    inertial(NULL)
+    frame_id(AA_RX_FRAME_NONE),
+    parent_id(AA_RX_FRAME_NONE),
+    refcount(1)
 {
     AA_MEM_CPY(E+AA_TF_QUTR_Q, q ? q : aa_tf_quat_ident, 4);
     AA_MEM_CPY(E+AA_TF_QUTR_V, v ? v : aa_tf_vec_ident, 3);
@@ -81,6 +86,53 @@ int SceneFrame::in_global()
     return 0 == parent.size();
 }
 
+void SceneFrame::release( SceneFrame *f )
+{
+    if( 1 == f->refcount.fetch_sub(1) ) {
+        delete f;
+    }
+}
+
+SceneFrame *SceneFrame::clone_into( SceneFrame *f ) const
+{
+    for( struct aa_rx_geom *g : geometry ) {
+        f->geometry.push_back( aa_rx_geom_copy(g) );
+    }
+    if( inertial ) {
+        f->inertial = AA_NEW(struct aa_rx_inertial);
+        *f->inertial = *inertial;
+    }
+    f->frame_id = frame_id;
+    f->parent_id = parent_id;
+    return f;
+}
+
+SceneFrame *SceneFrameFixed::clone() const
+{
+    return clone_into( new SceneFrameFixed( parent.c_str(), name.c_str(),
+                                            E+AA_TF_QUTR_Q, E+AA_TF_QUTR_V ) );
+}
+
+SceneFrame *SceneFrameRevolute::clone() const
+{
+    SceneFrameRevolute *f =
+        new SceneFrameRevolute( parent.c_str(), name.c_str(),
+                                E+AA_TF_QUTR_Q, E+AA_TF_QUTR_V,
+                                config_name.c_str(), offset, axis );
+    f->config_index = config_index;
+    return clone_into(f);
+}
+
+SceneFrame *SceneFramePrismatic::clone() const
+{
+    SceneFramePrismatic *f =
+        new SceneFramePrismatic( parent.c_str(), name.c_str(),
+                                 E+AA_TF_QUTR_Q, E+AA_TF_QUTR_V,
+                                 config_name.c_str(), offset, axis );
+    f->config_index = config_index;
+    return clone_into(f);
+}
+
 SceneFrameFixed::SceneFrameFixed(
     const char *_parent,
     const char *_name,
@@ -198,11 +250,556 @@ void SceneFrameRevolute::tf_rel( const double *q, double _E[7] )
 //     return AA_RX_FRAME_PRISMATIC;
 // }
 
+void SceneKinematics::compile( const std::vector<SceneFrame*> &frames )
+{
+    size_t n = frames.size();
+
+    ops.resize(n);
+    parents.resize(n);
+    args.resize(n);
+
+    fixed_E.clear();
+
+    revolute_config.clear();
+    revolute_offset.clear();
+    revolute_scale.clear();
+    revolute_axis.clear();
+    revolute_E.clear();
+
+    prismatic_config.clear();
+    prismatic_offset.clear();
+    prismatic_axis.clear();
+    prismatic_E.clear();
+
+    for( size_t i = 0; i < n; i ++ ) {
+        SceneFrame *f = frames[i];
+        int root = f->in_global();
+        parents[i] = f->parent_id;
+
+        switch( f->type ) {
+        case AA_RX_FRAME_FIXED:
+            ops[i] = root ? FIXED_ROOT : FIXED;
+            args[i] = fixed_E.size() / 7;
+            fixed_E.insert( fixed_E.end(), f->E, f->E+7 );
+            break;
+        case AA_RX_FRAME_REVOLUTE: {
+            SceneFrameJoint *fj = static_cast<SceneFrameJoint*>(f);
+            ops[i] = root ? REVOLUTE_ROOT : REVOLUTE;
+            args[i] = revolute_config.size();
+            /* A non-unit axis scales the rotation */
+            double s = aa_la_norm(3, fj->axis);
+            double u[3] = {0,0,0};
+            if( s > 0 ) {
+                for( size_t k = 0; k < 3; k ++ ) u[k] = fj->axis[k] / s;
+            }
+            revolute_config.push_back( fj->config_index );
+            revolute_offset.push_back( fj->offset );
+            revolute_scale.push_back( s );
+            revolute_axis.insert( revolute_axis.end(), u, u+3 );
+            revolute_E.insert( revolute_E.end(), f->E, f->E+7 );
+            break;
+        }
+        case AA_RX_FRAME_PRISMATIC: {
+            SceneFrameJoint *fj = static_cast<SceneFrameJoint*>(f);
+            ops[i] = root ? PRISMATIC_ROOT : PRISMATIC;
+            args[i] = prismatic_config.size();
+            /* Translation is applied after the fixed rotation */
+            double a[3];
+            aa_tf_qrot( f->E+AA_TF_QUTR_Q, fj->axis, a );
+            prismatic_config.push_back( fj->config_index );
+            prismatic_offset.push_back( fj->offset );
+            prismatic_axis.insert( prismatic_axis.end(), a, a+3 );
+            prismatic_E.insert( prismatic_E.end(), f->E, f->E+7 );
+            break;
+        }
+        }
+    }
+
+    /* Descendant ranges */
+    subtree_end.resize(n);
+    for( size_t i = 0; i < n; i ++ ) subtree_end[i] = i+1;
+    for( size_t i = n; i > 0; i -- ) {
+        aa_rx_frame_id p = parents[i-1];
+        if( p >= 0 ) {
+            subtree_end[(size_t)p] = AA_MAX( subtree_end[(size_t)p], subtree_end[i-1] );
+        }
+    }
+
+    /* Independent root subtrees */
+    root_begin.clear();
+    for( size_t i = 0; i < n; i = subtree_end[i] ) root_begin.push_back(i);
+    root_begin.push_back(n);
+
+    /* Frames of each config */
+    size_t n_configs = 0;
+    for( size_t c : revolute_config ) n_configs = AA_MAX( n_configs, c+1 );
+    for( size_t c : prismatic_config ) n_configs = AA_MAX( n_configs, c+1 );
+
+    config_frame_ptr.assign( n_configs+1, 0 );
+    for( size_t i = 0; i < n; i ++ ) {
+        size_t c = frame_config(i);
+        if( c < n_configs ) config_frame_ptr[c+1]++;
+    }
+    for( size_t c = 0; c < n_configs; c ++ ) {
+        config_frame_ptr[c+1] += config_frame_ptr[c];
+    }
+    config_frames.resize( config_frame_ptr[n_configs] );
+    {
+        std::vector<size_t> fill( config_frame_ptr.begin(), config_frame_ptr.end()-1 );
+        for( size_t i = 0; i < n; i ++ ) {
+            size_t c = frame_config(i);
+            if( c < n_configs ) config_frames[ fill[c]++ ] = i;
+        }
+    }
+}
+
+/* Use the aligned product when every transform is padded and aligned */
+typedef void (*qutr_mul_fun)( const double *, const double *, double * );
+
+static qutr_mul_fun
+qutr_mul_for( const double *TF_rel, size_t ld_rel,
+              const double *TF_abs, size_t ld_abs )
+{
+    if( AA_TF_QUTR_LD_ALIGNED == ld_rel && AA_TF_QUTR_LD_ALIGNED == ld_abs &&
+        0 == ((uintptr_t)TF_rel | (uintptr_t)TF_abs) % AA_TF_QUTR_ALIGN )
+    {
+        return aa_tf_qutr_mul_aligned;
+    } else {
+        return aa_tf_qutr_mul;
+    }
+}
+
+void SceneKinematics::tf_update( const double *q,
+                                 size_t n_changed, const aa_rx_config_id *changed,
+                                 size_t n_tf,
+                                 double *TF_rel, size_t ld_rel,
+                                 double *TF_abs, size_t ld_abs ) const
+{
+    size_t n = AA_MIN( n_tf, ops.size() );
+    size_t n_configs = config_frame_ptr.size() - 1;
+
+    /* Count the moved frames */
+    size_t n_moved = 0;
+    for( size_t k = 0; k < n_changed; k ++ ) {
+        size_t c = (size_t)changed[k];
+        if( c < n_configs ) {
+            n_moved += config_frame_ptr[c+1] - config_frame_ptr[c];
+        }
+    }
+    if( 0 == n_moved ) return;
+
+    /* Update relative transforms of the moved frames */
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+    size_t *starts = AA_MEM_REGION_NEW_N( reg, size_t, n_moved );
+    size_t n_starts = 0;
+    for( size_t k = 0; k < n_changed; k ++ ) {
+        size_t c = (size_t)changed[k];
+        if( c >= n_configs ) continue;
+        for( size_t p = config_frame_ptr[c]; p < config_frame_ptr[c+1]; p ++ ) {
+            size_t i = config_frames[p];
+            if( i >= n ) continue;
+            tf_rel( i, q, TF_rel + i*ld_rel );
+            /* insertion sort by frame index */
+            size_t j = n_starts++;
+            while( j > 0 && starts[j-1] > i ) {
+                starts[j] = starts[j-1];
+                j--;
+            }
+            starts[j] = i;
+        }
+    }
+
+    /* Chain absolute transforms over each subtree, skipping nested
+     * subtrees that were already covered. */
+    qutr_mul_fun mul = qutr_mul_for( TF_rel, ld_rel, TF_abs, ld_abs );
+    size_t end = 0;
+    for( size_t k = 0; k < n_starts; k ++ ) {
+        size_t i = starts[k];
+        if( i < end ) continue;
+        end = AA_MIN( n, subtree_end[i] );
+        for( ; i < end; i ++ ) {
+            const double *E_rel = TF_rel + i*ld_rel;
+            double *E_abs = TF_abs + i*ld_abs;
+            switch( ops[i] ) {
+            case FIXED_ROOT:
+            case REVOLUTE_ROOT:
+            case PRISMATIC_ROOT:
+                AA_MEM_CPY( E_abs, E_rel, 7 );
+                break;
+            default:
+                mul( TF_abs + ld_abs*(size_t)parents[i], E_rel, E_abs );
+            }
+        }
+    }
+
+    aa_mem_region_pop( reg, starts );
+}
+
+void SceneKinematics::tf( const double *q, size_t n_tf,
+                          double *TF_rel, size_t ld_rel,
+                          double *TF_abs, size_t ld_abs ) const
+{
+    tf_range( q, 0, AA_MIN( n_tf, ops.size() ),
+              TF_rel, ld_rel, TF_abs, ld_abs );
+}
+
+void SceneKinematics::tf_range( const double *q, size_t begin, size_t end,
+                                double *TF_rel, size_t ld_rel,
+                                double *TF_abs, size_t ld_abs ) const
+{
+    qutr_mul_fun mul = qutr_mul_for( TF_rel, ld_rel, TF_abs, ld_abs );
+    double *E_rel = TF_rel + begin*ld_rel;
+    double *E_abs = TF_abs + begin*ld_abs;
+    for( size_t i = begin; i < end; i++, E_rel += ld_rel, E_abs += ld_abs ) {
+        tf_rel( i, q, E_rel );
+        switch( ops[i] ) {
+        case FIXED_ROOT:
+        case REVOLUTE_ROOT:
+        case PRISMATIC_ROOT:
+            AA_MEM_CPY( E_abs, E_rel, 7 );
+            break;
+        default:
+            assert( parents[i] < (aa_rx_frame_id)i );
+            mul( TF_abs + ld_abs*(size_t)parents[i], E_rel, E_abs );
+        }
+    }
+}
+
+/*
+ * Batched kinematics operate on lane-major blocks: element k of the
+ * transform for lane l is stored at X[k*BATCH_LANES + l].  Every loop
+ * below runs over the lanes with a constant trip count so that the
+ * compiler can vectorize across configurations.
+ */
+
+#define FOR_LANES(l) for( size_t l = 0; l < SceneKinematics::BATCH_LANES; l ++ )
+#define LANE(X,k,l) ((X)[(k)*SceneKinematics::BATCH_LANES + (l)])
+
+static inline void
+lanes_qutr_mul( const double *AA_RESTRICT A, const double *AA_RESTRICT B,
+                double *AA_RESTRICT C )
+{
+    FOR_LANES(l) {
+        double ax = LANE(A,0,l), ay = LANE(A,1,l), az = LANE(A,2,l), aw = LANE(A,3,l);
+        double bx = LANE(B,0,l), by = LANE(B,1,l), bz = LANE(B,2,l), bw = LANE(B,3,l);
+        double vx = LANE(B,4,l), vy = LANE(B,5,l), vz = LANE(B,6,l);
+
+        /* rotation */
+        LANE(C,0,l) = aw*bx + ax*bw + ay*bz - az*by;
+        LANE(C,1,l) = aw*by - ax*bz + ay*bw + az*bx;
+        LANE(C,2,l) = aw*bz + ax*by - ay*bx + az*bw;
+        LANE(C,3,l) = aw*bw - ax*bx - ay*by - az*bz;
+
+        /* translation: v + 2w(u x v) + 2u x (u x v) */
+        double tx = 2 * (ay*vz - az*vy);
+        double ty = 2 * (az*vx - ax*vz);
+        double tz = 2 * (ax*vy - ay*vx);
+        LANE(C,4,l) = LANE(A,4,l) + vx + aw*tx + (ay*tz - az*ty);
+        LANE(C,5,l) = LANE(A,5,l) + vy + aw*ty + (az*tx - ax*tz);
+        LANE(C,6,l) = LANE(A,6,l) + vz + aw*tz + (ax*ty - ay*tx);
+    }
+}
+
+static inline void
+lanes_broadcast( const double E[7], double *X )
+{
+    for( size_t k = 0; k < 7; k ++ ) {
+        FOR_LANES(l) LANE(X,k,l) = E[k];
+    }
+}
+
+void SceneKinematics::tf_batch( size_t n_batch, const double *Q, size_t ld_q,
+                                size_t n_tf,
+                                double *TF_rel, size_t ld_rel, size_t stride_rel,
+                                double *TF_abs, size_t ld_abs, size_t stride_abs ) const
+{
+    const size_t L = BATCH_LANES;
+    const size_t n = AA_MIN( n_tf, ops.size() );
+
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+    double *R = AA_MEM_REGION_NEW_N( reg, double, 7*L );
+    double *A = AA_MEM_REGION_NEW_N( reg, double, 7*L*n );
+
+    for( size_t b = 0; b < n_batch; b += L ) {
+        size_t m = AA_MIN( L, n_batch - b );
+        const double *Qb = Q + b*ld_q;
+
+        for( size_t i = 0; i < n; i ++ ) {
+            size_t j = args[i];
+            double *Ai = A + 7*L*i;
+
+            /* relative */
+            switch( ops[i] ) {
+            case FIXED:
+            case FIXED_ROOT:
+                lanes_broadcast( &fixed_E[7*j], R );
+                break;
+            case REVOLUTE:
+            case REVOLUTE_ROOT: {
+                const double *E0 = &revolute_E[7*j];
+                const double *u = &revolute_axis[3*j];
+                size_t c = revolute_config[j];
+                double s[L], h[L];
+                FOR_LANES(l) {
+                    double x = (l < m) ? Qb[l*ld_q + c] : 0;
+                    double theta = revolute_scale[j] * (x + revolute_offset[j]) / 2;
+                    s[l] = sin(theta);
+                    h[l] = cos(theta);
+                }
+                double ax = E0[0], ay = E0[1], az = E0[2], aw = E0[3];
+                double bx = u[0], by = u[1], bz = u[2];
+                FOR_LANES(l) {
+                    LANE(R,0,l) = s[l]*(aw*bx + ay*bz - az*by) + ax*h[l];
+                    LANE(R,1,l) = s[l]*(aw*by - ax*bz + az*bx) + ay*h[l];
+                    LANE(R,2,l) = s[l]*(aw*bz + ax*by - ay*bx) + az*h[l];
+                    LANE(R,3,l) = aw*h[l] - s[l]*(ax*bx + ay*by + az*bz);
+                    LANE(R,4,l) = E0[4];
+                    LANE(R,5,l) = E0[5];
+                    LANE(R,6,l) = E0[6];
+                }
+                break;
+            }
+            case PRISMATIC:
+            case PRISMATIC_ROOT: {
+                const double *E0 = &prismatic_E[7*j];
+                const double *a = &prismatic_axis[3*j];
+                size_t c = prismatic_config[j];
+                lanes_broadcast( E0, R );
+                FOR_LANES(l) {
+                    double d = ((l < m) ? Qb[l*ld_q + c] : 0) + prismatic_offset[j];
+                    LANE(R,4,l) += d*a[0];
+                    LANE(R,5,l) += d*a[1];
+                    LANE(R,6,l) += d*a[2];
+                }
+                break;
+            }
+            }
+
+            /* absolute */
+            switch( ops[i] ) {
+            case FIXED_ROOT:
+            case REVOLUTE_ROOT:
+            case PRISMATIC_ROOT:
+                AA_MEM_CPY( Ai, R, 7*L );
+                break;
+            default:
+                assert( parents[i] < (aa_rx_frame_id)i );
+                lanes_qutr_mul( A + 7*L*(size_t)parents[i], R, Ai );
+            }
+
+            /* store */
+            for( size_t l = 0; l < m; l ++ ) {
+                double *E_abs = TF_abs + (b+l)*stride_abs + i*ld_abs;
+                for( size_t k = 0; k < 7; k ++ ) E_abs[k] = LANE(Ai,k,l);
+                if( TF_rel ) {
+                    double *E_rel = TF_rel + (b+l)*stride_rel + i*ld_rel;
+                    for( size_t k = 0; k < 7; k ++ ) E_rel[k] = LANE(R,k,l);
+                }
+            }
+        }
+    }
+
+    aa_mem_region_pop( reg, R );
+}
+
+/*
+ * Root subtrees share no frames, so each is an independent task.
+ * Workers and the calling thread claim subtrees from a shared counter
+ * until none remain, which balances uneven subtree sizes.
+ */
+struct SceneTFPool {
+    SceneTFPool( size_t n_threads );
+    ~SceneTFPool();
+
+    void run( const SceneKinematics *kin, const double *q, size_t n,
+              double *TF_rel, size_t ld_rel,
+              double *TF_abs, size_t ld_abs );
+
+    void work();
+    void worker();
+
+    std::vector<std::thread> threads;
+
+    /* Held by the thread running a job */
+    std::mutex busy;
+
+    std::mutex lock;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+    size_t generation;
+    size_t active;
+    bool stop;
+
+    /* Current job */
+    const SceneKinematics *kin;
+    const double *q;
+    size_t n;
+    double *TF_rel;
+    size_t ld_rel;
+    double *TF_abs;
+    size_t ld_abs;
+    std::atomic<size_t> next;
+};
+
+SceneTFPool::SceneTFPool( size_t n_threads ) :
+    generation(0),
+    active(0),
+    stop(false)
+{
+    for( size_t i = 0; i < n_threads; i ++ ) {
+        threads.push_back( std::thread( &SceneTFPool::worker, this ) );
+    }
+}
+
+SceneTFPool::~SceneTFPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    cv_start.notify_all();
+    for( std::thread &t : threads ) t.join();
+}
+
+void SceneTFPool::work()
+{
+    const std::vector<size_t> &roots = kin->root_begin;
+    size_t n_roots = roots.size() - 1;
+    for( size_t k = next++; k < n_roots && roots[k] < n; k = next++ ) {
+        kin->tf_range( q, roots[k], AA_MIN(n, roots[k+1]),
+                       TF_rel, ld_rel, TF_abs, ld_abs );
+    }
+}
+
+void SceneTFPool::worker()
+{
+    size_t seen = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv_start.wait( guard, [&]{ return stop || generation != seen; } );
+            if( stop ) return;
+            seen = generation;
+        }
+        work();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if( 0 == --active ) cv_done.notify_one();
+        }
+    }
+}
+
+void SceneTFPool::run( const SceneKinematics *kin_, const double *q_, size_t n_,
+                       double *TF_rel_, size_t ld_rel_,
+                       double *TF_abs_, size_t ld_abs_ )
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        kin = kin_;
+        q = q_;
+        n = n_;
+        TF_rel = TF_rel_;
+        ld_rel = ld_rel_;
+        TF_abs = TF_abs_;
+        ld_abs = ld_abs_;
+        next = 0;
+        active = threads.size();
+        generation++;
+    }
+    cv_start.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> guard(lock);
+    cv_done.wait( guard, [&]{ return 0 == active; } );
+}
+
+void SceneGraph::tf( const double *q, size_t n_tf,
+                     double *TF_rel, size_t ld_rel,
+                     double *TF_abs, size_t ld_abs ) const
+{
+    size_t n = AA_MIN( n_tf, kinematics.ops.size() );
+    if( tf_pool && n >= tf_parallel_threshold &&
+        kinematics.root_begin.size() > 2 &&
+        tf_pool->busy.try_lock() )
+    {
+        tf_pool->run( &kinematics, q, n, TF_rel, ld_rel, TF_abs, ld_abs );
+        tf_pool->busy.unlock();
+    } else {
+        /* Concurrent callers share the pool; others run sequentially */
+        kinematics.tf( q, n_tf, TF_rel, ld_rel, TF_abs, ld_abs );
+    }
+}
+
+void SceneGraph::set_tf_parallel( size_t n_threads, size_t threshold )
+{
+    assert( ! frozen );
+    delete tf_pool;
+    tf_pool = n_threads ? new SceneTFPool(n_threads) : NULL;
+    tf_parallel_threshold = threshold;
+}
+
 SceneGraph::SceneGraph()
-    : dirty_indices(0),
-      destructor(NULL)
+    : config_size(0),
+      compiled_kin(NULL),
+      tf_pool(NULL),
+      tf_parallel_threshold(0),
+      reindex_first(SIZE_MAX),
+      destructor(NULL),
+      dirty_indices(0),
+      frozen(0)
 {}
 
+SceneGraph::SceneGraph( const SceneGraph &other ) :
+    frame_map(other.frame_map),
+    frames(other.frames),
+    limits(other.limits),
+    config_rmap(other.config_rmap),
+    config_size(other.config_size),
+    frame_index(other.frame_index),
+    config_index(other.config_index),
+    kinematics(other.kinematics),
+    compiled_kin(other.compiled_kin),
+    analytic_ik(other.analytic_ik),
+    tf_pool(NULL),
+    tf_parallel_threshold(other.tf_parallel_threshold),
+    reindex_first(other.reindex_first),
+    reindex_names(other.reindex_names),
+    frame_remap(other.frame_remap),
+    allowed(other.allowed),
+    allowed_indices1(other.allowed_indices1),
+    allowed_indices2(other.allowed_indices2),
+    destructor(NULL),
+    destructor_context(NULL),
+    dirty_indices(other.dirty_indices),
+    dirty_collision(1),
+    dirty_gl(1),
+    frozen(0)
+{
+    /* Share frames */
+    for( auto &pair : frame_map ) pair.second->refcount++;
+
+    /* Threads are per scene graph */
+    if( other.tf_pool ) {
+        tf_pool = new SceneTFPool( other.tf_pool->threads.size() );
+    }
+
+    /* Copy limits */
+    std::map<struct aa_rx_config_limits*,struct aa_rx_config_limits*> limits_copy;
+    for( auto &pair : other.limits_map ) {
+        struct aa_rx_config_limits *l = NULL;
+        if( pair.second ) {
+            l = AA_NEW(struct aa_rx_config_limits);
+            *l = *pair.second;
+        }
+        limits_map[pair.first] = l;
+        limits_copy[pair.second] = l;
+    }
+    for( auto &l : limits ) {
+        if( l ) l = limits_copy[l];
+    }
+}
+
 SceneGraph::~SceneGraph()
 {
     /* User destructor(s) */
@@ -210,28 +807,159 @@ SceneGraph::~SceneGraph()
         destructor(destructor_context);
     }
 
-    /* Delete Frames */
-    for( auto &pair : frame_map ) delete pair.second;
+    /* Release Frames */
+    for( auto &pair : frame_map ) SceneFrame::release(pair.second);
 
     /* Delete Limits */
     for( auto &pair : limits_map ) free(pair.second);
+
+    delete tf_pool;
+}
+
+SceneNameIndex::SceneNameIndex() :
+    mask(0)
+{ }
+
+size_t SceneNameIndex::hash( const char *name )
+{
+    /* FNV-1a */
+    uint64_t h = 14695981039346656037ULL;
+    for( const unsigned char *p = (const unsigned char*)name; *p; p++ ) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
 }
 
-static void sort_frame_helper( std::list<SceneFrame*> &list,
-                               std::set<std::string> &visited,
-                               std::map<std::string,SceneFrame*> &map,
-                               std::string &name )
+void SceneNameIndex::reset( size_t n )
 {
-    if( 0 == name.size() ||  // root frame
-        visited.find(name) != visited.end()  // already visited
-        ) { return; }
-    // mark visited
-    visited.insert(name);
-    SceneFrame *f = map[name];
-    // visit parent
-    sort_frame_helper(list,visited,map,f->parent);
-    // append
-    list.push_back(f);
+    /* At most half full */
+    size_t m = 16;
+    while( m < 2*n ) m *= 2;
+
+    Slot empty = {0, NULL, 0};
+    slots.assign( m, empty );
+    mask = m - 1;
+}
+
+void SceneNameIndex::insert( const char *name, size_t index )
+{
+    size_t h = hash(name);
+    for( size_t i = h & mask; ; i = (i+1) & mask ) {
+        Slot &s = slots[i];
+        if( NULL == s.name ) {
+            s.hash = h;
+            s.name = name;
+            s.index = index;
+            return;
+        }
+    }
+}
+
+const SceneNameIndex::Slot *
+SceneNameIndex::lookup( const char *name ) const
+{
+    if( slots.empty() ) return NULL;
+
+    size_t h = hash(name);
+    for( size_t i = h & mask; ; i = (i+1) & mask ) {
+        const Slot &s = slots[i];
+        if( NULL == s.name ) {
+            return NULL;
+        } else if( h == s.hash &&
+                   (name == s.name || 0 == strcmp(name, s.name)) ) {
+            return &s;
+        }
+    }
+}
+
+size_t SceneNameIndex::find( const char *name ) const
+{
+    const Slot *s = lookup(name);
+    return s ? s->index : SIZE_MAX;
+}
+
+const char *SceneNameIndex::intern( const char *name ) const
+{
+    const Slot *s = lookup(name);
+    return s ? s->name : NULL;
+}
+
+void SceneNameIndex::rename( const char *old_name, const char *new_name )
+{
+    Slot *s = const_cast<Slot*>( lookup(old_name) );
+    if( s && old_name == s->name ) {
+        s->name = new_name;
+    }
+}
+
+/* Preorder traversal, so that the descendants of every frame are
+ * contiguous and immediately follow it. */
+static void sort_frame_helper( std::vector<SceneFrame*> &list,
+                               std::map<std::string,std::vector<SceneFrame*> > &children,
+                               const std::string &name )
+{
+    auto itr = children.find(name);
+    if( children.end() == itr ) return;
+
+    for( SceneFrame *f : itr->second ) {
+        list.push_back(f);
+        sort_frame_helper(list, children, f->name);
+    }
+}
+
+bool SceneGraph::frame_indexed( const SceneFrame *f ) const
+{
+    return f->frame_id >= 0
+        && (size_t)f->frame_id < frames.size()
+        && frames[(size_t)f->frame_id] == f;
+}
+
+void SceneGraph::touch( SceneFrame *f )
+{
+    assert( ! frozen );
+    dirty_indices = 1;
+    if( frame_indexed(f) ) {
+        reindex_first = AA_MIN( reindex_first, (size_t)f->frame_id );
+    }
+}
+
+/* Sort frames added or moved since the last index into list, keeping
+ * frames[0,first) in place.  Returns the new value of first.
+ */
+size_t SceneGraph::sort_suffix( size_t first, std::vector<SceneFrame*> &list )
+{
+    /* New children must follow the old subtree of their parent */
+    for( const std::string &name : reindex_names ) {
+        auto itr = frame_map.find(name);
+        if( frame_map.end() == itr || itr->second->in_global() ) continue;
+        SceneFrame *p = frame_map[itr->second->parent];
+        if( frame_indexed(p) && (size_t)p->frame_id < first ) {
+            first = AA_MIN( first, kinematics.subtree_end[(size_t)p->frame_id] );
+        }
+    }
+
+    std::map<std::string,std::vector<SceneFrame*> > children;
+    for( auto itr = frame_map.begin(); itr != frame_map.end(); itr++ ) {
+        SceneFrame *f = itr->second;
+        if( ! (frame_indexed(f) && (size_t)f->frame_id < first) ) {
+            children[f->parent].push_back(f);
+        }
+    }
+
+    /* Close the subtrees still open at the splice point, innermost
+     * first, then add new subtrees of the global frame. */
+    if( first > 0 ) {
+        for( aa_rx_frame_id a = (aa_rx_frame_id)(first-1);
+             AA_RX_FRAME_ROOT != a;
+             a = frames[(size_t)a]->parent_id )
+        {
+            sort_frame_helper( list, children, frames[(size_t)a]->name );
+        }
+    }
+    sort_frame_helper( list, children, "" );
+
+    return first;
 }
 
 int SceneGraph::index()
@@ -248,78 +976,221 @@ int SceneGraph::index()
         }
     }
 
-    // Sort frames
-    std::list<SceneFrame*> list;
-    std::set<std::string> visited;
-    for( auto itr = frame_map.begin(); itr != frame_map.end(); itr++ ) {
-        SceneFrame *f = itr->second;
-        // invalidate indices
-        f->frame_id = f->parent_id = AA_RX_FRAME_NONE;
-        // Recursive sort
-        sort_frame_helper( list, visited, frame_map, f->name );
+    // Sort frames, splicing edits after the unchanged prefix
+    size_t n_old = frames.size();
+    size_t first = AA_MIN( reindex_first, n_old );
+    std::vector<SceneFrame*> list;
+    list.reserve( frame_map.size() );
+    if( first > 0 ) {
+        first = sort_suffix( first, list );
+    }
+    if( first + list.size() != frame_map.size() ) {
+        // Recursive sort from the global frame
+        first = 0;
+        list.clear();
+        std::map<std::string,std::vector<SceneFrame*> > children;
+        for( auto itr = frame_map.begin(); itr != frame_map.end(); itr++ ) {
+            SceneFrame *f = itr->second;
+            children[f->parent].push_back(f);
+        }
+        sort_frame_helper( list, children, "" );
     }
 
-    // Index names and configs
-    frames.resize( frame_map.size() );
-    {
-        std::set<std::string> config_set;
-        config_map.clear();
-        config_rmap.clear();
-        limits.clear();
-        size_t i_frame=0;
-        config_size = 0;
-        for( auto itr = list.begin();
-             itr != list.end();
-             itr++, i_frame++ )
+    // Frames not reachable from the global frame form a cycle
+    if( first + list.size() != frame_map.size() ) {
+        return AA_RX_INVALID_FRAME;
+    }
+
+    // Map old to new frame indices
+    frame_remap.assign( n_old, AA_RX_FRAME_NONE );
+    for( size_t i = 0; i < first; i ++ ) {
+        frame_remap[i] = (aa_rx_frame_id)i;
+    }
+    for( size_t k = 0; k < list.size(); k ++ ) {
+        SceneFrame *f = list[k];
+        if( frame_indexed(f) ) {
+            frame_remap[(size_t)f->frame_id] = (aa_rx_frame_id)(first + k);
+        }
+    }
+
+    // Keep configs first used in the prefix
+    size_t n_config = 0;
+    if( first > 0 ) {
+        while( n_config < config_size &&
+               kinematics.config_frames[kinematics.config_frame_ptr[n_config]] < first )
         {
-            SceneFrame *f = *itr;
-            frames[i_frame] = f;
-            f->frame_id = (aa_rx_frame_id)i_frame;
-            if( f->in_global() ) {
-                f->parent_id = AA_RX_FRAME_ROOT;
-            } else {
-                f->parent_id = frame_map[f->parent]->frame_id;
-            }
-            assert( f->parent_id < f->frame_id );
-            switch( f->type ) {
-            case AA_RX_FRAME_FIXED:
-                break;
-            case AA_RX_FRAME_REVOLUTE:
-            case AA_RX_FRAME_PRISMATIC: {
-                SceneFrameJoint *fj = static_cast<SceneFrameJoint*>(f);
-                const std::string &config_name = fj->config_name;
-                if( config_set.end() == config_set.find(config_name) ) {
-                    // not in set
-                    config_set.insert( config_name );
-                    config_rmap.push_back(config_name.c_str());
-                    limits.push_back( limits_map[config_name] );
-                    config_map[config_name] = (aa_rx_config_id)config_size;
-                    config_size++;
-                }
-                fj->config_index = (size_t)config_map[config_name];
-                break;
-            }
+            n_config++;
+        }
+    }
+    config_rmap.resize( n_config );
+    limits.resize( n_config );
+    config_size = n_config;
+    config_index.reset( n_config + list.size() );
+    for( size_t i = 0; i < n_config; i ++ ) {
+        config_index.insert( config_rmap[i], i );
+    }
+
+    // Index names and configs of the suffix
+    std::vector<std::pair<const char*,const char*> > renamed;
+    frames.resize( frame_map.size() );
+    for( size_t k = 0; k < list.size(); k ++ ) {
+        size_t i_frame = first + k;
+        SceneFrame *f = list[k];
+        aa_rx_frame_id frame_id = (aa_rx_frame_id)i_frame;
+        aa_rx_frame_id parent_id = ( f->in_global()
+                                     ? AA_RX_FRAME_ROOT
+                                     : frame_map[f->parent]->frame_id );
+        assert( parent_id < frame_id );
+        size_t c = SIZE_MAX;
+        if( AA_RX_FRAME_FIXED != f->type ) {
+            SceneFrameJoint *fj = static_cast<SceneFrameJoint*>(f);
+            const char *config_name = fj->config_name.c_str();
+            c = config_index.find( config_name );
+            if( SIZE_MAX == c ) {
+                c = config_size++;
+                config_index.insert( config_name, c );
+                config_rmap.push_back( config_name );
+                limits.push_back( limits_map[fj->config_name] );
             }
         }
+
+        /* Copy shared frames only when their indices change */
+        if( f->frame_id != frame_id || f->parent_id != parent_id ||
+            ( SIZE_MAX != c && static_cast<SceneFrameJoint*>(f)->config_index != c ) )
+        {
+            f = mutable_frame( f, &renamed );
+            f->frame_id = frame_id;
+            f->parent_id = parent_id;
+            if( SIZE_MAX != c ) static_cast<SceneFrameJoint*>(f)->config_index = c;
+        }
+        frames[i_frame] = f;
+    }
+    rename_allowed( renamed );
+
+    // Name lookup
+    frame_index.reset( frames.size() );
+    for( size_t i = 0; i < frames.size(); i ++ ) {
+        frame_index.insert( frames[i]->name.c_str(), i );
     }
 
+    kinematics.compile( frames );
+
+    /* Generated kernels assume the old indices */
+    compiled_kin = NULL;
+
+    reindex_first = SIZE_MAX;
+    reindex_names.clear();
     dirty_indices = 0;
     return 0;
 }
 
+SceneFrame *SceneGraph::find_frame( const char *name ) const
+{
+    if( ! dirty_indices ) {
+        size_t i = frame_index.find(name);
+        return SIZE_MAX == i ? NULL : frames[i];
+    }
+
+    auto itr = frame_map.find(name);
+    return frame_map.end() == itr ? NULL : itr->second;
+}
 
 void SceneGraph::add(SceneFrame *f)
 {
+    assert( ! frozen );
     dirty_indices = 1;
 
     /* delete if already exists */
     auto itr = frame_map.find(f->name);
     if( frame_map.end() != itr ) {
         amino::SceneFrame *old_f = itr->second;
-        delete old_f;
+        touch( old_f );
+        SceneFrame::release( old_f );
     }
 
     frame_map[f->name] = f;
+    reindex_names.push_back( f->name );
+}
+
+void SceneGraph::remove( const char *name )
+{
+    assert( ! frozen );
+    dirty_indices = 1;
+
+    auto itr = frame_map.find(name);
+    if( frame_map.end() != itr ) {
+        amino::SceneFrame *f = itr->second;
+        touch( f );
+        frame_map.erase(itr);
+        SceneFrame::release( f );
+    }
+}
+
+SceneFrame *SceneGraph::mutable_frame( SceneFrame *f,
+                                       std::vector<std::pair<const char*,const char*> > *renamed )
+{
+    assert( ! frozen );
+    if( 1 == f->refcount ) return f;
+
+    SceneFrame *c = f->clone();
+
+    /* Replace f in the frame tables */
+    frame_map[f->name] = c;
+    if( frame_indexed(f) ) {
+        frames[(size_t)f->frame_id] = c;
+    }
+    frame_index.rename( f->name.c_str(), c->name.c_str() );
+
+    /* Interned config name */
+    if( AA_RX_FRAME_FIXED != f->type ) {
+        const char *n0 = static_cast<SceneFrameJoint*>(f)->config_name.c_str();
+        const char *n1 = static_cast<SceneFrameJoint*>(c)->config_name.c_str();
+        size_t i = config_index.find(n0);
+        if( SIZE_MAX != i && config_rmap[i] == n0 ) {
+            config_rmap[i] = n1;
+            config_index.rename( n0, n1 );
+        }
+    }
+
+    /* Allowed collisions */
+    std::pair<const char*,const char*> r( f->name.c_str(), c->name.c_str() );
+    if( renamed ) {
+        renamed->push_back(r);
+    } else if( ! allowed.empty() ) {
+        rename_allowed( std::vector<std::pair<const char*,const char*> >(1,r) );
+    }
+
+    SceneFrame::release(f);
+    return c;
+}
+
+void SceneGraph::rename_allowed( const std::vector<std::pair<const char*,const char*> > &renamed )
+{
+    if( renamed.empty() || allowed.empty() ) return;
+
+    std::map<const char*,const char*> m( renamed.begin(), renamed.end() );
+    std::set<std::pair<const char*,const char*> > a;
+    for( const auto &pair : allowed ) {
+        auto i0 = m.find(pair.first);
+        auto i1 = m.find(pair.second);
+        a.insert( std::pair<const char*,const char*>(
+                      m.end() == i0 ? pair.first : i0->second,
+                      m.end() == i1 ? pair.second : i1->second ) );
+    }
+    allowed.swap(a);
+}
+
+void SceneGraph::reparent( SceneFrame *f, const char *parent, const double E[7] )
+{
+    touch( f );
+    f = mutable_frame( f );
+
+    f->parent = ( (NULL == parent || '\0' == parent[0])
+                  ? ""
+                  : parent );
+    AA_MEM_CPY(f->E, E, 7);
+
+    reindex_names.push_back( f->name );
 }
 
 } /* amino */
@@ -330,7 +1201,8 @@ aa_rx_sg_add_geom( aa_rx_sg *scene_graph, const char *frame,
                    struct aa_rx_geom* geom )
 {
     aa_rx_sg_dirty_geom( scene_graph );
-    aa_rx_scene_frame *f = aa_rx_sg_find(scene_graph, frame);
+    amino::SceneGraph *sg = scene_graph->sg;
+    aa_rx_scene_frame *f = sg->mutable_frame( aa_rx_sg_find(scene_graph, frame) );
     f->geometry.push_back(geom);
 }
 
@@ -338,6 +1210,7 @@ AA_API void
 aa_rx_sg_dirty_geom( struct aa_rx_sg *scene_graph )
 {
     amino::SceneGraph *sg = scene_graph->sg;
+    assert( ! sg->frozen );
     sg->dirty_gl = 1;
     sg->dirty_collision = 1;
 }
@@ -385,6 +1258,7 @@ AA_API void
 aa_rx_sg_clean_gl( struct aa_rx_sg *scene_graph )
 {
     amino::SceneGraph *sg = scene_graph->sg;
+    assert( ! sg->frozen || ! sg->dirty_gl );
     sg->dirty_gl = 0;
 }
 
@@ -393,6 +1267,7 @@ AA_API void
 aa_rx_sg_clean_collision( struct aa_rx_sg *scene_graph )
 {
     amino::SceneGraph *sg = scene_graph->sg;
+    assert( ! sg->frozen || ! sg->dirty_collision );
     sg->dirty_collision = 0;
 }
 
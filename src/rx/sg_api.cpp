@@ -38,9 +38,14 @@
 
 #include "amino.h"
 #include "amino/rx/rxtype.h"
+#include "amino/rx/rxerr.h"
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scenegraph_internal.h"
  #include "amino/rx/scene_geom.h"
+#include "amino/rx/scene_plugin.h"
+#include "amino/rx/scene_kin.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/scene_kin_internal.h"
 
 
 AA_API struct aa_rx_sg *aa_rx_sg_create()
@@ -61,6 +66,29 @@ AA_API int aa_rx_sg_init ( struct aa_rx_sg *scene_graph )
     return scene_graph->sg->index();
 }
 
+AA_API int aa_rx_sg_freeze ( struct aa_rx_sg *scene_graph )
+{
+    amino::SceneGraph *sg = scene_graph->sg;
+    int r = sg->index();
+    sg->frozen = 1;
+    return r;
+}
+
+AA_API int aa_rx_sg_is_frozen ( const struct aa_rx_sg *scene_graph )
+{
+    return scene_graph->sg->frozen;
+}
+
+AA_API size_t aa_rx_sg_frame_remap (
+    const struct aa_rx_sg *scene_graph, size_t n, aa_rx_frame_id *remap )
+{
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+    const std::vector<aa_rx_frame_id> &m = scene_graph->sg->frame_remap;
+    size_t n_min = AA_MIN( n, m.size() );
+    for( size_t i = 0; i < n_min; i ++ ) remap[i] = m[i];
+    return m.size();
+}
+
 AA_API size_t aa_rx_sg_config_count(
     const struct aa_rx_sg *scene_graph )
 {
@@ -89,7 +117,8 @@ AA_API aa_rx_config_id aa_rx_sg_config_id(
     const struct aa_rx_sg *scene_graph, const char *config_name)
 {
     aa_rx_sg_ensure_clean_frames( scene_graph );
-    return scene_graph->sg->config_map[config_name];
+    size_t i = scene_graph->sg->config_index.find(config_name);
+    return SIZE_MAX == i ? AA_RX_CONFIG_NONE : (aa_rx_config_id)i;
 }
 
 AA_API aa_rx_frame_id aa_rx_sg_frame_id (
@@ -97,11 +126,8 @@ AA_API aa_rx_frame_id aa_rx_sg_frame_id (
 {
     if( '\0' == *frame_name ) return AA_RX_FRAME_ROOT;
 
-    auto itr = scene_graph->sg->frame_map.find(frame_name);
-    if( itr != scene_graph->sg->frame_map.end() ) {
-        return itr->second->frame_id;
-    }
-    return AA_RX_FRAME_NONE;
+    amino::SceneFrame *f = scene_graph->sg->find_frame(frame_name);
+    return f ? f->frame_id : AA_RX_FRAME_NONE;
 }
 
 AA_API const char *
@@ -185,16 +211,7 @@ AA_API void aa_rx_sg_rm_frame
   const char *name )
 {
 
-    amino::SceneGraph *sg = scene_graph->sg;
-    sg->dirty_indices = 1;
-
-    auto itr = sg->frame_map.find(name);
-    if( sg->frame_map.end() != itr ) {
-        amino::SceneFrame *f = itr->second;
-        delete f;
-    }
-
-    sg->frame_map.erase(name);
+    scene_graph->sg->remove(name);
 }
 
 AA_API void aa_rx_sg_tf
@@ -209,28 +226,238 @@ AA_API void aa_rx_sg_tf
     aa_rx_sg_ensure_clean_frames( scene_graph );
     assert( n_q == scene_graph->sg->config_size );
 
+    const struct aa_rx_dl_sg_kin *kin = scene_graph->sg->compiled_kin;
+    if( kin && n_tf >= kin->frame_count ) {
+        kin->tf( q, TF_rel, ld_rel, TF_abs, ld_abs );
+    } else {
+        scene_graph->sg->tf( q, n_tf,
+                             TF_rel, ld_rel,
+                             TF_abs, ld_abs );
+    }
+}
+
+AA_API void aa_rx_sg_set_tf_parallel
+( struct aa_rx_sg *scene_graph, size_t n_threads, size_t threshold )
+{
+    scene_graph->sg->set_tf_parallel( n_threads, threshold );
+}
+
+/* Compare a compiled kernel against the generic kinematics */
+static bool
+sg_kin_check( amino::SceneGraph *sg, const struct aa_rx_dl_sg_kin *kin )
+{
+    size_t n_f = sg->frames.size();
+    size_t n_q = sg->config_size;
+    std::vector<double> q(n_q), TF(4*7*n_f);
+    double *TF_rel = TF.data(), *TF_abs = TF_rel + 7*n_f;
+    double *TF_rel_k = TF_abs + 7*n_f, *TF_abs_k = TF_rel_k + 7*n_f;
+
+    /* The zero configuration and a generic one */
+    for( size_t k = 0; k < 2; k ++ ) {
+        for( size_t i = 0; i < n_q; i ++ ) {
+            q[i] = k ? sin((double)(i+1)) : 0;
+        }
+        sg->tf( q.data(), n_f, TF_rel, 7, TF_abs, 7 );
+        kin->tf( q.data(), TF_rel_k, 7, TF_abs_k, 7 );
+        for( size_t i = 0; i < 2*n_f; i ++ ) {
+            const double *E = TF_rel + 7*i, *E_k = TF_rel_k + 7*i;
+            /* Either sign of the quaternion is the same rotation */
+            if( 1 - fabs(aa_tf_qdot(E, E_k)) > 1e-9 ) return false;
+            for( size_t j = AA_TF_QUTR_T; j < 7; j ++ ) {
+                if( fabs(E[j] - E_k[j]) > 1e-9 * (1 + fabs(E[j])) ) return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Compare compiled chain Jacobians against aa_rx_sg_sub_jacobian() */
+static int
+sg_kin_check_chains( struct aa_rx_sg *scene_graph, const struct aa_rx_dl_sg_kin *kin )
+{
     amino::SceneGraph *sg = scene_graph->sg;
-    size_t i_frame = 0;
-    for( size_t i_rel = 0, i_abs = 0;
-         i_frame < n_tf && i_frame < sg->frames.size();
-         i_frame++, i_rel += ld_rel, i_abs += ld_abs )
+    size_t n_f = sg->frames.size();
+    size_t n_q = sg->config_size;
+    std::vector<double> q(n_q), TF(2*7*n_f);
+    double *TF_rel = TF.data(), *TF_abs = TF_rel + 7*n_f;
+    for( size_t i = 0; i < n_q; i ++ ) q[i] = sin((double)(i+1));
+    sg->tf( q.data(), n_f, TF_rel, 7, TF_abs, 7 );
+
+    for( size_t c = 0; c < kin->chain_count; c ++ ) {
+        const struct aa_rx_dl_sg_chain *chain = kin->chains + c;
+        aa_rx_frame_id root = aa_rx_sg_frame_id( scene_graph, chain->root );
+        aa_rx_frame_id tip = aa_rx_sg_frame_id( scene_graph, chain->tip );
+        if( AA_RX_FRAME_NONE == root || tip < 0 ) return AA_RX_INVALID_FRAME;
+
+        struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( scene_graph, root, tip );
+        size_t n_c = ssg->config_count;
+        int r = 0;
+        if( n_c != chain->config_count ) r = AA_RX_INVALID_FRAME;
+        for( size_t i = 0; !r && i < n_c; i ++ ) {
+            if( strcmp(sg->config_rmap[ssg->configs[i]], chain->configs[i]) ) {
+                r = AA_RX_INVALID_FRAME;
+            }
+        }
+        if( !r ) {
+            std::vector<double> J(12*n_c);
+            double *J_k = J.data() + 6*n_c;
+            aa_rx_sg_sub_jacobian( ssg, n_f, TF_abs, 7, J.data(), 6 );
+            chain->jacobian( TF_abs, 7, J_k, 6 );
+            for( size_t i = 0; i < 6*n_c; i ++ ) {
+                if( fabs(J[i] - J_k[i]) > 1e-9 * (1 + fabs(J[i])) ) {
+                    r = AA_RX_INVALID_PARAMETER;
+                }
+            }
+        }
+        aa_rx_sg_sub_destroy( ssg );
+        if( r ) return r;
+    }
+    return 0;
+}
+
+AA_API int
+aa_rx_sg_set_kin( struct aa_rx_sg *scene_graph,
+                  const struct aa_rx_dl_sg_kin *kin )
+{
+    amino::SceneGraph *sg = scene_graph->sg;
+    assert( ! sg->frozen );
+    if( NULL == kin ) {
+        sg->compiled_kin = NULL;
+        return 0;
+    }
+
+    int r = sg->index();
+    if( r ) return r;
+
+    /* The kernels hard-code frame and config indices */
+    if( kin->frame_count != sg->frames.size() ||
+        kin->config_count != sg->config_size )
     {
-        amino::SceneFrame *f = sg->frames[i_frame];
-        double *E_rel = TF_rel + i_rel;
-        double *E_abs = TF_abs + i_abs;
-        // compute relative
-        f->tf_rel( q, E_rel );
-        // chain to global
-        if( f->in_global() ) {
-            // TODO: can we somehow get rid of this branch?
-            //       maybe a separate type for global frames
-            AA_MEM_CPY(E_abs, E_rel, 7);
-        } else {
-            assert( f->parent_id < (ssize_t)i_frame );
-            double *E_abs_parent = TF_abs + (ld_abs * (size_t)f->parent_id);;
-            aa_tf_qutr_mul(E_abs_parent, E_rel, E_abs);
+        return AA_RX_INVALID_FRAME;
+    }
+    for( size_t i = 0; i < kin->frame_count; i ++ ) {
+        if( sg->frames[i]->name != kin->frames[i] ) return AA_RX_INVALID_FRAME;
+    }
+    for( size_t i = 0; i < kin->config_count; i ++ ) {
+        if( strcmp(sg->config_rmap[i], kin->configs[i]) ) return AA_RX_INVALID_FRAME;
+    }
+    if( ! sg_kin_check(sg, kin) ) return AA_RX_INVALID_PARAMETER;
+
+    /* Check chains against the generic Jacobian */
+    const struct aa_rx_dl_sg_kin *old = sg->compiled_kin;
+    sg->compiled_kin = NULL;
+    r = sg_kin_check_chains( scene_graph, kin );
+    sg->compiled_kin = r ? old : kin;
+    return r;
+}
+
+AA_API const struct aa_rx_dl_sg_kin *
+aa_rx_sg_get_kin( const struct aa_rx_sg *scene_graph )
+{
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+    return scene_graph->sg->compiled_kin;
+}
+
+AA_API void
+aa_rx_sg_add_ik( struct aa_rx_sg *scene_graph,
+                 const struct aa_rx_ik_analytic *ik )
+{
+    amino::SceneGraph *sg = scene_graph->sg;
+    assert( ! sg->frozen );
+    sg->analytic_ik.push_back(ik);
+}
+
+AA_API const struct aa_rx_ik_analytic *
+aa_rx_sg_sub_ik( const struct aa_rx_sg_sub *ssg )
+{
+    const struct aa_rx_sg *scene_graph = ssg->scenegraph;
+    const std::vector<const struct aa_rx_ik_analytic *> &v = scene_graph->sg->analytic_ik;
+    if( v.empty() || 0 == ssg->frame_count ) return NULL;
+
+    aa_rx_frame_id root = aa_rx_sg_frame_parent( scene_graph, ssg->frames[0] );
+    aa_rx_frame_id tip = ssg->frames[ssg->frame_count - 1];
+    const char *root_name = root >= 0 ? aa_rx_sg_frame_name(scene_graph, root) : "";
+    const char *tip_name = aa_rx_sg_frame_name(scene_graph, tip);
+
+    /* Only a chain matches: its frames are exactly those from root to tip */
+    if( ssg->frame_count != aa_rx_sg_chain_frame_count(scene_graph, root, tip) ) {
+        return NULL;
+    }
+
+    /* Later solvers take precedence */
+    for( size_t j = v.size(); j > 0; j -- ) {
+        const struct aa_rx_ik_analytic *ik = v[j-1];
+        const char *ik_root = ik->root ? ik->root : "";
+        if( strcmp(ik_root, root_name) ||
+            strcmp(ik->tip, tip_name) ||
+            ik->config_count != ssg->config_count )
+        {
+            continue;
         }
+        size_t i = 0;
+        while( i < ik->config_count &&
+               0 == strcmp(ik->configs[i], aa_rx_sg_config_name(scene_graph, ssg->configs[i])) )
+        {
+            i++;
+        }
+        if( i == ik->config_count ) return ik;
     }
+
+    return NULL;
+}
+
+static double *
+tf_buf_alloc_aligned( struct aa_mem_region *reg, size_t n )
+{
+    size_t size = n * sizeof(double);
+    uintptr_t p = (uintptr_t)aa_mem_region_alloc( reg, size + AA_TF_QUTR_ALIGN );
+    double *d = (double*)AA_ALIGN2( p, (uintptr_t)AA_TF_QUTR_ALIGN );
+    AA_MEM_ZERO( d, n );
+    return d;
+}
+
+AA_API struct aa_rx_sg_tf_buf *
+aa_rx_sg_tf_buf_alloc( const struct aa_rx_sg *scene_graph,
+                       struct aa_mem_region *reg )
+{
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+
+    struct aa_rx_sg_tf_buf *buf = AA_MEM_REGION_NEW( reg, struct aa_rx_sg_tf_buf );
+    buf->n_tf = aa_rx_sg_frame_count(scene_graph);
+    buf->ld = AA_TF_QUTR_LD_ALIGNED;
+    buf->TF_rel = tf_buf_alloc_aligned( reg, buf->ld * buf->n_tf );
+    buf->TF_abs = tf_buf_alloc_aligned( reg, buf->ld * buf->n_tf );
+    return buf;
+}
+
+AA_API void aa_rx_sg_tf_buf_fill
+( const struct aa_rx_sg *scene_graph,
+  size_t n_q, const double *q,
+  struct aa_rx_sg_tf_buf *buf )
+{
+    aa_rx_sg_tf( scene_graph, n_q, q, buf->n_tf,
+                 buf->TF_rel, buf->ld,
+                 buf->TF_abs, buf->ld );
+}
+
+AA_API void aa_rx_sg_tf_batch
+( const struct aa_rx_sg *scene_graph,
+  size_t n_batch,
+  size_t n_q, const double *Q, size_t ld_q,
+  size_t n_tf,
+  double *TF_rel, size_t ld_rel, size_t stride_rel,
+  double *TF_abs, size_t ld_abs, size_t stride_abs )
+{
+    if( NULL == scene_graph ) return;
+
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+    assert( n_q == scene_graph->sg->config_size );
+    (void)n_q;
+
+    scene_graph->sg->kinematics.tf_batch( n_batch, Q, ld_q,
+                                          n_tf,
+                                          TF_rel, ld_rel, stride_rel,
+                                          TF_abs, ld_abs, stride_abs );
 }
 
 
@@ -251,61 +478,60 @@ AA_API void aa_rx_sg_tf_update
     amino::SceneGraph *sg = scene_graph->sg;
     assert( n_q == scene_graph->sg->config_size );
 
-    bool updated[sg->frames.size()];
-
-    size_t i_frame = 0;
-    for( size_t i_rel0 = 0, i_abs0 = 0,
-             i_rel = 0, i_abs = 0;
-         i_frame < n_tf && i_frame < sg->frames.size();
-         i_frame++, i_rel += ld_rel, i_abs += ld_abs,
-             i_rel0 += ld_rel0, i_abs0 += ld_abs0
-        )
-    {
-        amino::SceneFrame *f = sg->frames[i_frame];
-        enum aa_rx_frame_type type = f->type;
-        bool update_abs = 0;
-        bool in_global =  f->in_global();
-
-        const double *E_rel0 = TF_rel0 + i_rel0;
-        const double *E_abs0 = TF_abs0 + i_abs0;
-        double *E_rel  = TF_rel + i_rel;
-        double *E_abs  = TF_abs + i_abs;
-
-        switch( type ) {
-        case AA_RX_FRAME_FIXED:
-            f->tf_rel(q, E_rel);
-            update_abs = !in_global && updated[f->parent_id];
-            break;
-        case AA_RX_FRAME_REVOLUTE:
-        case AA_RX_FRAME_PRISMATIC: {
-            amino::SceneFrameJoint *fj = static_cast<amino::SceneFrameJoint*>(f);
-            if( aa_feq(q0[fj->config_index], q[fj->config_index], 0 )) {
-                AA_MEM_CPY(E_rel, E_rel0, 7);
-                update_abs = !in_global && updated[f->parent_id];
-            } else {
-                f->tf_rel(q, E_rel);
-                update_abs = 1;
-            }
-            break; }
-        }
+    /* Start from the initial transforms */
+    size_t n_f = AA_MIN( n_tf, sg->frames.size() );
+    if( TF_rel != TF_rel0 || ld_rel != ld_rel0 ) {
+        aa_cla_dlacpy( ' ', 7, (int)n_f, TF_rel0, (int)ld_rel0, TF_rel, (int)ld_rel );
+    }
+    if( TF_abs != TF_abs0 || ld_abs != ld_abs0 ) {
+        aa_cla_dlacpy( ' ', 7, (int)n_f, TF_abs0, (int)ld_abs0, TF_abs, (int)ld_abs );
+    }
 
-        if( update_abs ) {
-            // chain to global
-            if( in_global ) {
-                // TODO: can we somehow get rid of this branch?
-                //       maybe a separate type for global frames
-                AA_MEM_CPY(E_abs, E_rel, 7);
-            } else {
-                assert( f->parent_id < (ssize_t)i_frame );
-                double *E_abs_parent = TF_abs + (ld_abs * (size_t)f->parent_id);;
-                aa_tf_qutr_mul(E_abs_parent, E_rel, E_abs);
-            }
-            updated[i_frame] = 1;
-        } else {
-            AA_MEM_CPY(E_abs, E_abs0, 7);
-            updated[i_frame] = 0;
-        }
+    /* Find the changed configurations */
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+    aa_rx_config_id *changed = AA_MEM_REGION_NEW_N( reg, aa_rx_config_id, n_q );
+    size_t n_changed = 0;
+    for( size_t i = 0; i < n_q; i ++ ) {
+        if( q0[i] != q[i] ) changed[n_changed++] = (aa_rx_config_id)i;
     }
+
+    sg->kinematics.tf_update( q, n_changed, changed,
+                              n_tf,
+                              TF_rel, ld_rel,
+                              TF_abs, ld_abs );
+
+    aa_mem_region_pop( reg, changed );
+}
+
+AA_API void aa_rx_sg_tf_update_configs
+( const struct aa_rx_sg *scene_graph,
+  size_t n_q, const double *q,
+  size_t n_changed, const aa_rx_config_id *changed,
+  size_t n_tf,
+  double *TF_rel, size_t ld_rel,
+  double *TF_abs, size_t ld_abs )
+{
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+    assert( n_q == scene_graph->sg->config_size );
+    (void)n_q;
+
+    scene_graph->sg->kinematics.tf_update( q, n_changed, changed,
+                                           n_tf,
+                                           TF_rel, ld_rel,
+                                           TF_abs, ld_abs );
+}
+
+AA_API void aa_rx_sg_frame_tf_rel
+( const struct aa_rx_sg *scene_graph, aa_rx_frame_id frame,
+  size_t n_q, const double *q,
+  double E[7] )
+{
+    aa_rx_sg_ensure_clean_frames( scene_graph );
+    assert( n_q == scene_graph->sg->config_size );
+    assert( frame >= 0 && (size_t)frame < scene_graph->sg->frames.size() );
+    (void)n_q;
+
+    scene_graph->sg->kinematics.tf_rel( (size_t)frame, q, E );
 }
 
 
@@ -397,10 +623,18 @@ get_limits( struct aa_rx_sg *scenegraph,
             const char *config_name )
 {
     amino::SceneGraph *sg = scenegraph->sg;
+    assert( ! sg->frozen );
     struct aa_rx_config_limits *l = sg->limits_map[config_name];
     if( NULL == l ) {
         l = AA_NEW0(struct aa_rx_config_limits);
         sg->limits_map[config_name] = l;
+        /* Make the new limits visible by config index */
+        if( sg->dirty_indices ) {
+            sg->reindex_first = 0;
+        } else {
+            size_t i = sg->config_index.find(config_name);
+            if( SIZE_MAX != i ) sg->limits[i] = l;
+        }
     }
 
     return l;
@@ -456,7 +690,7 @@ aa_rx_sg_frame_set_inertial( struct aa_rx_sg *scenegraph,
                              const double inertia[9] )
 {
     amino::SceneGraph *sg = scenegraph->sg;
-    struct amino::SceneFrame *f = sg->frame_map[frame];
+    struct amino::SceneFrame *f = sg->mutable_frame( sg->find_frame(frame) );
     if( NULL == f->inertial ) {
         f->inertial = AA_NEW(struct aa_rx_inertial);
     }
@@ -552,84 +786,16 @@ AA_API void aa_rx_sg_reparent_name (const struct aa_rx_sg *scene_graph,
                                     const char *frame,
                                     const double * E1)
 {
-    amino::SceneFrame *f = scene_graph->sg->frame_map[frame];
-
-    f->parent = ( (NULL == new_parent || '\0' == new_parent[0])
-                  ? ""
-                  : new_parent );
-
-    AA_MEM_CPY(f->E, E1, 7);
-
-    scene_graph->sg->dirty_indices = 1;
+    amino::SceneGraph *sg = scene_graph->sg;
+    sg->reparent( sg->find_frame(frame), new_parent, E1 );
 }
 
-struct sg_copy_geom_cx{
-    const aa_rx_sg *sg_old;
-    aa_rx_sg *sg_new;
-};
-
-static void sg_copy_geom(void *context, aa_rx_frame_id frame_id, struct aa_rx_geom *geom0)
-{
-    sg_copy_geom_cx * cx = (sg_copy_geom_cx* ) context;
-    struct aa_rx_geom *geom1 = aa_rx_geom_copy(geom0);
-    aa_rx_geom_attach( cx->sg_new,
-                       aa_rx_sg_frame_name(cx->sg_old, frame_id),
-                       geom1);
-};
-
 AA_API  struct aa_rx_sg *  aa_rx_sg_copy( const struct aa_rx_sg * orig){
     aa_rx_sg_ensure_clean_frames( orig );
 
-    aa_rx_sg * dest = aa_rx_sg_create();
-
-    // add frames
-    for (size_t i=0; i<orig->sg->frames.size(); i++){
-        amino::SceneFrame * f = orig->sg->frames[i];
-        amino::SceneFrame * f_new = NULL;
-        switch (f->type){
-        case AA_RX_FRAME_FIXED: {
-            f_new = new amino::SceneFrameFixed(f->parent.c_str(), f->name.c_str(), f->E + AA_TF_QUTR_Q, f->E + AA_TF_QUTR_V);
-            } break;
-        case AA_RX_FRAME_REVOLUTE: {
-            amino::SceneFrameRevolute * fr = (amino::SceneFrameRevolute*) f;
-            f_new = new amino::SceneFrameRevolute(fr->parent.c_str(), fr->name.c_str(),
-                fr->E + AA_TF_QUTR_Q, fr->E + AA_TF_QUTR_V,
-                fr->config_name.c_str(), fr->offset, fr->axis);
-            } break;
-        case AA_RX_FRAME_PRISMATIC: {
-            amino::SceneFramePrismatic * fp = (amino::SceneFramePrismatic*) f;
-            f_new = new amino::SceneFramePrismatic(fp->parent.c_str(), fp->name.c_str(),
-                fp->E + AA_TF_QUTR_Q, fp->E + AA_TF_QUTR_V,
-                fp->config_name.c_str(), fp->offset, fp->axis);
-            } break;
-        }
-        assert(f_new);
-        dest->sg->add(f_new);
-    }
-
-    // set limits
-    for( auto &pair : orig->sg->limits_map ) {
-        aa_rx_config_limits * nl = new aa_rx_config_limits();
-        *nl = *pair.second;
-        dest->sg->limits_map[pair.first] = nl;
-    }
-
-    // set geometries
-    sg_copy_geom_cx cx;
-    cx.sg_old = orig;
-    cx.sg_new = dest;
-    aa_rx_sg_map_geom(orig, sg_copy_geom, &cx);
-
-    // set allowed collision
-    for (auto &pair : orig->sg->allowed){
-        aa_rx_sg_allow_collision_name(dest, pair.first, pair.second, 1);
-    }
-
-    // initialize sg
-    dest->sg->index();
-
+    aa_rx_sg * dest = new aa_rx_sg;
+    dest->sg = new amino::SceneGraph( *orig->sg );
     return dest;
-
 }
 
 AA_API void
@@ -645,14 +811,15 @@ AA_API void
 aa_rx_sg_allow_collision_name( struct aa_rx_sg *scene_graph,
                                const char* frame0, const char* frame1, const int allowed )
 {
-    bool order = strcmp(frame0, frame1) <0;
+    amino::SceneGraph *sg = scene_graph->sg;
+    assert( ! sg->frozen );
     const char *string0, *string1;
     if (strcmp(frame0, frame1)<0){
-        string0 = scene_graph->sg->frame_map[frame0]->name.c_str();
-        string1 = scene_graph->sg->frame_map[frame1]->name.c_str();
+        string0 = sg->find_frame(frame0)->name.c_str();
+        string1 = sg->find_frame(frame1)->name.c_str();
     } else {
-        string0 = scene_graph->sg->frame_map[frame1]->name.c_str();
-        string1 = scene_graph->sg->frame_map[frame0]->name.c_str();
+        string0 = sg->find_frame(frame1)->name.c_str();
+        string1 = sg->find_frame(frame0)->name.c_str();
     }
     std::pair<const char*, const char*> p(string0, string1);
     if (allowed){
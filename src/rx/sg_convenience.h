@@ -49,7 +49,7 @@ typedef amino::SceneFrame aa_rx_scene_frame;
 static inline aa_rx_scene_frame *
 aa_rx_sg_find( aa_rx_sg *scene_graph, const char *frame )
 {
-    return scene_graph->sg->frame_map[frame];
+    return scene_graph->sg->find_frame(frame);
 }
 
 
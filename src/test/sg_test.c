@@ -45,13 +45,33 @@
 #include "amino/rx/rxtype.h"
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scenegraph_internal.h"
+#include "amino/rx/scene_plugin.h"
+#include "amino/rx/scene_geom.h"
+#include "amino/rx/scene_dyn.h"
+#include "amino/rx/scene_kin.h"
+#include "amino/rx/scene_sub.h"
+#include "amino/rx/rxerr.h"
+#include "amino/kin.h"
 #include <assert.h>
+#include <pthread.h>
 
 
 
 static void scara( struct aa_rx_sg *sg );
 static void check_scara( struct aa_rx_sg *sg );
 static void check_tf( struct aa_rx_sg *sg );
+static void check_tf_axes( void );
+static void check_tf_batch( struct aa_rx_sg *sg );
+static void check_tf_update( struct aa_rx_sg *sg );
+static void check_tf_buf( struct aa_rx_sg *sg );
+static void check_tf_kin( struct aa_rx_sg *sg );
+static void check_reindex( void );
+static void check_snapshot( void );
+static void check_freeze( void );
+static void check_tf_parallel( void );
+static void check_ik( void );
+static void check_ik_multi( void );
+static void check_ik_analytic( void );
 
 int main(void)
 {
@@ -61,11 +81,22 @@ int main(void)
 
     check_scara(sg);
     check_tf(sg);
+    check_tf_update(sg);
+    check_tf_kin(sg);
 
 
 
     aa_rx_sg_destroy(sg);
 
+    check_tf_axes();
+    check_reindex();
+    check_snapshot();
+    check_freeze();
+    check_tf_parallel();
+    check_ik();
+    check_ik_multi();
+    check_ik_analytic();
+
     return 0;
 }
 
@@ -128,6 +159,21 @@ static void check_scara( struct aa_rx_sg *sg )
     assert( 4 == aa_rx_sg_frame_count(sg) );
     assert( 4 == aa_rx_sg_config_count(sg) );
 
+    /* Name lookup from non-interned strings */
+    for( size_t i = 0; i < aa_rx_sg_frame_count(sg); i ++ ) {
+        char buf[32];
+        strcpy( buf, aa_rx_sg_frame_name(sg, (aa_rx_frame_id)i) );
+        assert( (aa_rx_frame_id)i == aa_rx_sg_frame_id(sg, buf) );
+    }
+    for( size_t i = 0; i < aa_rx_sg_config_count(sg); i ++ ) {
+        char buf[32];
+        strcpy( buf, aa_rx_sg_config_name(sg, (aa_rx_config_id)i) );
+        assert( (aa_rx_config_id)i == aa_rx_sg_config_id(sg, buf) );
+    }
+    assert( AA_RX_FRAME_ROOT == aa_rx_sg_frame_id(sg, "") );
+    assert( AA_RX_FRAME_NONE == aa_rx_sg_frame_id(sg, "q4") );
+    assert( AA_RX_CONFIG_NONE == aa_rx_sg_config_id(sg, "q4") );
+
     // aa_rx_config_id cid0 = aa_rx_sg_config_id(sg,"q0");
     // aa_rx_config_id cid1 = aa_rx_sg_config_id(sg,"q1");
     // aa_rx_config_id cid2 = aa_rx_sg_config_id(sg,"q2");
@@ -195,3 +241,1276 @@ static void check_tf( struct aa_rx_sg *sg )
         aveq( "chain 0", 7*4, E_ref, TF_abs, 1e-6 );
     }
 }
+
+static void check_tf_axes( void )
+{
+    /* Rotated joint frames with non-unit axes and offsets */
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    double q0[4], q1[4];
+    double axis0[3] = {0, 2, 0};
+    double axis1[3] = {1, 1, 0};
+    double v0[3] = {.1, .2, .3};
+    double v1[3] = {-.3, .5, .2};
+    double rv0[3] = {.3, -.2, .1};
+    double rv1[3] = {-.4, .1, .7};
+    aa_tf_rotvec2quat(rv0, q0);
+    aa_tf_rotvec2quat(rv1, q1);
+
+    aa_rx_sg_add_frame_revolute( sg, "", "a", q0, v0, "qa", axis0, .25 );
+    aa_rx_sg_add_frame_prismatic( sg, "a", "b", q1, v1, "qb", axis1, -.5 );
+    aa_rx_sg_add_frame_fixed( sg, "b", "c", q0, v1 );
+    /* side branch */
+    aa_rx_sg_add_frame_revolute( sg, "a", "d", q1, v0, "qd", axis1, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "d", "e", q1, v1 );
+    aa_rx_sg_init(sg);
+
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double q[n_q];
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    q[aa_rx_sg_config_id(sg,"qa")] = .7;
+    q[aa_rx_sg_config_id(sg,"qb")] = 1.3;
+    q[aa_rx_sg_config_id(sg,"qd")] = -.2;
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+
+    /* reference */
+    double Ea[7], Eb[7], Ec[7], h[4], x[3], E[7];
+    double qa = .7 + .25, qb = 1.3 - .5;
+    for( size_t i = 0; i < 3; i ++ ) x[i] = qa*axis0[i];
+    aa_tf_rotvec2quat(x, h);
+    aa_tf_qv_chain( q0, v0, h, aa_tf_vec_ident, Ea, Ea+4 );
+
+    for( size_t i = 0; i < 3; i ++ ) x[i] = qb*axis1[i];
+    aa_tf_qv_chain( q1, v1, aa_tf_quat_ident, x, E, E+4 );
+    aa_tf_qutr_mul( Ea, E, Eb );
+
+    AA_MEM_CPY( E, q0, 4 );
+    AA_MEM_CPY( E+4, v1, 3 );
+    aa_tf_qutr_mul( Eb, E, Ec );
+
+    aveq( "axes a", 7, Ea, TF_abs + 7*aa_rx_sg_frame_id(sg,"a"), 1e-9 );
+    aveq( "axes b", 7, Eb, TF_abs + 7*aa_rx_sg_frame_id(sg,"b"), 1e-9 );
+    aveq( "axes c", 7, Ec, TF_abs + 7*aa_rx_sg_frame_id(sg,"c"), 1e-9 );
+
+    check_tf_batch(sg);
+    check_tf_update(sg);
+    check_tf_buf(sg);
+
+    aa_rx_sg_destroy(sg);
+}
+
+static void check_tf_buf( struct aa_rx_sg *sg )
+{
+    struct aa_mem_region *reg = aa_mem_region_local_get();
+    struct aa_rx_sg_tf_buf *buf = aa_rx_sg_tf_buf_alloc(sg, reg);
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double q[n_q];
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    for( size_t i = 0; i < n_q; i ++ ) q[i] = M_PI * (2*aa_frand() - 1);
+
+    test( "tf buf ld", AA_TF_QUTR_LD_ALIGNED == buf->ld );
+    test( "tf buf align",
+          0 == (uintptr_t)buf->TF_rel % AA_TF_QUTR_ALIGN &&
+          0 == (uintptr_t)buf->TF_abs % AA_TF_QUTR_ALIGN );
+
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+    aa_rx_sg_tf_buf_fill( sg, n_q, q, buf );
+    for( size_t i = 0; i < n_f; i ++ ) {
+        aveq( "tf buf rel", 7, TF_rel + 7*i, buf->TF_rel + buf->ld*i, 1e-9 );
+        aveq( "tf buf abs", 7, TF_abs + 7*i, buf->TF_abs + buf->ld*i, 1e-9 );
+    }
+
+    aa_mem_region_pop( reg, buf );
+}
+
+static void check_tf_batch( struct aa_rx_sg *sg )
+{
+    /* Batch size not a multiple of the lane count */
+    size_t n_b = 11;
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t ld_q = n_q + 1;
+    double Q[ld_q*n_b];
+    double TF_rel[7*n_f*n_b], TF_abs[7*n_f*n_b];
+    double E_rel[7*n_f], E_abs[7*n_f];
+
+    for( size_t i = 0; i < ld_q*n_b; i ++ ) {
+        Q[i] = M_PI * (2*aa_frand() - 1);
+    }
+
+    aa_rx_sg_tf_batch( sg, n_b, n_q, Q, ld_q,
+                       n_f,
+                       TF_rel, 7, 7*n_f,
+                       TF_abs, 7, 7*n_f );
+
+    for( size_t i = 0; i < n_b; i ++ ) {
+        aa_rx_sg_tf( sg, n_q, Q + i*ld_q, n_f, E_rel, 7, E_abs, 7 );
+        aveq( "batch rel", 7*n_f, E_rel, TF_rel + i*7*n_f, 1e-9 );
+        aveq( "batch abs", 7*n_f, E_abs, TF_abs + i*7*n_f, 1e-9 );
+    }
+}
+
+static void check_tf_update( struct aa_rx_sg *sg )
+{
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double q0[n_q], q[n_q];
+    double TF_rel0[7*n_f], TF_abs0[7*n_f];
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    double E_rel[7*n_f], E_abs[7*n_f];
+
+    for( size_t i = 0; i < n_q; i ++ ) q0[i] = M_PI * (2*aa_frand() - 1);
+    aa_rx_sg_tf( sg, n_q, q0, n_f, TF_rel0, 7, TF_abs0, 7 );
+
+    /* change each config alone, then the first and last together */
+    for( size_t k = 0; k <= n_q; k ++ ) {
+        aa_rx_config_id changed[2];
+        size_t n_changed;
+        if( k < n_q ) {
+            changed[0] = (aa_rx_config_id)k;
+            n_changed = 1;
+        } else {
+            changed[0] = (aa_rx_config_id)(n_q-1);
+            changed[1] = 0;
+            n_changed = 2;
+        }
+
+        AA_MEM_CPY( q, q0, n_q );
+        for( size_t j = 0; j < n_changed; j ++ ) q[changed[j]] += .5;
+        aa_rx_sg_tf( sg, n_q, q, n_f, E_rel, 7, E_abs, 7 );
+
+        AA_MEM_CPY( TF_rel, TF_rel0, 7*n_f );
+        AA_MEM_CPY( TF_abs, TF_abs0, 7*n_f );
+        aa_rx_sg_tf_update_configs( sg, n_q, q, n_changed, changed,
+                                    n_f, TF_rel, 7, TF_abs, 7 );
+        aveq( "update_configs rel", 7*n_f, E_rel, TF_rel, 1e-9 );
+        aveq( "update_configs abs", 7*n_f, E_abs, TF_abs, 1e-9 );
+
+        aa_rx_sg_tf_update( sg, n_q, q0, q, n_f,
+                            TF_rel0, 7, TF_abs0, 7,
+                            TF_rel, 7, TF_abs, 7 );
+        aveq( "update rel", 7*n_f, E_rel, TF_rel, 1e-9 );
+        aveq( "update abs", 7*n_f, E_abs, TF_abs, 1e-9 );
+    }
+}
+
+/* Kinematics for the scara, in the form emitted by the scene compiler */
+static size_t kin_scara_calls = 0;
+
+static void kin_scara_tf( const double *q,
+                          double *TF_rel, size_t ld_rel,
+                          double *TF_abs, size_t ld_abs )
+{
+    kin_scara_calls++;
+    /* FRAME: q0 */
+    {
+        double *R = TF_rel + 0*ld_rel;
+        double *A = TF_abs + 0*ld_abs;
+        double theta = q[0];
+        double s = sin(0.5*theta), c = cos(0.5*theta);
+        R[0] = 0; R[1] = 0; R[2] = s; R[3] = c;
+        R[4] = l0; R[5] = 0; R[6] = 0;
+        AA_MEM_CPY(A, R, 7);
+    }
+    /* FRAME: q1 */
+    {
+        double *R = TF_rel + 1*ld_rel;
+        double *A = TF_abs + 1*ld_abs;
+        const double *P = TF_abs + 0*ld_abs;
+        double theta = q[1];
+        double s = sin(0.5*theta), c = cos(0.5*theta);
+        R[0] = 0; R[1] = 0; R[2] = s; R[3] = c;
+        R[4] = l1; R[5] = 0; R[6] = 0;
+        aa_tf_qutr_mul(P, R, A);
+    }
+    /* FRAME: q2 */
+    {
+        double *R = TF_rel + 2*ld_rel;
+        double *A = TF_abs + 2*ld_abs;
+        const double *P = TF_abs + 1*ld_abs;
+        double theta = q[2];
+        double s = sin(0.5*theta), c = cos(0.5*theta);
+        R[0] = 0; R[1] = 0; R[2] = s; R[3] = c;
+        R[4] = l2; R[5] = 0; R[6] = 0;
+        aa_tf_qutr_mul(P, R, A);
+    }
+    /* FRAME: q3 */
+    {
+        double *R = TF_rel + 3*ld_rel;
+        double *A = TF_abs + 3*ld_abs;
+        const double *P = TF_abs + 2*ld_abs;
+        double d = q[3];
+        R[0] = 0; R[1] = 0; R[2] = 0; R[3] = 1;
+        R[4] = 0; R[5] = 0; R[6] = d;
+        AA_MEM_CPY(A, P, 4);
+        aa_tf_qrot(P, R+AA_TF_QUTR_T, A+AA_TF_QUTR_T);
+        A[4] += P[4]; A[5] += P[5]; A[6] += P[6];
+    }
+}
+
+/* A kernel with a wrong joint axis */
+static void kin_scara_tf_bad( const double *q,
+                              double *TF_rel, size_t ld_rel,
+                              double *TF_abs, size_t ld_abs )
+{
+    kin_scara_tf( q, TF_rel, ld_rel, TF_abs, ld_abs );
+    double *R = TF_rel + 3*ld_rel;
+    double *A = TF_abs + 3*ld_abs;
+    const double *P = TF_abs + 2*ld_abs;
+    R[4] = q[3]; R[6] = 0;
+    aa_tf_qutr_mul(P, R, A);
+}
+
+/* Jacobian of the scara chain from the root to q3, as emitted by the
+ * scene compiler */
+static size_t kin_scara_jac_calls = 0;
+
+static void kin_scara_jac( const double *TF_abs, size_t ld_abs,
+                           double *J, size_t ld_J )
+{
+    kin_scara_jac_calls++;
+    const double *pe = TF_abs + 3*ld_abs + AA_TF_QUTR_T;
+    /* FRAME: q0 */
+    {
+        const double *E = TF_abs + 0*ld_abs;
+        double *Jr = J + 0*ld_J + AA_TF_DX_W;
+        double *Jt = J + 0*ld_J + AA_TF_DX_V;
+        Jr[0] = (2*(E[0]*E[2] + E[1]*E[3]));
+        Jr[1] = (2*(E[1]*E[2] - E[0]*E[3]));
+        Jr[2] = (1 - 2*(E[0]*E[0] + E[1]*E[1]));
+        double r[3] = {pe[0]-E[4], pe[1]-E[5], pe[2]-E[6]};
+        aa_tf_cross(Jr, r, Jt);
+    }
+    /* FRAME: q1 */
+    {
+        const double *E = TF_abs + 1*ld_abs;
+        double *Jr = J + 1*ld_J + AA_TF_DX_W;
+        double *Jt = J + 1*ld_J + AA_TF_DX_V;
+        Jr[0] = (2*(E[0]*E[2] + E[1]*E[3]));
+        Jr[1] = (2*(E[1]*E[2] - E[0]*E[3]));
+        Jr[2] = (1 - 2*(E[0]*E[0] + E[1]*E[1]));
+        double r[3] = {pe[0]-E[4], pe[1]-E[5], pe[2]-E[6]};
+        aa_tf_cross(Jr, r, Jt);
+    }
+    /* FRAME: q2 */
+    {
+        const double *E = TF_abs + 2*ld_abs;
+        double *Jr = J + 2*ld_J + AA_TF_DX_W;
+        double *Jt = J + 2*ld_J + AA_TF_DX_V;
+        Jr[0] = (2*(E[0]*E[2] + E[1]*E[3]));
+        Jr[1] = (2*(E[1]*E[2] - E[0]*E[3]));
+        Jr[2] = (1 - 2*(E[0]*E[0] + E[1]*E[1]));
+        double r[3] = {pe[0]-E[4], pe[1]-E[5], pe[2]-E[6]};
+        aa_tf_cross(Jr, r, Jt);
+    }
+    /* FRAME: q3 */
+    {
+        const double *E = TF_abs + 3*ld_abs;
+        double *Jr = J + 3*ld_J + AA_TF_DX_W;
+        double *Jt = J + 3*ld_J + AA_TF_DX_V;
+        Jr[0] = 0; Jr[1] = 0; Jr[2] = 0;
+        Jt[0] = (2*(E[0]*E[2] + E[1]*E[3]));
+        Jt[1] = (2*(E[1]*E[2] - E[0]*E[3]));
+        Jt[2] = (1 - 2*(E[0]*E[0] + E[1]*E[1]));
+    }
+}
+
+/* A Jacobian with the wrong sign on the prismatic column */
+static void kin_scara_jac_bad( const double *TF_abs, size_t ld_abs,
+                               double *J, size_t ld_J )
+{
+    kin_scara_jac( TF_abs, ld_abs, J, ld_J );
+    double *Jt = J + 3*ld_J + AA_TF_DX_V;
+    Jt[0] *= -1; Jt[1] *= -1; Jt[2] *= -1;
+}
+
+static void check_tf_kin( struct aa_rx_sg *sg )
+{
+    static const char *frames[] = {"q0", "q1", "q2", "q3"};
+    static const char *configs[] = {"q0", "q1", "q2", "q3"};
+    static const char *swapped[] = {"q1", "q0", "q2", "q3"};
+    static const struct aa_rx_dl_sg_chain chains[] = {
+        {"", "q3", 4, configs, kin_scara_jac} };
+    static const struct aa_rx_dl_sg_chain chains_bad[] = {
+        {"", "q3", 4, configs, kin_scara_jac_bad} };
+    struct aa_rx_dl_sg_kin kin = {4, frames, 4, configs, kin_scara_tf, 1, chains};
+    struct aa_rx_dl_sg_kin bad = {4, frames, 4, swapped, kin_scara_tf, 0, NULL};
+    struct aa_rx_dl_sg_kin wrong = {4, frames, 4, configs, kin_scara_tf_bad, 0, NULL};
+    struct aa_rx_dl_sg_kin wrong_jac = {4, frames, 4, configs, kin_scara_tf, 1, chains_bad};
+
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double q[n_q];
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    double TF_rel_k[7*n_f], TF_abs_k[7*n_f];
+
+    /* Mismatched indices are rejected */
+    test( "kin bad", 0 != aa_rx_sg_set_kin(sg, &bad) );
+    test( "kin bad get", NULL == aa_rx_sg_get_kin(sg) );
+
+    /* Kernels that disagree with the generic kinematics are rejected */
+    test( "kin wrong", AA_RX_INVALID_PARAMETER == aa_rx_sg_set_kin(sg, &wrong) );
+    test( "kin wrong get", NULL == aa_rx_sg_get_kin(sg) );
+    test( "kin wrong jac", AA_RX_INVALID_PARAMETER == aa_rx_sg_set_kin(sg, &wrong_jac) );
+    test( "kin wrong jac get", NULL == aa_rx_sg_get_kin(sg) );
+
+    test( "kin set", 0 == aa_rx_sg_set_kin(sg, &kin) );
+    test( "kin get", &kin == aa_rx_sg_get_kin(sg) );
+
+    for( size_t k = 0; k < 10; k ++ ) {
+        for( size_t i = 0; i < n_q; i ++ ) q[i] = M_PI * (2*aa_frand() - 1);
+        size_t calls = kin_scara_calls;
+        aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel_k, 7, TF_abs_k, 7 );
+        test( "kin called", calls + 1 == kin_scara_calls );
+
+        aa_rx_sg_set_kin(sg, NULL);
+        aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+        aa_rx_sg_set_kin(sg, &kin);
+
+        aveq( "kin rel", 7*n_f, TF_rel, TF_rel_k, 1e-9 );
+        aveq( "kin abs", 7*n_f, TF_abs, TF_abs_k, 1e-9 );
+    }
+
+    /* Chains created with the kernels installed use the compiled Jacobian */
+    {
+        aa_rx_frame_id tip = aa_rx_sg_frame_id( sg, "q3" );
+        struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, tip );
+        size_t rows, cols;
+        aa_rx_sg_sub_jacobian_size( ssg, &rows, &cols );
+        double J[rows*cols], J_k[rows*cols];
+        for( size_t k = 0; k < 10; k ++ ) {
+            for( size_t i = 0; i < n_q; i ++ ) q[i] = M_PI * sin((double)(4*k+i+1));
+            aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+
+            size_t calls = kin_scara_jac_calls;
+            aa_rx_sg_sub_jacobian( ssg, n_f, TF_abs, 7, J_k, rows );
+            test( "kin jac called", calls + 1 == kin_scara_jac_calls );
+
+            aa_rx_sg_set_kin(sg, NULL);
+            aa_rx_sg_sub_jacobian( ssg, n_f, TF_abs, 7, J, rows );
+            test( "kin jac generic", calls + 1 == kin_scara_jac_calls );
+            aa_rx_sg_set_kin(sg, &kin);
+
+            aveq( "kin jac", rows*cols, J, J_k, 1e-9 );
+        }
+        aa_rx_sg_sub_destroy( ssg );
+    }
+
+    /* Re-indexing discards the kernels */
+    aa_rx_sg_add_frame_fixed( sg, "q3", "tip", NULL, aa_tf_vec_ident );
+    aa_rx_sg_init(sg);
+    test( "kin reindex", NULL == aa_rx_sg_get_kin(sg) );
+}
+
+static void reindex_base( struct aa_rx_sg *sg )
+{
+    static const double v[3] = {.1, .2, .3};
+    aa_rx_sg_add_frame_revolute( sg, "", "a", NULL, v, "qa", aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "a", "b", NULL, v, "qb", aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_prismatic( sg, "b", "c", NULL, v, "qc", aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "a", "d", NULL, v, "qd", aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "d", "e", NULL, v );
+    aa_rx_sg_add_frame_fixed( sg, "", "f", NULL, v );
+}
+
+static void reindex_attach( struct aa_rx_sg *sg )
+{
+    static const double v[3] = {-.3, .1, .2};
+    static const double E[7] = {0, 0, 0, 1, .5, 0, 0};
+    aa_rx_sg_add_frame_fixed( sg, "b", "obj", NULL, v );
+    aa_rx_sg_add_frame_revolute( sg, "obj", "obj2", NULL, v, "qo", aa_tf_vec_z, 0 );
+    aa_rx_sg_rm_frame( sg, "e" );
+    aa_rx_sg_reparent_name( sg, "c", "d", E );
+}
+
+static void reindex_detach( struct aa_rx_sg *sg )
+{
+    aa_rx_sg_rm_frame( sg, "obj2" );
+    aa_rx_sg_rm_frame( sg, "obj" );
+}
+
+/* Compare incrementally indexed scene against a fully indexed one */
+static void reindex_compare( struct aa_rx_sg *sg, struct aa_rx_sg *ref )
+{
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    test( "reindex frames", n_f == aa_rx_sg_frame_count(ref) );
+    test( "reindex configs", n_q == aa_rx_sg_config_count(ref) );
+
+    /* Preorder: each frame's parent is an ancestor-or-self of the previous frame */
+    for( size_t i = 0; i < n_f; i ++ ) {
+        aa_rx_frame_id p = aa_rx_sg_frame_parent(sg, (aa_rx_frame_id)i);
+        test( "reindex parent order", p < (aa_rx_frame_id)i );
+        if( i > 0 && AA_RX_FRAME_ROOT != p ) {
+            aa_rx_frame_id a = (aa_rx_frame_id)i-1;
+            while( a != p && AA_RX_FRAME_ROOT != a ) a = aa_rx_sg_frame_parent(sg, a);
+            test( "reindex contiguous", a == p );
+        }
+    }
+
+    double q[n_q], q_ref[n_q];
+    for( size_t i = 0; i < n_q; i ++ ) {
+        q[i] = M_PI * (2*aa_frand() - 1);
+        const char *name = aa_rx_sg_config_name(sg, (aa_rx_config_id)i);
+        q_ref[aa_rx_sg_config_id(ref, name)] = q[i];
+    }
+
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    double TF_rel_ref[7*n_f], TF_abs_ref[7*n_f];
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+    aa_rx_sg_tf( ref, n_q, q_ref, n_f, TF_rel_ref, 7, TF_abs_ref, 7 );
+    for( size_t i = 0; i < n_f; i ++ ) {
+        const char *name = aa_rx_sg_frame_name(sg, (aa_rx_frame_id)i);
+        aa_rx_frame_id j = aa_rx_sg_frame_id(ref, name);
+        aveq( "reindex tf", 7, TF_abs + 7*i, TF_abs_ref + 7*j, 1e-9 );
+    }
+}
+
+static void reindex_check_remap( struct aa_rx_sg *sg, size_t n_old, char old_names[][8] )
+{
+    aa_rx_frame_id remap[n_old];
+    test( "remap size", n_old == aa_rx_sg_frame_remap(sg, n_old, remap) );
+    for( size_t i = 0; i < n_old; i ++ ) {
+        if( AA_RX_FRAME_NONE == remap[i] ) {
+            test( "remap removed", AA_RX_FRAME_NONE == aa_rx_sg_frame_id(sg, old_names[i]) );
+        } else {
+            test( "remap name", 0 == strcmp(old_names[i], aa_rx_sg_frame_name(sg, remap[i])) );
+        }
+    }
+}
+
+static void check_reindex( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_sg *ref = aa_rx_sg_create();
+    char old_names[16][8];
+
+    reindex_base(sg);
+    aa_rx_sg_init(sg);
+
+    /* attach */
+    size_t n_old = aa_rx_sg_frame_count(sg);
+    for( size_t i = 0; i < n_old; i ++ ) {
+        strcpy( old_names[i], aa_rx_sg_frame_name(sg, (aa_rx_frame_id)i) );
+    }
+    reindex_attach(sg);
+    aa_rx_sg_init(sg);
+
+    reindex_base(ref);
+    reindex_attach(ref);
+    aa_rx_sg_init(ref);
+
+    reindex_compare(sg, ref);
+    reindex_check_remap(sg, n_old, old_names);
+
+    /* detach */
+    n_old = aa_rx_sg_frame_count(sg);
+    for( size_t i = 0; i < n_old; i ++ ) {
+        strcpy( old_names[i], aa_rx_sg_frame_name(sg, (aa_rx_frame_id)i) );
+    }
+    reindex_detach(sg);
+    aa_rx_sg_init(sg);
+
+    aa_rx_sg_destroy(ref);
+    ref = aa_rx_sg_create();
+    reindex_base(ref);
+    reindex_attach(ref);
+    reindex_detach(ref);
+    aa_rx_sg_init(ref);
+
+    reindex_compare(sg, ref);
+    reindex_check_remap(sg, n_old, old_names);
+
+    aa_rx_sg_destroy(ref);
+    aa_rx_sg_destroy(sg);
+}
+
+static void snapshot_count_geom( void *cx, aa_rx_frame_id frame_id, struct aa_rx_geom *geom )
+{
+    (void)frame_id; (void)geom;
+    (*(size_t*)cx)++;
+}
+
+static size_t snapshot_geom_count( struct aa_rx_sg *sg )
+{
+    size_t n = 0;
+    aa_rx_sg_map_geom( sg, snapshot_count_geom, &n );
+    return n;
+}
+
+static void check_snapshot( void )
+{
+    static const double box[3] = {.1, .2, .3};
+    static const double inertia[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_sg *ref = aa_rx_sg_create();
+    struct aa_rx_sg *ref_copy = aa_rx_sg_create();
+
+    reindex_base(sg);
+    struct aa_rx_geom_opt *opt = aa_rx_geom_opt_create();
+    aa_rx_geom_attach( sg, "b", aa_rx_geom_box(opt, box) );
+    aa_rx_sg_init(sg);
+    aa_rx_sg_allow_collision_name( sg, "a", "b", 1 );
+
+    reindex_base(ref);
+    aa_rx_sg_init(ref);
+    reindex_base(ref_copy);
+    reindex_attach(ref_copy);
+    aa_rx_sg_init(ref_copy);
+
+    /* Modify the snapshot */
+    struct aa_rx_sg *copy = aa_rx_sg_copy(sg);
+    reindex_compare(copy, ref);
+    reindex_attach(copy);
+    aa_rx_sg_frame_set_inertial( copy, "f", 2, inertia );
+    aa_rx_geom_attach( copy, "b", aa_rx_geom_box(opt, box) );
+    aa_rx_sg_init(copy);
+
+    /* The original is unchanged */
+    reindex_compare(sg, ref);
+    test( "snapshot orig geom", 1 == snapshot_geom_count(sg) );
+    test( "snapshot orig mass",
+          isnan(aa_rx_sg_frame_get_mass(sg, aa_rx_sg_frame_id(sg, "f"))) );
+
+    /* The copy has the changes, and outlives the original */
+    aa_rx_sg_destroy(sg);
+    reindex_compare(copy, ref_copy);
+    test( "snapshot copy geom", 2 == snapshot_geom_count(copy) );
+    test( "snapshot copy mass",
+          2 == aa_rx_sg_frame_get_mass(copy, aa_rx_sg_frame_id(copy, "f")) );
+
+    aa_rx_sg_allow_collision_name( copy, "a", "b", 0 );
+
+    aa_rx_geom_opt_destroy(opt);
+    aa_rx_sg_destroy(copy);
+    aa_rx_sg_destroy(ref_copy);
+    aa_rx_sg_destroy(ref);
+}
+
+#define FREEZE_THREADS 4
+#define FREEZE_ITER 100
+
+struct freeze_cx {
+    const struct aa_rx_sg *sg;
+    const double *q;
+    const double *TF;
+    int ok;
+};
+
+static void *freeze_thread( void *cx_ )
+{
+    struct freeze_cx *cx = (struct freeze_cx*)cx_;
+    size_t n_f = aa_rx_sg_frame_count(cx->sg);
+    size_t n_q = aa_rx_sg_config_count(cx->sg);
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    cx->ok = 1;
+    for( size_t k = 0; k < FREEZE_ITER; k ++ ) {
+        aa_rx_sg_tf( cx->sg, n_q, cx->q, n_f, TF_rel, 7, TF_abs, 7 );
+        for( size_t i = 0; i < 7*n_f; i ++ ) {
+            if( TF_abs[i] != cx->TF[i] ) cx->ok = 0;
+        }
+        if( AA_RX_FRAME_NONE == aa_rx_sg_frame_id(cx->sg, "e") ) cx->ok = 0;
+    }
+    return NULL;
+}
+
+static void check_freeze( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    reindex_base(sg);
+    aa_rx_sg_freeze(sg);
+    test( "freeze", aa_rx_sg_is_frozen(sg) );
+
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double q[n_q], TF_rel[7*n_f], TF_abs[7*n_f];
+    for( size_t i = 0; i < n_q; i ++ ) q[i] = M_PI * (2*aa_frand() - 1);
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+
+    /* Concurrent readers */
+    pthread_t threads[FREEZE_THREADS];
+    struct freeze_cx cx[FREEZE_THREADS];
+    for( size_t i = 0; i < FREEZE_THREADS; i ++ ) {
+        cx[i].sg = sg;
+        cx[i].q = q;
+        cx[i].TF = TF_abs;
+        pthread_create( &threads[i], NULL, freeze_thread, &cx[i] );
+    }
+    for( size_t i = 0; i < FREEZE_THREADS; i ++ ) {
+        pthread_join( threads[i], NULL );
+        test( "freeze concurrent tf", cx[i].ok );
+    }
+
+    /* A copy may be modified */
+    struct aa_rx_sg *copy = aa_rx_sg_copy(sg);
+    test( "freeze copy", ! aa_rx_sg_is_frozen(copy) );
+    aa_rx_sg_add_frame_fixed( copy, "e", "g", NULL, aa_tf_vec_ident );
+    aa_rx_sg_init(copy);
+    test( "freeze copy frames", n_f + 1 == aa_rx_sg_frame_count(copy) );
+    test( "freeze orig frames", n_f == aa_rx_sg_frame_count(sg) );
+
+    aa_rx_sg_destroy(copy);
+    aa_rx_sg_destroy(sg);
+}
+
+static void check_tf_parallel( void )
+{
+    static const double v[3] = {.1, .2, .3};
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    char name[3][32];
+
+    /* Many independent fixtures */
+    for( size_t i = 0; i < 40; i ++ ) {
+        sprintf( name[0], "base%lu", (unsigned long)i );
+        sprintf( name[1], "link%lu", (unsigned long)i );
+        sprintf( name[2], "tip%lu", (unsigned long)i );
+        aa_rx_sg_add_frame_fixed( sg, "", name[0], NULL, v );
+        aa_rx_sg_add_frame_revolute( sg, name[0], name[1], NULL, v, name[1], aa_tf_vec_z, 0 );
+        aa_rx_sg_add_frame_prismatic( sg, name[1], name[2], NULL, v, name[2], aa_tf_vec_x, 0 );
+    }
+    aa_rx_sg_init(sg);
+
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double q[n_q];
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    double TF_rel_p[7*n_f], TF_abs_p[7*n_f];
+    for( size_t i = 0; i < n_q; i ++ ) q[i] = M_PI * (2*aa_frand() - 1);
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+
+    aa_rx_sg_set_tf_parallel( sg, 3, 1 );
+    for( size_t k = 0; k < 10; k ++ ) {
+        AA_MEM_ZERO( TF_abs_p, 7*n_f );
+        aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel_p, 7, TF_abs_p, 7 );
+        aveq( "parallel rel", 7*n_f, TF_rel, TF_rel_p, 0 );
+        aveq( "parallel abs", 7*n_f, TF_abs, TF_abs_p, 0 );
+    }
+
+    /* Copies have their own threads */
+    struct aa_rx_sg *copy = aa_rx_sg_copy(sg);
+    aa_rx_sg_destroy(sg);
+    AA_MEM_ZERO( TF_abs_p, 7*n_f );
+    aa_rx_sg_tf( copy, n_q, q, n_f, TF_rel_p, 7, TF_abs_p, 7 );
+    aveq( "parallel copy", 7*n_f, TF_abs, TF_abs_p, 0 );
+
+    aa_rx_sg_set_tf_parallel( copy, 0, 0 );
+    aa_rx_sg_destroy(copy);
+}
+
+/* A 6-DOF arm, plus an unrelated branch */
+static void ik_arm( struct aa_rx_sg *sg )
+{
+    static const double v0[3] = {0, 0, .3};
+    static const double v1[3] = {0, 0, .4};
+    static const double v2[3] = {.35, 0, 0};
+    static const double v3[3] = {.1, 0, 0};
+    static const double vt[3] = {.1, 0, 0};
+    aa_rx_sg_add_frame_fixed( sg, "", "base", NULL, v0 );
+    aa_rx_sg_add_frame_revolute( sg, "base", "j0", NULL, aa_tf_vec_ident, "q0", aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j0", "j1", NULL, aa_tf_vec_ident, "q1", aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j1", "j2", NULL, v1, "q2", aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j2", "j3", NULL, v2, "q3", aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j3", "j4", NULL, v3, "q4", aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j4", "j5", NULL, aa_tf_vec_ident, "q5", aa_tf_vec_x, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "j5", "tip", NULL, vt );
+    aa_rx_sg_add_frame_fixed( sg, "tip", "tool", NULL, v3 );
+
+    aa_rx_sg_add_frame_fixed( sg, "", "table", NULL, v2 );
+    aa_rx_sg_add_frame_revolute( sg, "table", "lid", NULL, v3, "q_lid", aa_tf_vec_y, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "j1", "cam", NULL, v3, "q_cam", aa_tf_vec_z, 0 );
+}
+
+static void ik_tip( const struct aa_rx_sg *sg, const char *frame,
+                    size_t n_q, const double *q, double E[7] )
+{
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    double TF_rel[7*n_f], TF_abs[7*n_f];
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+    AA_MEM_CPY( E, TF_abs + 7*aa_rx_sg_frame_id(sg, frame), 7 );
+}
+
+static void ik_check_pose( const char *name, const double E0[7], const double E1[7] )
+{
+    double q_rel[4];
+    aa_tf_qcmul( E0, E1, q_rel );
+    aa_tf_qminimize( q_rel );
+    double theta = 2*atan2( sqrt(q_rel[0]*q_rel[0] + q_rel[1]*q_rel[1] + q_rel[2]*q_rel[2]),
+                            q_rel[3] );
+    double x = aa_la_ssd( 3, E0+AA_TF_QUTR_V, E1+AA_TF_QUTR_V );
+    test( name, fabs(theta) < 1e-2 && sqrt(x) < 1e-3 );
+}
+
+static void ik_trials( const struct aa_rx_sg_sub *ssg, struct aa_rx_ksol_opts *opts,
+                       aa_rx_ik_fun *fun, void *cx, const char *frame )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_s = aa_rx_sg_sub_config_count(ssg);
+
+    for( size_t k = 0; k < 10; k ++ ) {
+        double q_ref[n_q], q_seed[n_q], q_sol[n_q], q_s[n_s];
+        for( size_t i = 0; i < n_q; i ++ ) {
+            q_ref[i] = 2*aa_frand() - 1;
+            q_seed[i] = q_ref[i] + .2*(2*aa_frand() - 1);
+        }
+        /* Configurations outside the chain stay at the seed */
+        AA_MEM_CPY( q_sol, q_seed, n_q );
+        aa_rx_sg_sub_config_get( ssg, n_q, q_ref, n_s, q_s );
+        aa_rx_sg_sub_config_set( ssg, n_s, q_s, n_q, q_sol );
+        double E_ref[7], E_sol[7];
+        ik_tip( sg, frame, n_q, q_sol, E_ref );
+
+        aa_rx_ksol_opts_take_seed( opts, n_q, q_seed, AA_MEM_BORROW );
+        int r = fun( cx, 1, E_ref, 7, n_s, q_s );
+        test( "ik solve", 0 == r );
+
+        aa_rx_sg_sub_config_set( ssg, n_s, q_s, n_q, q_sol );
+        ik_tip( sg, frame, n_q, q_sol, E_sol );
+        ik_check_pose( "ik pose", E_ref, E_sol );
+    }
+}
+
+static void ik_parallel_best( const struct aa_rx_sg_sub *ssg, struct aa_rx_ksol_opts *opts,
+                              struct aa_rx_ik_parallel_cx *par, const char *frame )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_s = aa_rx_sg_sub_config_count(ssg);
+
+    double q_ref[n_q], q_sol[n_q], E_ref[7], E_sol[7];
+    for( size_t i = 0; i < n_q; i ++ ) q_ref[i] = 2*aa_frand() - 1;
+    ik_tip( sg, frame, n_q, q_ref, E_ref );
+
+    /* A poor seed */
+    double q_seed[n_q];
+    for( size_t i = 0; i < n_q; i ++ ) q_seed[i] = -q_ref[i];
+    aa_rx_ksol_opts_take_seed( opts, n_q, q_seed, AA_MEM_BORROW );
+
+    double tol_dq = .1*M_PI/180;
+    aa_rx_ksol_opts_set_tol_dq( opts, tol_dq );
+
+    double q_s_ref[n_s], Q[4*n_s];
+    aa_rx_sg_sub_config_get( ssg, n_q, q_ref, n_s, q_s_ref );
+    size_t n_sol = aa_rx_ik_parallel_solve_best( par, 1, E_ref, 7, q_s_ref, 4, n_s, Q, n_s );
+    test( "ik parallel best", n_sol > 0 );
+    for( size_t j = 0; j < n_sol; j ++ ) {
+        AA_MEM_CPY( q_sol, q_seed, n_q );
+        aa_rx_sg_sub_config_set( ssg, n_s, Q+j*n_s, n_q, q_sol );
+        ik_tip( sg, frame, n_q, q_sol, E_sol );
+        ik_check_pose( "ik parallel best pose", E_ref, E_sol );
+        if( j > 0 ) {
+            test( "ik parallel best order",
+                  aa_la_ssd(n_s, q_s_ref, Q+(j-1)*n_s) <= aa_la_ssd(n_s, q_s_ref, Q+j*n_s) );
+        }
+        for( size_t i = 0; i < j; i ++ ) {
+            test( "ik parallel best distinct",
+                  sqrt(aa_la_ssd(n_s, Q+i*n_s, Q+j*n_s)) >= tol_dq );
+        }
+    }
+
+    /* Out of reach */
+    double E_far[7];
+    AA_MEM_CPY( E_far, E_ref, 7 );
+    E_far[AA_TF_QUTR_T] += 10;
+    test( "ik parallel unreachable",
+          0 != aa_rx_ik_parallel_solve( par, 1, E_far, 7, n_s, q_s_ref ) );
+    test( "ik parallel unreachable best",
+          0 == aa_rx_ik_parallel_solve_best( par, 1, E_far, 7, NULL, 4, n_s, Q, n_s ) );
+
+    /* Seed of the wrong length */
+    aa_rx_ksol_opts_take_seed( opts, n_q-1, q_seed, AA_MEM_BORROW );
+    test( "ik parallel short seed",
+          AA_RX_INVALID_PARAMETER == aa_rx_ik_parallel_solve( par, 1, E_ref, 7, n_s, q_s_ref ) );
+    test( "ik parallel short seed best",
+          0 == aa_rx_ik_parallel_solve_best( par, 1, E_ref, 7, NULL, 4, n_s, Q, n_s ) );
+    aa_rx_ksol_opts_take_seed( opts, n_q, q_seed, AA_MEM_BORROW );
+}
+
+static void ik_path( const struct aa_rx_sg_sub *ssg, struct aa_rx_ksol_opts *opts,
+                     struct aa_rx_ik_lm_cx *lm, const char *frame )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_s = aa_rx_sg_sub_config_count(ssg);
+    size_t n_p = 200;
+
+    /* Cartesian path of a joint-space line */
+    double q0[n_q], q1[n_q], q[n_q];
+    for( size_t i = 0; i < n_q; i ++ ) {
+        q0[i] = 2*aa_frand() - 1;
+        q1[i] = 2*aa_frand() - 1;
+    }
+    double *E = AA_NEW_AR( double, 7*n_p );
+    for( size_t p = 0; p < n_p; p ++ ) {
+        double t = (double)p / (double)(n_p-1);
+        for( size_t i = 0; i < n_q; i ++ ) q[i] = (1-t)*q0[i] + t*q1[i];
+        ik_tip( sg, frame, n_q, q, E + 7*p );
+    }
+
+    double *Q = AA_NEW_AR( double, n_s*n_p );
+    double *dq_max = AA_NEW_AR( double, n_p );
+    int *status = AA_NEW_AR( int, n_p );
+    aa_rx_ksol_opts_take_seed( opts, n_q, q0, AA_MEM_BORROW );
+    int r = aa_rx_ik_lm_solve_batch( lm, n_p, 1, E, 7, n_s, Q, n_s, status, dq_max );
+    test( "ik path solve", 0 == r );
+
+    for( size_t p = 0; p < n_p; p ++ ) {
+        double E_sol[7];
+        test( "ik path status", 0 == status[p] );
+        test( "ik path continuity", dq_max[p] < .05 );
+        AA_MEM_CPY( q, q0, n_q );
+        aa_rx_sg_sub_config_set( ssg, n_s, Q + p*n_s, n_q, q );
+        ik_tip( sg, frame, n_q, q, E_sol );
+        ik_check_pose( "ik path pose", E + 7*p, E_sol );
+    }
+
+    free( status );
+    free( dq_max );
+    free( Q );
+    free( E );
+}
+
+static void ik_cache( struct aa_rx_sg_sub *ssg, struct aa_rx_ksol_opts *opts,
+                      struct aa_rx_ik_jac_cx *cx, struct aa_rx_ik_lm_cx *lm,
+                      const char *frame )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_s = aa_rx_sg_sub_config_count(ssg);
+    const char *filename = "sg_test_ik_cache.bin";
+
+    double q0[n_q];
+    AA_MEM_ZERO( q0, n_q );
+    struct aa_rx_ik_cache *cache = aa_rx_ik_cache_create( n_s, .1, .5 );
+    size_t n = aa_rx_ik_cache_precompute( cache, ssg, aa_rx_sg_frame_id(sg, frame),
+                                          n_q, q0, 500 );
+    test( "ik cache precompute", n > 0 && n == aa_rx_ik_cache_size(cache) );
+
+    /* Round trip */
+    test( "ik cache save", 0 == aa_rx_ik_cache_save(cache, filename) );
+    struct aa_rx_ik_cache *loaded = aa_rx_ik_cache_load( filename );
+    remove( filename );
+    test( "ik cache load", loaded && n == aa_rx_ik_cache_size(loaded) );
+    {
+        double q[n_q], E[7], Q0[2*n_s], Q1[2*n_s];
+        for( size_t i = 0; i < n_q; i ++ ) q[i] = 2*aa_frand() - 1;
+        ik_tip( sg, frame, n_q, q, E );
+        size_t n0 = aa_rx_ik_cache_lookup( cache, E, 2, n_s, Q0, n_s );
+        size_t n1 = aa_rx_ik_cache_lookup( loaded, E, 2, n_s, Q1, n_s );
+        test( "ik cache lookup", n0 == n1 && 0 == memcmp(Q0, Q1, n0*n_s*sizeof(double)) );
+    }
+    aa_rx_ik_cache_destroy( loaded );
+
+    /* Neighbors across a rotation cell and across the flip at pi */
+    {
+        double angles[2][2] = { {.49, .51}, {M_PI-.01, -(M_PI-.01)} };
+        double q_s[n_s], Q[n_s];
+        AA_MEM_ZERO( q_s, n_s );
+        for( size_t j = 0; j < 2; j ++ ) {
+            double E0[7] = {0,0,0,1, .05,.05,.05}, E1[7];
+            AA_MEM_CPY( E1, E0, 7 );
+            aa_tf_zangle2quat( angles[j][0], E0+AA_TF_QUTR_Q );
+            aa_tf_zangle2quat( angles[j][1], E1+AA_TF_QUTR_Q );
+            struct aa_rx_ik_cache *c = aa_rx_ik_cache_create( n_s, .1, .5 );
+            aa_rx_ik_cache_insert( c, E0, n_s, q_s );
+            test( "ik cache rotation neighbor", 1 == aa_rx_ik_cache_lookup(c, E1, 1, n_s, Q, n_s) );
+            aa_rx_ik_cache_destroy( c );
+        }
+    }
+
+    /* Seeded solves */
+    aa_rx_sg_sub_set_ik_cache( ssg, cache );
+    ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, frame );
+    ik_trials( ssg, opts, aa_rx_ik_jac_fun, cx, frame );
+    test( "ik cache insert", aa_rx_ik_cache_size(cache) >= n );
+    aa_rx_sg_sub_set_ik_cache( ssg, NULL );
+
+    aa_rx_ik_cache_destroy( cache );
+}
+
+static void check_ik( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    ik_arm(sg);
+    aa_rx_sg_init(sg);
+
+    struct aa_rx_sg_sub *ssg =
+        aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, aa_rx_sg_frame_id(sg, "tip") );
+    test( "ik chain configs", 6 == aa_rx_sg_sub_config_count(ssg) );
+
+    struct aa_rx_ksol_opts *opts = aa_rx_ksol_opts_create();
+    struct aa_rx_ik_jac_cx *cx = aa_rx_ik_jac_cx_create( ssg, opts );
+    struct aa_rx_ik_lm_cx *lm = aa_rx_ik_lm_cx_create( ssg, opts );
+
+    ik_trials( ssg, opts, aa_rx_ik_jac_fun, cx, "tip" );
+    ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, "tip" );
+
+    /* End-effector on a static branch past the chain */
+    aa_rx_ksol_opts_set_frame( opts, aa_rx_sg_frame_id(sg, "tool") );
+    ik_trials( ssg, opts, aa_rx_ik_jac_fun, cx, "tool" );
+    ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, "tool" );
+
+    /* Nullspace bias */
+    {
+        double q_center[6] = {0}, gain[6];
+        for( size_t i = 0; i < 6; i ++ ) gain[i] = .1;
+        aa_rx_ksol_opts_take_config( opts, 6, q_center, AA_MEM_BORROW );
+        aa_rx_ksol_opts_take_gain_config( opts, 6, gain, AA_MEM_BORROW );
+        ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, "tool" );
+        aa_rx_ksol_opts_take_config( opts, 0, NULL, AA_MEM_BORROW );
+        aa_rx_ksol_opts_take_gain_config( opts, 0, NULL, AA_MEM_BORROW );
+    }
+
+    /* Seed cache */
+    ik_cache( ssg, opts, cx, lm, "tool" );
+
+    /* Path tracking */
+    ik_path( ssg, opts, lm, "tool" );
+
+    /* Multi-start */
+    {
+        struct aa_rx_ik_parallel_cx *par = aa_rx_ik_parallel_cx_create( ssg, opts, 3, 8 );
+        ik_trials( ssg, opts, aa_rx_ik_parallel_fun, par, "tool" );
+        ik_parallel_best( ssg, opts, par, "tool" );
+        aa_rx_ik_parallel_cx_destroy( par );
+    }
+
+    aa_rx_ik_lm_cx_destroy( lm );
+    aa_rx_ik_jac_cx_destroy( cx );
+    aa_rx_ksol_opts_destroy( opts );
+    aa_rx_sg_sub_destroy( ssg );
+    aa_rx_sg_destroy( sg );
+}
+
+/* Two arms on a rotating torso */
+static void ik_bimanual( struct aa_rx_sg *sg )
+{
+    static const double vt[3] = {0, 0, .5};
+    static const double vl[3] = {0, .2, 0};
+    static const double vr[3] = {0, -.2, 0};
+    static const double va[3] = {.3, 0, 0};
+    aa_rx_sg_add_frame_revolute( sg, "", "torso", NULL, vt, "q_torso", aa_tf_vec_z, 0 );
+    const char *side[2] = {"l", "r"};
+    const double *v[2] = {vl, vr};
+    for( size_t s = 0; s < 2; s ++ ) {
+        char n[8][16];
+        for( size_t i = 0; i < 8; i ++ ) sprintf( n[i], "%s%zu", side[s], i );
+        aa_rx_sg_add_frame_revolute( sg, "torso", n[0], NULL, v[s], n[0], aa_tf_vec_y, 0 );
+        aa_rx_sg_add_frame_revolute( sg, n[0], n[1], NULL, aa_tf_vec_ident, n[1], aa_tf_vec_x, 0 );
+        aa_rx_sg_add_frame_revolute( sg, n[1], n[2], NULL, va, n[2], aa_tf_vec_y, 0 );
+        aa_rx_sg_add_frame_revolute( sg, n[2], n[3], NULL, aa_tf_vec_ident, n[3], aa_tf_vec_z, 0 );
+        aa_rx_sg_add_frame_revolute( sg, n[3], n[4], NULL, va, n[4], aa_tf_vec_y, 0 );
+        aa_rx_sg_add_frame_revolute( sg, n[4], n[5], NULL, aa_tf_vec_ident, n[5], aa_tf_vec_x, 0 );
+        aa_rx_sg_add_frame_fixed( sg, n[5], n[6], NULL, va );
+    }
+    aa_rx_sg_add_frame_revolute( sg, "torso", "head", NULL, vt, "q_head", aa_tf_vec_z, 0 );
+}
+
+static void ik_multi_trials( const struct aa_rx_sg_sub *ssg, struct aa_rx_ksol_opts *opts,
+                             aa_rx_ik_fun *fun, void *cx,
+                             size_t n_e, const char **frames )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(ssg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_s = aa_rx_sg_sub_config_count(ssg);
+
+    for( size_t k = 0; k < 5; k ++ ) {
+        double q_ref[n_q], q_seed[n_q], q_sol[n_q], q_s[n_s];
+        for( size_t i = 0; i < n_q; i ++ ) {
+            q_ref[i] = 2*aa_frand() - 1;
+            q_seed[i] = q_ref[i] + .2*(2*aa_frand() - 1);
+        }
+        AA_MEM_CPY( q_sol, q_seed, n_q );
+        aa_rx_sg_sub_config_get( ssg, n_q, q_ref, n_s, q_s );
+        aa_rx_sg_sub_config_set( ssg, n_s, q_s, n_q, q_sol );
+        double E_ref[7*n_e], E_sol[7*n_e];
+        for( size_t j = 0; j < n_e; j ++ ) {
+            ik_tip( sg, frames[j], n_q, q_sol, E_ref + 7*j );
+        }
+
+        aa_rx_ksol_opts_take_seed( opts, n_q, q_seed, AA_MEM_BORROW );
+        int r = fun( cx, n_e, E_ref, 7, n_s, q_s );
+        test( "ik multi solve", 0 == r );
+
+        aa_rx_sg_sub_config_set( ssg, n_s, q_s, n_q, q_sol );
+        for( size_t j = 0; j < n_e; j ++ ) {
+            ik_tip( sg, frames[j], n_q, q_sol, E_sol + 7*j );
+            ik_check_pose( "ik multi pose", E_ref + 7*j, E_sol + 7*j );
+        }
+    }
+}
+
+/* Compare the sparse tree Jacobian against the dense chain Jacobian */
+static void ik_sparse_jacobian( const struct aa_rx_sg_sub *tree, size_t n_e, const char **tips )
+{
+    const struct aa_rx_sg *sg = aa_rx_sg_sub_sg(tree);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    size_t n_f = aa_rx_sg_frame_count(sg);
+    size_t n_s = aa_rx_sg_sub_config_count(tree);
+
+    double q[n_q], TF_rel[7*n_f], TF_abs[7*n_f];
+    for( size_t i = 0; i < n_q; i ++ ) q[i] = 2*aa_frand() - 1;
+    aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+
+    size_t idx[n_e];
+    for( size_t j = 0; j < n_e; j ++ ) {
+        aa_rx_frame_id f = aa_rx_sg_frame_id(sg, tips[j]);
+        for( size_t i = 0; i < aa_rx_sg_sub_frame_count(tree); i ++ ) {
+            if( f == aa_rx_sg_sub_frame(tree, i) ) idx[j] = i;
+        }
+    }
+
+    size_t nnz = aa_rx_sg_sub_jacobian_nnz( tree, n_e, idx );
+    size_t row_ptr[6*n_e+1], col_ind[nnz];
+    double values[nnz];
+    aa_rx_sg_sub_jacobian_csr_pattern( tree, n_e, idx, row_ptr, col_ind );
+    aa_rx_sg_sub_jacobian_csr( tree, n_f, TF_abs, 7, n_e, idx, values );
+    test( "sparse jacobian nnz", row_ptr[6*n_e] == nnz && nnz < 6*n_e*n_s );
+
+    for( size_t j = 0; j < n_e; j ++ ) {
+        struct aa_rx_sg_sub *chain =
+            aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, aa_rx_sg_frame_id(sg, tips[j]) );
+        size_t n_c = aa_rx_sg_sub_config_count(chain);
+        double J[6*n_c];
+        aa_rx_sg_sub_jacobian( chain, n_f, TF_abs, 7, J, 6 );
+
+        /* Expand the sparse rows against the tree configurations */
+        for( size_t d = 0; d < 6; d ++ ) {
+            size_t r = 6*j + d;
+            test( "sparse jacobian row", n_c == row_ptr[r+1] - row_ptr[r] );
+            for( size_t k = row_ptr[r]; k < row_ptr[r+1]; k ++ ) {
+                aa_rx_config_id config = aa_rx_sg_sub_config(tree, col_ind[k]);
+                for( size_t c = 0; c < n_c; c ++ ) {
+                    if( config == aa_rx_sg_sub_config(chain, c) ) {
+                        test( "sparse jacobian value",
+                              aa_feq( values[k], J[6*c + d], 1e-9 ) );
+                    }
+                }
+            }
+        }
+        aa_rx_sg_sub_destroy( chain );
+    }
+
+    /* An empty sub-scenegraph has no Jacobian columns */
+    struct aa_rx_sg_sub *empty = aa_rx_sg_tree_create( sg, AA_RX_FRAME_ROOT, 0, NULL );
+    test( "empty sub jacobian",
+          0 == aa_rx_sg_sub_frame_count(empty) && 0 == aa_rx_sg_sub_config_count(empty) );
+    aa_rx_sg_sub_jacobian( empty, n_f, TF_abs, 7, NULL, 6 );
+    aa_rx_sg_sub_destroy( empty );
+}
+
+static void check_ik_multi( void )
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    ik_bimanual(sg);
+    aa_rx_sg_init(sg);
+
+    /* Both hands */
+    {
+        const char *tips[2] = {"l6", "r6"};
+        aa_rx_frame_id tip_ids[2] = { aa_rx_sg_frame_id(sg, tips[0]),
+                                      aa_rx_sg_frame_id(sg, tips[1]) };
+        struct aa_rx_sg_sub *ssg = aa_rx_sg_tree_create( sg, AA_RX_FRAME_ROOT, 2, tip_ids );
+        test( "ik tree frames", 15 == aa_rx_sg_sub_frame_count(ssg) );
+        test( "ik tree configs", 13 == aa_rx_sg_sub_config_count(ssg) );
+        for( size_t i = 1; i < aa_rx_sg_sub_frame_count(ssg); i ++ ) {
+            test( "ik tree order", aa_rx_sg_sub_frame(ssg,i-1) < aa_rx_sg_sub_frame(ssg,i) );
+        }
+
+        ik_sparse_jacobian( ssg, 2, tips );
+
+        struct aa_rx_ksol_opts *opts = aa_rx_ksol_opts_create();
+        struct aa_rx_ik_jac_cx *cx = aa_rx_ik_jac_cx_create( ssg, opts );
+        struct aa_rx_ik_lm_cx *lm = aa_rx_ik_lm_cx_create( ssg, opts );
+
+        /* Default to the leaves */
+        ik_multi_trials( ssg, opts, aa_rx_ik_jac_fun, cx, 2, tips );
+        ik_multi_trials( ssg, opts, aa_rx_ik_lm_fun, lm, 2, tips );
+
+        /* Weighted */
+        double weights[2] = {1, .5};
+        aa_rx_ksol_opts_take_frame_weights( opts, 2, weights, AA_MEM_BORROW );
+        ik_multi_trials( ssg, opts, aa_rx_ik_lm_fun, lm, 2, tips );
+        aa_rx_ksol_opts_take_frame_weights( opts, 0, NULL, AA_MEM_BORROW );
+
+        aa_rx_ik_lm_cx_destroy( lm );
+        aa_rx_ik_jac_cx_destroy( cx );
+        aa_rx_ksol_opts_destroy( opts );
+        aa_rx_sg_sub_destroy( ssg );
+    }
+
+    /* Seed cache for one arm, with the torso outside the chain */
+    {
+        aa_rx_frame_id tip = aa_rx_sg_frame_id(sg, "l6");
+        aa_rx_frame_id torso = aa_rx_sg_frame_id(sg, "torso");
+        struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, torso, tip );
+        size_t n_q = aa_rx_sg_config_count(sg);
+        size_t n_s = aa_rx_sg_sub_config_count(ssg);
+        size_t n_f = aa_rx_sg_frame_count(sg);
+
+        /* The same samples at two torso angles */
+        double q0[n_q], q1[n_q];
+        AA_MEM_ZERO( q0, n_q );
+        AA_MEM_ZERO( q1, n_q );
+        q1[aa_rx_sg_config_id(sg, "q_torso")] = 1;
+        struct aa_rx_ik_cache *c0 = aa_rx_ik_cache_create( n_s, .5, 1 );
+        struct aa_rx_ik_cache *c1 = aa_rx_ik_cache_create( n_s, .5, 1 );
+        srand(1);
+        aa_rx_ik_cache_precompute( c0, ssg, tip, n_q, q0, 200 );
+        srand(1);
+        aa_rx_ik_cache_precompute( c1, ssg, tip, n_q, q1, 200 );
+
+        for( size_t k = 0; k < 10; k ++ ) {
+            double q[n_q], TF_rel[7*n_f], TF_abs[7*n_f], E[7], Q0[2*n_s], Q1[2*n_s];
+            for( size_t i = 0; i < n_q; i ++ ) q[i] = 2*aa_frand() - 1;
+            aa_rx_sg_tf( sg, n_q, q, n_f, TF_rel, 7, TF_abs, 7 );
+            aa_tf_qutr_cmul( TF_abs + 7*torso, TF_abs + 7*tip, E );
+            size_t n0 = aa_rx_ik_cache_lookup( c0, E, 2, n_s, Q0, n_s );
+            size_t n1 = aa_rx_ik_cache_lookup( c1, E, 2, n_s, Q1, n_s );
+            test( "ik cache torso", n0 > 0 && n0 == n1 &&
+                  0 == memcmp(Q0, Q1, n0*n_s*sizeof(double)) );
+        }
+
+        /* Seeded solves with the torso moving */
+        struct aa_rx_ksol_opts *opts = aa_rx_ksol_opts_create();
+        struct aa_rx_ik_lm_cx *lm = aa_rx_ik_lm_cx_create( ssg, opts );
+        struct aa_rx_ik_jac_cx *cx = aa_rx_ik_jac_cx_create( ssg, opts );
+        aa_rx_sg_sub_set_ik_cache( ssg, c1 );
+        ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, "l6" );
+        ik_trials( ssg, opts, aa_rx_ik_jac_fun, cx, "l6" );
+        aa_rx_sg_sub_set_ik_cache( ssg, NULL );
+
+        aa_rx_ik_jac_cx_destroy( cx );
+        aa_rx_ik_lm_cx_destroy( lm );
+        aa_rx_ksol_opts_destroy( opts );
+        aa_rx_ik_cache_destroy( c1 );
+        aa_rx_ik_cache_destroy( c0 );
+        aa_rx_sg_sub_destroy( ssg );
+    }
+
+    /* Hand and elbow of one arm */
+    {
+        const char *frames[2] = {"l6", "l3"};
+        aa_rx_frame_id ids[2] = { aa_rx_sg_frame_id(sg, frames[0]),
+                                  aa_rx_sg_frame_id(sg, frames[1]) };
+        struct aa_rx_sg_sub *ssg = aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, ids[0] );
+        struct aa_rx_ksol_opts *opts = aa_rx_ksol_opts_create();
+        aa_rx_ksol_opts_take_frames( opts, 2, ids, AA_MEM_BORROW );
+        struct aa_rx_ik_lm_cx *lm = aa_rx_ik_lm_cx_create( ssg, opts );
+
+        ik_multi_trials( ssg, opts, aa_rx_ik_lm_fun, lm, 2, frames );
+
+        /* Mismatched goal count */
+        double q_s[aa_rx_sg_sub_config_count(ssg)];
+        double E[7*3] = {0};
+        size_t n_q = aa_rx_sg_config_count(sg);
+        double q_seed[n_q];
+        AA_MEM_ZERO( q_seed, n_q );
+        aa_rx_ksol_opts_take_seed( opts, n_q, q_seed, AA_MEM_BORROW );
+        test( "ik multi count",
+              AA_RX_INVALID_PARAMETER == aa_rx_ik_lm_solve( lm, 3, E, 7,
+                                                            aa_rx_sg_sub_config_count(ssg), q_s ) );
+
+        aa_rx_ik_lm_cx_destroy( lm );
+        aa_rx_ksol_opts_destroy( opts );
+        aa_rx_sg_sub_destroy( ssg );
+    }
+
+    aa_rx_sg_destroy( sg );
+}
+
+/* Closed-form IK for a planar two-link arm */
+struct ik_planar2 {
+    double l[2];
+    size_t calls;
+};
+
+static int ik_planar2_solve( const void *data, const double E[7], size_t n_q, double *q )
+{
+    struct ik_planar2 *p = (struct ik_planar2*)data;
+    assert( 2 == n_q );
+    p->calls++;
+
+    double ta[2], tb[2];
+    if( aa_kin_planar2_ik_theta2( p->l, E+AA_TF_QUTR_T, ta, tb ) ) return -1;
+
+    /* The elbow branch whose second link matches the goal heading */
+    const double *r = E+AA_TF_QUTR_Q;
+    double phi = 2*atan2( r[2], r[3] );
+    double da = fabs(aa_ang_delta(ta[1], phi));
+    double db = fabs(aa_ang_delta(tb[1], phi));
+    const double *t = da <= db ? ta : tb;
+    q[0] = t[0];
+    q[1] = aa_ang_norm_pi(t[1] - t[0]);
+    return 0;
+}
+
+static void check_ik_analytic( void )
+{
+    static const double v_base[3] = {.5, -.2, .3};
+    static const double v_link[3] = {.4, 0, 0};
+    static const double v_tip[3] = {.3, 0, 0};
+    static const char *configs[2] = {"p0", "p1"};
+    struct ik_planar2 planar = { {.4, .3}, 0 };
+    struct aa_rx_ik_analytic ik = { "pbase", "ptip", 2, configs, ik_planar2_solve, &planar };
+
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    aa_rx_sg_add_frame_revolute( sg, "", "turn", NULL, aa_tf_vec_ident, "q_turn", aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "turn", "pbase", NULL, v_base );
+    aa_rx_sg_add_frame_revolute( sg, "pbase", "pj0", NULL, aa_tf_vec_ident, "p0", aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_revolute( sg, "pj0", "pj1", NULL, v_link, "p1", aa_tf_vec_z, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "pj1", "ptip", NULL, v_tip );
+    aa_rx_sg_add_frame_fixed( sg, "ptip", "pend", NULL, v_tip );
+    aa_rx_sg_init(sg);
+    aa_rx_sg_add_ik( sg, &ik );
+
+    struct aa_rx_sg_sub *ssg =
+        aa_rx_sg_chain_create( sg, aa_rx_sg_frame_id(sg, "pbase"), aa_rx_sg_frame_id(sg, "ptip") );
+    struct aa_rx_sg_sub *other =
+        aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, aa_rx_sg_frame_id(sg, "ptip") );
+    test( "ik analytic match", &ik == aa_rx_sg_sub_ik(ssg) );
+    test( "ik analytic mismatch", NULL == aa_rx_sg_sub_ik(other) );
+    aa_rx_sg_sub_destroy( other );
+
+    struct aa_rx_ksol_opts *opts = aa_rx_ksol_opts_create();
+    struct aa_rx_ik_lm_cx *lm = aa_rx_ik_lm_cx_create( ssg, opts );
+    struct aa_rx_ik_jac_cx *cx = aa_rx_ik_jac_cx_create( ssg, opts );
+
+    ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, "ptip" );
+    test( "ik analytic lm", 10 == planar.calls );
+    ik_trials( ssg, opts, aa_rx_ik_jac_fun, cx, "ptip" );
+    test( "ik analytic jac", 20 == planar.calls );
+
+    /* A frame list holding only the tip keeps the fast path */
+    {
+        aa_rx_frame_id frames[1] = { aa_rx_sg_frame_id(sg, "ptip") };
+        aa_rx_ksol_opts_take_frames( opts, 1, frames, AA_MEM_BORROW );
+        ik_trials( ssg, opts, aa_rx_ik_lm_fun, lm, "ptip" );
+        test( "ik analytic frames", 30 == planar.calls );
+
+        double q[3] = {0}, q_s[2];
+        double E[7];
+        ik_tip( sg, "pj1", 3, q, E );
+        frames[0] = aa_rx_sg_frame_id(sg, "pj1");
+        aa_rx_ksol_opts_take_frames( opts, 1, frames, AA_MEM_BORROW );
+        aa_rx_ksol_opts_take_seed( opts, 3, q, AA_MEM_BORROW );
+        aa_rx_ik_lm_solve( lm, 1, E, 7, 2, q_s );
+        test( "ik analytic other frame", 30 == planar.calls );
+        aa_rx_ksol_opts_take_frames( opts, 0, NULL, AA_MEM_BORROW );
+    }
+
+    /* Out of reach */
+    {
+        double q[3] = {0}, q_s[2];
+        double E[7] = {0, 0, 0, 1, 5, 0, 0};
+        aa_rx_ksol_opts_take_seed( opts, 3, q, AA_MEM_BORROW );
+        test( "ik analytic unreachable", 0 != aa_rx_ik_lm_solve( lm, 1, E, 7, 2, q_s ) );
+    }
+
+    aa_rx_ik_jac_cx_destroy( cx );
+    aa_rx_ik_lm_cx_destroy( lm );
+    aa_rx_ksol_opts_destroy( opts );
+    aa_rx_sg_sub_destroy( ssg );
+    aa_rx_sg_destroy( sg );
+}
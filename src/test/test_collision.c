@@ -6,6 +6,7 @@
 #include "amino/rx/scenegraph.h"
 #include "amino/rx/scene_geom.h"
 #include "amino/rx/scene_collision.h"
+#include "amino/rx/scene_sub.h"
 
 
 static void test_box()
@@ -140,9 +141,250 @@ void test_cylinder()
         assert( 0 == aa_rx_cl_set_get( set,
                                        aa_rx_sg_frame_id(sg, "b"),
                                        aa_rx_sg_frame_id(sg, "c") ) );
+        assert( 1 == aa_rx_cl_set_count(set) );
+
+        /* Set operations */
+        struct aa_rx_cl_set *other = aa_rx_cl_set_create(sg);
+        aa_rx_cl_set_set( other, aa_rx_sg_frame_id(sg, "b"), aa_rx_sg_frame_id(sg, "a"), 1 );
+        aa_rx_cl_set_merge( other, set );
+        assert( 2 == aa_rx_cl_set_count(other) );
+        aa_rx_cl_set_intersect( other, set );
+        assert( 1 == aa_rx_cl_set_count(other) );
+        aa_rx_cl_set_symdiff( other, set );
+        assert( 0 == aa_rx_cl_set_count(other) );
+        aa_rx_cl_set_destroy( other );
+
+        /* Cached static collisions */
+        aa_rx_cl_set_clear( set );
+        assert( aa_rx_cl_check( cl, (size_t)n, TF_abs, 7, set ) );
+        assert( 1 == aa_rx_cl_set_count(set) );
+        aa_rx_cl_allow_name( cl, "a", "c", 1 );
+        assert( !aa_rx_cl_check( cl, (size_t)n, TF_abs, 7, NULL ) );
+
+        /* Distance */
+        struct aa_rx_cl_dist *dist = aa_rx_cl_dist_create(cl);
+        aa_rx_frame_id id_a = aa_rx_sg_frame_id(sg, "a");
+        aa_rx_frame_id id_b = aa_rx_sg_frame_id(sg, "b");
+        aa_rx_frame_id id_c = aa_rx_sg_frame_id(sg, "c");
+        double nrm[3];
+        aa_rx_cl_distance( cl, (size_t)n, TF_abs, 7, INFINITY, dist );
+        assert( fabs(aa_rx_cl_dist_get(dist, id_a, id_b, NULL, NULL, nrm) - .01) < 1e-3 );
+        assert( nrm[2] > .9 );
+        assert( isinf(aa_rx_cl_dist_get(dist, id_a, id_c, NULL, NULL, NULL)) );
+        aa_rx_cl_distance( cl, (size_t)n, TF_abs, 7, .005, dist );
+        assert( isinf(aa_rx_cl_dist_get(dist, id_a, id_b, NULL, NULL, NULL)) );
+        aa_rx_cl_dist_destroy( dist );
+        aa_rx_cl_set_destroy( set );
+    }
+}
+
+void test_motion()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    aa_rx_sg_add_frame_fixed( sg,
+                              "", "plate",
+                              aa_tf_quat_ident, aa_tf_vec_ident );
+    double axis[3] = {0,0,1};
+    aa_rx_sg_add_frame_prismatic( sg,
+                                  "", "m",
+                                  aa_tf_quat_ident, aa_tf_vec_ident,
+                                  "q", axis, 0 );
+
+    double d_plate[3] = {1, 1, .01};
+    double d_m[3] = {.1, .1, .1};
+    aa_rx_geom_attach( sg, "plate", aa_rx_geom_box(opt_cl, d_plate) );
+    aa_rx_geom_attach( sg, "m", aa_rx_geom_box(opt_cl, d_m) );
+
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    size_t n = aa_rx_sg_frame_count(sg);
+    double TF_rel[7*n];
+    double TF_0[7*n], TF_1[7*n], TF_2[7*n];
+    double q0 = -2, q1 = 2, q2 = 3;
+    aa_rx_sg_tf(sg, 1, &q0, n, TF_rel, 7, TF_0, 7 );
+    aa_rx_sg_tf(sg, 1, &q1, n, TF_rel, 7, TF_1, 7 );
+    aa_rx_sg_tf(sg, 1, &q2, n, TF_rel, 7, TF_2, 7 );
+
+    /* Endpoints are free, but the motion passes through the plate */
+    assert( !aa_rx_cl_check( cl, n, TF_0, 7, NULL ) );
+    assert( !aa_rx_cl_check( cl, n, TF_1, 7, NULL ) );
+    assert( aa_rx_cl_check_motion( cl, n, TF_0, 7, TF_1, 7, NULL ) );
+    assert( !aa_rx_cl_check_motion( cl, n, TF_1, 7, TF_2, 7, NULL ) );
+
+    aa_rx_cl_destroy(cl);
+}
+
+void test_moving_groups()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    double axis[3] = {1,0,0};
+    double v_wall[3] = {1,0,0};
+    double v_up[3] = {0,0,.2};
+    double v_post[3] = {0,0,.4};
+    double v_shelf[3] = {1,.8,0};
+    aa_rx_sg_add_frame_fixed( sg, "", "wall", aa_tf_quat_ident, v_wall );
+    aa_rx_sg_add_frame_fixed( sg, "", "shelf", aa_tf_quat_ident, v_shelf );
+    aa_rx_sg_add_frame_prismatic( sg, "", "arm",
+                                  aa_tf_quat_ident, aa_tf_vec_ident,
+                                  "q_arm", axis, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "arm", "post", aa_tf_quat_ident, v_post );
+    /* The finger moves with the arm, but by a config outside the chain */
+    aa_rx_sg_add_frame_prismatic( sg, "arm", "finger",
+                                  aa_tf_quat_ident, v_up,
+                                  "q_finger", axis, 0 );
+    aa_rx_sg_add_frame_fixed( sg, "finger", "obj", aa_tf_quat_ident, v_up );
+
+    double d_wall[3] = {.1, 1, 1};
+    double d[3] = {.1, .1, .1};
+    aa_rx_geom_attach( sg, "wall", aa_rx_geom_box(opt_cl, d_wall) );
+    aa_rx_geom_attach( sg, "shelf", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "arm", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "post", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "finger", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "obj", aa_rx_geom_box(opt_cl, d) );
+
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    struct aa_rx_sg_sub *ssg =
+        aa_rx_sg_chain_create( sg, AA_RX_FRAME_ROOT, aa_rx_sg_frame_id(sg, "arm") );
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    struct aa_rx_cl *cl_all = aa_rx_cl_create(sg);
+    aa_rx_cl_set_moving( cl, ssg );
+
+    struct aa_rx_cl_set *set = aa_rx_cl_set_create(sg);
+    struct aa_rx_cl_dist *dist = aa_rx_cl_dist_create(cl);
+    struct aa_rx_cl_dist *dist_all = aa_rx_cl_dist_create(cl_all);
+    aa_rx_frame_id id_wall = aa_rx_sg_frame_id(sg, "wall");
+    aa_rx_frame_id id_shelf = aa_rx_sg_frame_id(sg, "shelf");
+    aa_rx_frame_id id_arm = aa_rx_sg_frame_id(sg, "arm");
+    size_t n = aa_rx_sg_frame_count(sg);
+    size_t n_q = aa_rx_sg_config_count(sg);
+    double TF_rel[7*n], TF_abs[7*n], q[n_q];
+
+    /* Free, robot and static, attached and static, robot and attached */
+    static const double cases[][3] = { {0, .5, 0},
+                                       {.95, .5, 2},
+                                       {0, .95, 2},
+                                       {0, 0, 1},
+                                       {0, .5, 0} };
+    for( size_t k = 0; k < sizeof(cases)/sizeof(cases[0]); k ++ ) {
+        q[aa_rx_sg_config_id(sg, "q_arm")] = cases[k][0];
+        q[aa_rx_sg_config_id(sg, "q_finger")] = cases[k][1];
+        size_t count = (size_t)cases[k][2];
+        aa_rx_sg_tf( sg, n_q, q, n, TF_rel, 7, TF_abs, 7 );
+
+        aa_rx_cl_set_clear( set );
+        assert( (count > 0) == (0 != aa_rx_cl_check( cl, n, TF_abs, 7, set )) );
+        assert( count == aa_rx_cl_set_count(set) );
+        assert( (count > 0) == (0 != aa_rx_cl_check( cl, n, TF_abs, 7, NULL )) );
+
+        aa_rx_cl_set_clear( set );
+        assert( (count > 0) == (0 != aa_rx_cl_check( cl_all, n, TF_abs, 7, set )) );
+        assert( count == aa_rx_cl_set_count(set) );
+
+        /* Static distances are cached, but only within the margin */
+        aa_rx_cl_distance( cl, n, TF_abs, 7, .2, dist );
+        assert( isinf(aa_rx_cl_dist_get(dist, id_wall, id_shelf, NULL, NULL, NULL)) );
+        double margin = (k % 2) ? INFINITY : .3;
+        double d_min = aa_rx_cl_distance( cl, n, TF_abs, 7, margin, dist );
+        assert( fabs(d_min - aa_rx_cl_distance( cl_all, n, TF_abs, 7, margin, dist_all )) < 1e-6 );
+        assert( fabs(aa_rx_cl_dist_get(dist, id_wall, id_shelf, NULL, NULL, NULL) - .25) < 1e-3 );
+        double d_arm = aa_rx_cl_dist_get(dist, id_arm, id_wall, NULL, NULL, NULL);
+        double d_arm_all = aa_rx_cl_dist_get(dist_all, id_arm, id_wall, NULL, NULL, NULL);
+        assert( (isinf(d_arm) && isinf(d_arm_all)) || fabs(d_arm - d_arm_all) < 1e-6 );
+    }
+
+    /* Continuous checks sweep robot and attached geometry */
+    {
+        static const double motions[][5] = { {0, .5, 2, .5, 4},
+                                             {0, .5, 0, 2, 2},
+                                             {0, .5, 0, .2, 0} };
+        double TF_1[7*n];
+        for( size_t k = 0; k < sizeof(motions)/sizeof(motions[0]); k ++ ) {
+            size_t count = (size_t)motions[k][4];
+            q[aa_rx_sg_config_id(sg, "q_arm")] = motions[k][0];
+            q[aa_rx_sg_config_id(sg, "q_finger")] = motions[k][1];
+            aa_rx_sg_tf( sg, n_q, q, n, TF_rel, 7, TF_abs, 7 );
+            q[aa_rx_sg_config_id(sg, "q_arm")] = motions[k][2];
+            q[aa_rx_sg_config_id(sg, "q_finger")] = motions[k][3];
+            aa_rx_sg_tf( sg, n_q, q, n, TF_rel, 7, TF_1, 7 );
+            assert( !aa_rx_cl_check( cl, n, TF_1, 7, NULL ) );
+
+            aa_rx_cl_set_clear( set );
+            assert( (count > 0) == (0 != aa_rx_cl_check_motion( cl, n, TF_abs, 7, TF_1, 7, set )) );
+            assert( count == aa_rx_cl_set_count(set) );
+            assert( (count > 0) == (0 != aa_rx_cl_check_motion( cl, n, TF_abs, 7, TF_1, 7, NULL )) );
+
+            aa_rx_cl_set_clear( set );
+            assert( (count > 0) == (0 != aa_rx_cl_check_motion( cl_all, n, TF_abs, 7, TF_1, 7, set )) );
+            assert( count == aa_rx_cl_set_count(set) );
+        }
     }
+
+    /* Allowing the only colliding pair skips robot against attached */
+    q[aa_rx_sg_config_id(sg, "q_arm")] = 0;
+    q[aa_rx_sg_config_id(sg, "q_finger")] = 0;
+    aa_rx_sg_tf( sg, n_q, q, n, TF_rel, 7, TF_abs, 7 );
+    aa_rx_cl_allow_name( cl, "post", "obj", 1 );
+    assert( !aa_rx_cl_check( cl, n, TF_abs, 7, NULL ) );
+
+    aa_rx_cl_dist_destroy( dist_all );
+    aa_rx_cl_dist_destroy( dist );
+    aa_rx_cl_set_destroy( set );
+    aa_rx_cl_destroy( cl_all );
+    aa_rx_cl_destroy( cl );
+    aa_rx_sg_sub_destroy( ssg );
 }
 
+void test_reindex_allowed()
+{
+    struct aa_rx_sg *sg = aa_rx_sg_create();
+    struct aa_rx_geom_opt *opt_cl = aa_rx_geom_opt_create();
+    aa_rx_geom_opt_set_collision(opt_cl, 1);
+
+    aa_rx_sg_add_frame_fixed( sg, "", "a", aa_tf_quat_ident, aa_tf_vec_ident );
+    aa_rx_sg_add_frame_fixed( sg, "", "b", aa_tf_quat_ident, aa_tf_vec_ident );
+    aa_rx_sg_add_frame_fixed( sg, "", "c", aa_tf_quat_ident, aa_tf_vec_ident );
+    double d[3] = {.1, .1, .1};
+    aa_rx_geom_attach( sg, "b", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_geom_attach( sg, "c", aa_rx_geom_box(opt_cl, d) );
+    aa_rx_sg_allow_collision_name( sg, "b", "c", 1 );
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    /* Removing a frame without geometry shifts the ids of b and c */
+    aa_rx_frame_id b0 = aa_rx_sg_frame_id(sg, "b");
+    aa_rx_sg_rm_frame( sg, "a" );
+    aa_rx_sg_init(sg);
+    aa_rx_sg_cl_init(sg);
+
+    assert( b0 != aa_rx_sg_frame_id(sg, "b") );
+
+    struct aa_rx_cl_set *set = aa_rx_cl_set_create(sg);
+    aa_rx_sg_cl_set_copy( sg, set );
+    assert( 1 == aa_rx_cl_set_count(set) );
+    assert( aa_rx_cl_set_get(set, aa_rx_sg_frame_id(sg, "b"), aa_rx_sg_frame_id(sg, "c")) );
+
+    struct aa_rx_cl *cl = aa_rx_cl_create(sg);
+    aa_rx_cl_allow_set( cl, set );
+    size_t n = aa_rx_sg_frame_count(sg);
+    double TF_rel[7*n];
+    double TF_abs[7*n];
+    aa_rx_sg_tf(sg, 0, NULL, n, TF_rel, 7, TF_abs, 7 );
+    assert( !aa_rx_cl_check( cl, n, TF_abs, 7, NULL ) );
+
+    aa_rx_cl_destroy(cl);
+    aa_rx_cl_set_destroy(set);
+}
 
 int main( int argc, char **argv)
 {
@@ -150,6 +392,9 @@ int main( int argc, char **argv)
     aa_rx_cl_init();
     test_box();
     test_cylinder();
+    test_motion();
+    test_moving_groups();
+    test_reindex_allowed();
 
     return 0;
 }
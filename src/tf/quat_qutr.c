@@ -83,6 +83,21 @@ aa_tf_qutr_mul( const double A[AA_RESTRICT 7], const double B[AA_RESTRICT 7],
                     C+AA_TF_QUTR_Q, C+AA_TF_QUTR_V );
 }
 
+AA_API void
+aa_tf_qutr_mul_aligned( const double A[AA_RESTRICT 8], const double B[AA_RESTRICT 8],
+                        double C[AA_RESTRICT 8] )
+{
+#ifdef __GNUC__
+    A = (const double*)__builtin_assume_aligned( A, AA_TF_QUTR_ALIGN );
+    B = (const double*)__builtin_assume_aligned( B, AA_TF_QUTR_ALIGN );
+    C = (double*)__builtin_assume_aligned( C, AA_TF_QUTR_ALIGN );
+#endif
+    aa_tf_qv_chain( A+AA_TF_QUTR_Q, A+AA_TF_QUTR_V,
+                    B+AA_TF_QUTR_Q, B+AA_TF_QUTR_V,
+                    C+AA_TF_QUTR_Q, C+AA_TF_QUTR_V );
+    C[AA_TF_QUTR_LD_ALIGNED-1] = 0;
+}
+
 AA_API void
 aa_tf_qv_chainnorm( const double q1[AA_RESTRICT 4], const double v1[AA_RESTRICT 3],
                     const double q2[AA_RESTRICT 4], const double v2[AA_RESTRICT 3],